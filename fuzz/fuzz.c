@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <csum.h>
+
+/*
+ * Every input runs through all usable drivers, held against the plain
+ * C one of each algorithm, a mismatch aborts so the fuzzer keeps it.
+ */
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (csum_selftest_input(data, size))
+        abort();
+
+    return 0;
+}
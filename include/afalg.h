@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _AFALG_H_
+#define _AFALG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <csum.h>
+
+/**
+ * struct afalg_hash - a kernel crypto api hash reached through AF_ALG.
+ * @name: kernel algorithm name, such as "crct10dif".
+ * @size: digest size in bytes, at most eight.
+ * @little: digest is stored little endian rather than in cpu order.
+ * @tfm: bound transform socket, negative when unavailable.
+ */
+struct afalg_hash {
+    const char *name;
+    unsigned int size;
+    bool little;
+    int tfm;
+};
+
+extern int
+afalg_digest(struct afalg_hash *hash, const void *data,
+             size_t length, uint64_t *value);
+
+extern int
+afalg_probe(struct afalg_hash *hash, struct csum_algo *algo);
+
+extern void
+afalg_release(struct afalg_hash *hash);
+
+#endif /* _AFALG_H_ */
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _ASYNC_H_
+#define _ASYNC_H_
+
+#include <csum.h>
+
+#define ASYNC_BUFFER 0x10000
+
+/**
+ * struct csum_async - epoll driven set of concurrent streams.
+ * @entries: streams currently being hashed.
+ * @buffer: read buffer shared by every stream of this loop.
+ * @epoll: descriptor to nest into an external event loop.
+ */
+struct csum_async {
+    struct bfdev_list_head entries;
+    uint8_t buffer[ASYNC_BUFFER];
+    int epoll;
+};
+
+/**
+ * struct csum_async_entry - one non-blocking descriptor being hashed.
+ * @list: entry of &csum_async.entries.
+ * @ctx: prepared context owned by the caller.
+ * @stream: push state of @ctx.
+ * @done: called once at end of stream or on error, result is NULL then.
+ * @pdata: private data of the caller.
+ * @fd: pipe, socket or character device, switched to non-blocking.
+ */
+struct csum_async_entry {
+    struct bfdev_list_head list;
+    struct csum_context *ctx;
+    struct csum_stream stream;
+    void (*done)(struct csum_async_entry *entry, const char *result, int error);
+    void *pdata;
+    int fd;
+};
+
+static inline int
+csum_async_fd(struct csum_async *async)
+{
+    return async->epoll;
+}
+
+static inline bool
+csum_async_empty(struct csum_async *async)
+{
+    return bfdev_list_check_empty(&async->entries);
+}
+
+extern int
+csum_async_init(struct csum_async *async);
+
+extern void
+csum_async_exit(struct csum_async *async);
+
+extern int
+csum_async_add(struct csum_async *async, struct csum_async_entry *entry);
+
+extern void
+csum_async_remove(struct csum_async *async, struct csum_async_entry *entry);
+
+extern int
+csum_async_dispatch(struct csum_async *async, int timeout);
+
+#endif /* _ASYNC_H_ */
@@ -6,11 +6,67 @@
 #ifndef _CSUM_H_
 #define _CSUM_H_
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <errno.h>
+#include <bfdev/bits.h>
 #include <bfdev/list.h>
 
+enum {
+    __CSUM_CPU_SSE2 = 0,
+    __CSUM_CPU_SSSE3,
+    __CSUM_CPU_SSE41,
+    __CSUM_CPU_PCLMUL,
+    __CSUM_CPU_AVX2,
+    __CSUM_CPU_AVX512F,
+    __CSUM_CPU_AVX512BW,
+    __CSUM_CPU_VPCLMUL,
+    __CSUM_CPU_SHA,
+    __CSUM_CPU_NR,
+
+    CSUM_CPU_SSE2 = BFDEV_BIT(__CSUM_CPU_SSE2),
+    CSUM_CPU_SSSE3 = BFDEV_BIT(__CSUM_CPU_SSSE3),
+    CSUM_CPU_SSE41 = BFDEV_BIT(__CSUM_CPU_SSE41),
+    CSUM_CPU_PCLMUL = BFDEV_BIT(__CSUM_CPU_PCLMUL),
+    CSUM_CPU_AVX2 = BFDEV_BIT(__CSUM_CPU_AVX2),
+    CSUM_CPU_AVX512F = BFDEV_BIT(__CSUM_CPU_AVX512F),
+    CSUM_CPU_AVX512BW = BFDEV_BIT(__CSUM_CPU_AVX512BW),
+    CSUM_CPU_VPCLMUL = BFDEV_BIT(__CSUM_CPU_VPCLMUL),
+    CSUM_CPU_SHA = BFDEV_BIT(__CSUM_CPU_SHA),
+};
+
+/*
+ * An accelerated kernel driver reached through AF_ALG is preferred over
+ * the userspace tables but ranks below the cpu instruction drivers. The
+ * kernel runs the same folding on x86 and adds a syscall per block, so
+ * it is picked on its own only where no such driver is usable; -I
+ * takes it anyway, --bench shows whether that pays off.
+ */
+enum {
+    CSUM_PRIO_FALLBACK = 50,
+    CSUM_PRIO_GENERIC = 100,
+    CSUM_PRIO_TABLE = 200,
+    CSUM_PRIO_OFFLOAD = 250,
+    CSUM_PRIO_SIMD = 300,
+    CSUM_PRIO_WIDE = 400,
+};
+
+enum csum_stage {
+    CSUM_STAGE_OPEN = 0,
+    CSUM_STAGE_MAP,
+    CSUM_STAGE_SOURCE,
+    CSUM_STAGE_COMPUTE,
+    CSUM_STAGE_COMBINE,
+    CSUM_STAGE_NR,
+};
+
+struct csum_clock {
+    uint64_t wall;
+    uint64_t cpu;
+};
+
 struct csum_state {
     uintptr_t offset;
     void *pdata;
@@ -22,38 +78,195 @@ struct csum_linear {
     size_t length;
 };
 
+/* most buffers csum_linear_many hands to one many round */
+#define CSUM_MANY_MAX 16
+
+/**
+ * struct csum_stream - incremental push state.
+ * @sta: running state, offset counts every byte pushed so far.
+ * @data: block handed to the next compute round.
+ * @length: size of @data.
+ */
+struct csum_stream {
+    struct csum_state sta;
+    const void *data;
+    size_t length;
+};
+
+/**
+ * struct csum_extent - one range of a multi range request.
+ * @offset: first byte of the range.
+ * @length: size of the range.
+ * @ctx: context owning @result, released by csum_extents_release.
+ * @result: checksum of the range.
+ */
+struct csum_extent {
+    uint64_t offset;
+    uint64_t length;
+    struct csum_context *ctx;
+    const char *result;
+};
+
+#define CSUM_WRITER_BUFFER 0x100000
+#define CSUM_WRITER_ALGOS 256
+#define CSUM_WRITER_DIGEST 128
+
+enum csum_format {
+    CSUM_FORMAT_TEXT = 0,
+    CSUM_FORMAT_JSON,
+    CSUM_FORMAT_NDJSON,
+    CSUM_FORMAT_BINARY,
+};
+
+/**
+ * struct csum_record - one result handed to a writer.
+ * @para: algorithm parameter, may be NULL.
+ * @offset: first byte covered, only reported as text when @ranged.
+ * @size: bytes covered by @result.
+ * @prefixed: @result is a "0x" number printed at the digest width.
+ */
+struct csum_record {
+    const char *algo;
+    const char *para;
+    const char *path;
+    const char *result;
+    uint64_t offset;
+    uint64_t size;
+    bool ranged;
+    bool prefixed;
+};
+
+/**
+ * struct csum_writer - batched output of machine readable records.
+ * @algos: names behind the binary algo ids, in order of first use.
+ * @used: bytes of @buffer holding complete records.
+ */
+struct csum_writer {
+    int fd;
+    enum csum_format format;
+    unsigned long records;
+    unsigned int nalgos;
+    char *algos[CSUM_WRITER_ALGOS];
+    size_t used;
+    uint8_t buffer[CSUM_WRITER_BUFFER];
+};
+
+/**
+ * struct csum_context - one running checksum.
+ * @jobs: threads a compute round may spread one large block over,
+ *        only honoured by tree hashes, zero or one keeps it serial.
+ */
 struct csum_context {
     struct csum_algo *algo;
+    const char *args;
     unsigned long flags;
+    unsigned int jobs;
     size_t (*next_block)(struct csum_context *tsc, struct csum_state *sta,
                          uintptr_t consumed, const void **dest);
 };
 
+/**
+ * struct csum_algo - one implementation of a checksum.
+ * @coreutils: results are printed the "digest  file" way of the
+ *             coreutils sum tools.
+ * @linear: optional, advance over one contiguous buffer and return
+ *          the result, as compute would with a single block.
+ * @many: optional, run several contexts of this implementation to
+ *        their result together, each one reading its own state.
+ */
 struct csum_algo {
     struct bfdev_list_head list;
     struct algorithm_ops *ops;
 
     const char *name;
+    const char *driver;
     const char *desc;
+    unsigned long features;
+    int priority;
+    bool selected;
+    bool coreutils;
 
     struct csum_context *(*prepare)(const char *args, unsigned long flags);
     void (*destroy)(struct csum_context *ctx);
+    void (*reset)(struct csum_context *ctx);
     const char *(*compute)(struct csum_context *ctx, struct csum_state *sta);
+    const char *(*linear)(struct csum_context *ctx, const void *data, size_t length);
+    void (*combine)(struct csum_context *ctx, struct csum_context *next, uint64_t length);
+    void (*zeros)(struct csum_context *ctx, uint64_t length);
+    void (*many)(struct csum_context **ctxs, struct csum_state **stas,
+                 const char **results, unsigned int count);
 };
 
+extern bool csum_stats_enabled;
+
+extern const char *
+csum_stats_compute(struct csum_context *ctx, struct csum_state *sta);
+
+extern void
+csum_stats_start(struct csum_clock *clock);
+
+extern void
+csum_stats_stop(enum csum_stage stage, struct csum_clock *clock, uint64_t bytes);
+
+extern void
+csum_stats_enable(void);
+
+extern void
+csum_stats_report(FILE *stream, bool json);
+
 static inline const char *
-csum_compute(struct csum_context *ctx, struct csum_state *sta)
+csum_next(struct csum_context *ctx, struct csum_state *sta)
 {
     struct csum_algo *algo = ctx->algo;
-    sta->offset = 0;
+
+    if (bfdev_unlikely(csum_stats_enabled))
+        return csum_stats_compute(ctx, sta);
+
     return algo->compute(ctx, sta);
 }
 
 static inline const char *
-csum_next(struct csum_context *ctx, struct csum_state *sta)
+csum_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    sta->offset = 0;
+    return csum_next(ctx, sta);
+}
+
+static inline void
+csum_combine(struct csum_context *ctx, struct csum_state *sta,
+             struct csum_context *next, struct csum_state *nsta)
 {
     struct csum_algo *algo = ctx->algo;
-    return algo->compute(ctx, sta);
+    struct csum_clock clock;
+
+    csum_stats_start(&clock);
+    algo->combine(ctx, next, nsta->offset);
+    csum_stats_stop(CSUM_STAGE_COMBINE, &clock, nsta->offset);
+    sta->offset += nsta->offset;
+}
+
+static inline void
+csum_zeros(struct csum_context *ctx, struct csum_state *sta, uint64_t length)
+{
+    struct csum_algo *algo = ctx->algo;
+    struct csum_clock clock;
+
+    csum_stats_start(&clock);
+    algo->zeros(ctx, length);
+    csum_stats_stop(CSUM_STAGE_COMBINE, &clock, length);
+    sta->offset += length;
+}
+
+static inline int
+csum_reset(struct csum_context *ctx)
+{
+    struct csum_algo *algo = ctx->algo;
+
+    if (!algo->reset)
+        return -EOPNOTSUPP;
+
+    algo->reset(ctx);
+    return 0;
 }
 
 static inline void
@@ -68,12 +281,121 @@ extern struct bfdev_list_head csum_algos;
 extern const char *
 csum_linear_compute(struct csum_context *ctx, struct csum_linear *linear, const void *data, size_t length);
 
+extern const char *
+csum_linear_parallel(struct csum_context *ctx, struct csum_linear *linear,
+                     const void *data, size_t length, unsigned int jobs);
+
+extern void
+csum_linear_many(struct csum_context **ctxs, struct csum_linear *linears,
+                 const char **results, unsigned int count);
+
 extern const char *
 csum_linear_next(struct csum_context *ctx, struct csum_linear *linear);
 
+extern void
+csum_stream_init(struct csum_context *ctx, struct csum_stream *stream);
+
+extern void
+csum_stream_update(struct csum_context *ctx, struct csum_stream *stream,
+                   const void *data, size_t length);
+
+extern const char *
+csum_stream_final(struct csum_context *ctx, struct csum_stream *stream);
+
+extern const char *
+csum_range_compute(struct csum_context *ctx, struct csum_state *sta, int fd,
+                   uint64_t offset, uint64_t length, size_t align, unsigned int jobs);
+
+extern const char *
+csum_concat_compute(struct csum_context *ctx, struct csum_state *sta,
+                    const char *const *paths, unsigned int count, unsigned int jobs,
+                    unsigned int *failed);
+
+extern const char *
+csum_sparse_compute(struct csum_context *ctx, struct csum_state *sta, int fd,
+                    const void *data, uint64_t offset, uint64_t length);
+
+extern const char *
+csum_quick_compute(struct csum_context *ctx, int fd, const void *data,
+                   uint64_t size, unsigned int samples);
+
+extern int
+csum_extents_compute(struct csum_context *ctx, int fd, const void *data,
+                     struct csum_extent *extents, unsigned int count,
+                     size_t align, unsigned int jobs);
+
+extern void
+csum_extents_release(struct csum_extent *extents, unsigned int count);
+
+extern uint64_t
+csum_crc_zeros(uint64_t (*update)(uint64_t crc, const void *data, size_t length),
+               unsigned int width, uint64_t crc, uint64_t length);
+
+extern uint64_t
+csum_crc_combine(uint64_t (*update)(uint64_t crc, const void *data, size_t length),
+                 unsigned int width, uint64_t crc, uint64_t init,
+                 uint64_t next, uint64_t length);
+
+extern uint16_t
+csum_inet_adjust(uint16_t check, const void *old, const void *new, size_t length);
+
+extern int
+csum_bench(FILE *stream, const char *name, const char *args, size_t size);
+
+extern int
+csum_selftest(FILE *stream, unsigned int rounds);
+
+extern int
+csum_selftest_input(const void *data, size_t length);
+
+extern int
+csum_dups(FILE *stream, const char *name, const char *args,
+          const char *const *paths, unsigned int count, unsigned int jobs);
+
+extern int
+csum_watch(FILE *stream, const char *name, const char *args,
+           const char *const *paths, unsigned int count, unsigned int delay,
+           bool strict);
+
+extern int
+csum_format_parse(const char *name);
+
+extern struct csum_writer *
+csum_writer_create(int fd, enum csum_format format);
+
+extern int
+csum_writer_record(struct csum_writer *writer, const struct csum_record *record);
+
+extern int
+csum_writer_flush(struct csum_writer *writer);
+
+extern int
+csum_writer_destroy(struct csum_writer *writer);
+
+extern unsigned long
+csum_cpu_features(void);
+
+extern const char *
+csum_cpu_name(unsigned int feature);
+
+extern struct csum_algo *
+csum_find(const char *name);
+
+extern int
+csum_select(const char *driver);
+
 extern struct csum_context *
 csum_prepare(const char *name, const char *args, unsigned long flags);
 
+extern void
+csum_prepare_fail(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+extern const char *
+csum_prepare_error(void);
+
+extern struct csum_context *
+csum_clone(struct csum_context *ctx);
+
 extern int
 csum_register(struct csum_algo *algo);
 
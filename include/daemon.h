@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Requests are one tab separated line, the parameter is '-' when unset:
+ *
+ *   FILE <algo> <param> <path>
+ *   DATA <algo> <param> <length>, followed by <length> raw bytes
+ *
+ * The payload of DATA is chunked, every chunk is followed by the length
+ * of the next one on a line of its own, and an empty chunk ends it.
+ *
+ * Every request is answered with either "OK <length> <result>" or
+ * "ERR <errno>", and a connection may carry any number of requests.
+ * Files are opened with the privileges of the daemon, so the socket is
+ * private and only peers of the same user, or root, are served.
+ */
+
+#define DAEMON_FILE "FILE"
+#define DAEMON_DATA "DATA"
+#define DAEMON_OK "OK"
+#define DAEMON_ERR "ERR"
+#define DAEMON_NONE "-"
+
+struct csum_client {
+    FILE *in;
+    FILE *out;
+};
+
+extern int
+csum_daemon_serve(const char *path, unsigned int workers);
+
+extern int
+csum_client_connect(struct csum_client *client, const char *path);
+
+extern int
+csum_client_request(struct csum_client *client, const char *algo,
+                    const char *args, const char *file, uint64_t *length,
+                    char *result, size_t size);
+
+extern void
+csum_client_close(struct csum_client *client);
+
+#endif /* _DAEMON_H_ */
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _DIGEST_H_
+#define _DIGEST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <csum.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define DIGEST_BLOCK 64
+#define DIGEST_WORDS 8
+#define DIGEST_LANES 8
+
+#define DIGEST_IMPL_SHANI \
+    (CSUM_CPU_SSE2 | CSUM_CPU_SSSE3 | CSUM_CPU_SSE41 | CSUM_CPU_SHA)
+
+#define DIGEST_IMPL_AVX2 \
+    (CSUM_CPU_SSE2 | CSUM_CPU_AVX2)
+
+typedef void (*digest_compress)(uint32_t *hash, const uint8_t *data, size_t blocks);
+
+/*
+ * Compress DIGEST_LANES independent messages side by side. Lane @n
+ * takes @blocks[n] blocks from @data[n], a lane with no blocks is left
+ * untouched and its pointers may be anything.
+ */
+typedef void (*digest_lanes)(uint32_t *const *hashes, const uint8_t *const *data,
+                             const size_t *blocks);
+
+/**
+ * struct digest_model - one big endian Merkle-Damgard hash.
+ * @words: state words, also the digest length in words.
+ * @init: initial state.
+ * @reference: generic compression, every other kernel is checked on it.
+ */
+struct digest_model {
+    unsigned int words;
+    const uint32_t *init;
+    digest_compress reference;
+};
+
+/**
+ * struct digest_impl - one registered implementation of a digest.
+ * @algo: algorithm entry, filled from the module template on register.
+ * @model: hash this implementation computes.
+ * @compress: block compression of a single message.
+ * @lanes: optional multi buffer compression, enables the many op.
+ * @registered: whether the entry is on the algorithm list.
+ */
+struct digest_impl {
+    struct csum_algo algo;
+    const struct digest_model *model;
+    digest_compress compress;
+    digest_lanes lanes;
+    bool registered;
+};
+
+#define DIGEST_IMPL_COUNT(impls) \
+    (sizeof(impls) / sizeof(*(impls)))
+
+#define algo_to_digest_impl(ptr) \
+    bfdev_container_of(ptr, struct digest_impl, algo)
+
+struct digest_state {
+    uint32_t hash[DIGEST_WORDS];
+    uint8_t buffer[DIGEST_BLOCK];
+    size_t buffered;
+    uint64_t total;
+};
+
+struct digest_context {
+    struct csum_context csum;
+    struct digest_state state;
+    char result[DIGEST_WORDS * 8 + 1];
+};
+
+#define csum_to_digest(ptr) \
+    bfdev_container_of(ptr, struct digest_context, csum)
+
+#if defined(__x86_64__)
+
+/*
+ * Gather word @index of every lane into one vector each, so that
+ * msg[w] holds message word w of all eight blocks, byte swapped.
+ */
+static inline __attribute__((target("avx2"))) void
+digest_avx2_message(__m256i *msg, const uint8_t *const *data, size_t offset)
+{
+    const __m256i swap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+    );
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+    __m256i v[8];
+    unsigned int half, count;
+
+    for (half = 0; half < 2; ++half) {
+        for (count = 0; count < 8; ++count)
+            v[count] = _mm256_loadu_si256((const __m256i *)
+                (data[count] + offset + half * 32));
+
+        t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+        t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+        t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+        t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+        t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+        t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+        t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+        t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+
+        v[0] = _mm256_unpacklo_epi64(t0, t2);
+        v[1] = _mm256_unpackhi_epi64(t0, t2);
+        v[2] = _mm256_unpacklo_epi64(t1, t3);
+        v[3] = _mm256_unpackhi_epi64(t1, t3);
+        v[4] = _mm256_unpacklo_epi64(t4, t6);
+        v[5] = _mm256_unpackhi_epi64(t4, t6);
+        v[6] = _mm256_unpacklo_epi64(t5, t7);
+        v[7] = _mm256_unpackhi_epi64(t5, t7);
+
+        for (count = 0; count < 4; ++count) {
+            msg[half * 8 + count] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(
+                v[count], v[count + 4], 0x20), swap);
+            msg[half * 8 + count + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(
+                v[count], v[count + 4], 0x31), swap);
+        }
+    }
+}
+
+#endif /* __x86_64__ */
+
+extern void
+digest_update(const struct digest_impl *impl, struct digest_state *state,
+              const void *data, size_t length);
+
+extern const char *
+digest_final(const struct digest_impl *impl, const struct digest_state *state,
+             char *result);
+
+extern struct csum_context *
+digest_prepare(const struct digest_model *model);
+
+extern void
+digest_destroy(struct csum_context *ctx);
+
+extern void
+digest_reset(struct csum_context *ctx);
+
+extern const char *
+digest_compute(struct csum_context *ctx, struct csum_state *sta);
+
+extern void
+digest_many(struct csum_context **ctxs, struct csum_state **stas,
+            const char **results, unsigned int count);
+
+extern int
+digest_impl_register(struct digest_impl *impls, unsigned int count,
+                     const struct csum_algo *template);
+
+extern void
+digest_impl_unregister(struct digest_impl *impls, unsigned int count);
+
+#endif /* _DIGEST_H_ */
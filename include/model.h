@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _MODEL_H_
+#define _MODEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+
+enum crc_fold {
+    CRC_FOLD_128 = 0,
+    CRC_FOLD_512,
+    CRC_FOLD_2048,
+    CRC_FOLD_NR,
+};
+
+/**
+ * struct crc_model - generated tables of a width/poly/reflect crc.
+ * @width: register width in bits, from 1 to 64.
+ * @poly: generator polynomial in normal form, without the x^width term.
+ * @reflect: whether the register is shifted towards the lsb.
+ * @table: slice-by-8 tables for the 64 bit aligned register.
+ * @fold: carry-less folding constants, one pair per fold distance.
+ * @update: fastest update routine usable on this cpu.
+ */
+struct crc_model {
+    unsigned int width;
+    uint64_t poly;
+    bool reflect;
+
+    uint64_t table[8][256];
+    uint64_t fold[CRC_FOLD_NR][2];
+
+    uint64_t (*update)(const struct crc_model *model, uint64_t crc,
+                       const void *data, size_t length);
+};
+
+/**
+ * struct crc_narrow - slice-by-8 tables for registers of at most 8 bits.
+ * @mask: valid register bits.
+ * @state: register advanced across eight zero bytes.
+ * @table: contribution of each byte of an eight byte slice.
+ * @shift: register advanced across one zero byte.
+ * @byte: contribution of a single byte.
+ */
+struct crc_narrow {
+    uint8_t mask;
+    uint8_t state[256];
+    uint8_t table[8][256];
+    uint8_t shift[256];
+    uint8_t byte[256];
+};
+
+#define CRC_IMPL_PCLMUL \
+    (CSUM_CPU_PCLMUL | CSUM_CPU_SSE41 | CSUM_CPU_SSSE3)
+
+#define CRC_IMPL_VPCLMUL \
+    (CRC_IMPL_PCLMUL | CSUM_CPU_AVX2 | CSUM_CPU_AVX512F | \
+     CSUM_CPU_AVX512BW | CSUM_CPU_VPCLMUL)
+
+/**
+ * struct crc_impl - one registered implementation of a fixed crc.
+ * @algo: algorithm entry, filled from the module template on register.
+ * @update: block update routine of this implementation.
+ * @probe: optional availability check, may adjust the priority.
+ * @registered: whether the entry is on the algorithm list.
+ */
+struct crc_impl {
+    struct csum_algo algo;
+    uint64_t (*update)(uint64_t crc, const void *data, size_t length);
+    int (*probe)(struct crc_impl *impl);
+    bool registered;
+};
+
+#define CRC_IMPL_COUNT(impls) \
+    (sizeof(impls) / sizeof(*(impls)))
+
+#define algo_to_crc_impl(ptr) \
+    bfdev_container_of(ptr, struct crc_impl, algo)
+
+static inline uint64_t
+crc_impl_update(struct csum_context *ctx, uint64_t crc,
+                const void *data, size_t length)
+{
+    struct crc_impl *impl = algo_to_crc_impl(ctx->algo);
+    return impl->update(crc, data, length);
+}
+
+static inline uint64_t
+crc_model_update(const struct crc_model *model, uint64_t crc,
+                 const void *data, size_t length)
+{
+    return model->update(model, crc, data, length);
+}
+
+/*
+ * Same text as printf "%#0*x" with @field, a zero value is printed as
+ * @field zeros without the 0x prefix, just like glibc does.
+ */
+static inline void
+crc_format(char *buffer, uint64_t value, unsigned int field)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned int digits;
+
+    if (!value) {
+        memset(buffer, '0', field);
+        buffer[field] = '\0';
+        return;
+    }
+
+    digits = (67 - __builtin_clzll(value)) / 4;
+    if (field > digits + 2)
+        digits = field - 2;
+
+    buffer[0] = '0';
+    buffer[1] = 'x';
+    buffer[digits + 2] = '\0';
+
+    for (; digits; value >>= 4)
+        buffer[1 + digits--] = hex[value & 0xf];
+}
+
+/*
+ * Everything of a fixed crc module but its update routines and its
+ * implementation table, generated from one descriptor: the context
+ * holding a @type register, every op, and the algorithm template
+ * @prefix. @prefix##_update has to be the bitwise reference of @width.
+ * Contiguous buffers skip the next_block loop through the linear op.
+ */
+#define CRC_ALGO_TEMPLATE(prefix, label, type, width, field)                \
+struct prefix##_context {                                                   \
+    struct csum_context csum;                                               \
+    char result[32];                                                        \
+    type init;                                                              \
+    type crc;                                                               \
+};                                                                          \
+                                                                            \
+static inline struct prefix##_context *                                     \
+csum_to_##prefix(struct csum_context *ctx)                                  \
+{                                                                           \
+    return bfdev_container_of(ctx, struct prefix##_context, csum);          \
+}                                                                           \
+                                                                            \
+static const char *                                                         \
+prefix##_compute(struct csum_context *ctx, struct csum_state *sta)          \
+{                                                                           \
+    struct prefix##_context *context = csum_to_##prefix(ctx);               \
+    uintptr_t consumed = sta->offset;                                       \
+    size_t length;                                                          \
+    const void *buff;                                                       \
+                                                                            \
+    for (;;) {                                                              \
+        length = ctx->next_block(ctx, sta, consumed, &buff);                \
+        if (!length)                                                        \
+            break;                                                          \
+                                                                            \
+        context->crc = crc_impl_update(ctx, context->crc, buff, length);    \
+        consumed += length;                                                 \
+    }                                                                       \
+                                                                            \
+    crc_format(context->result, context->crc, field);                       \
+    sta->offset = consumed;                                                 \
+                                                                            \
+    return context->result;                                                 \
+}                                                                           \
+                                                                            \
+static const char *                                                         \
+prefix##_linear(struct csum_context *ctx, const void *data, size_t length)  \
+{                                                                           \
+    struct prefix##_context *context = csum_to_##prefix(ctx);               \
+                                                                            \
+    context->crc = crc_impl_update(ctx, context->crc, data, length);        \
+    crc_format(context->result, context->crc, field);                       \
+                                                                            \
+    return context->result;                                                 \
+}                                                                           \
+                                                                            \
+static struct csum_context *                                                \
+prefix##_prepare(const char *args, unsigned long flags)                     \
+{                                                                           \
+    struct prefix##_context *context;                                       \
+                                                                            \
+    context = bfdev_zalloc(NULL, sizeof(*context));                         \
+    if (bfdev_unlikely(!context))                                           \
+        return NULL;                                                        \
+                                                                            \
+    if (args)                                                               \
+        context->crc = (type)strtoul(args, NULL, 0);                        \
+                                                                            \
+    context->init = context->crc;                                           \
+    return &context->csum;                                                  \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+prefix##_destroy(struct csum_context *ctx)                                  \
+{                                                                           \
+    struct prefix##_context *context = csum_to_##prefix(ctx);               \
+    bfdev_free(NULL, context);                                              \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+prefix##_reset(struct csum_context *ctx)                                    \
+{                                                                           \
+    struct prefix##_context *context = csum_to_##prefix(ctx);               \
+    context->crc = context->init;                                           \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+prefix##_combine(struct csum_context *ctx, struct csum_context *next,       \
+               uint64_t length)                                             \
+{                                                                           \
+    struct prefix##_context *context = csum_to_##prefix(ctx);               \
+    struct prefix##_context *other = csum_to_##prefix(next);                \
+                                                                            \
+    context->crc = csum_crc_combine(prefix##_update, width, context->crc,   \
+                                    context->init, other->crc, length);     \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+prefix##_zeros(struct csum_context *ctx, uint64_t length)                   \
+{                                                                           \
+    struct prefix##_context *context = csum_to_##prefix(ctx);               \
+    context->crc = csum_crc_zeros(prefix##_update, width, context->crc, length); \
+}                                                                           \
+                                                                            \
+static struct csum_algo prefix = {                                          \
+    .name = label,                                                          \
+    .prepare = prefix##_prepare,                                            \
+    .destroy = prefix##_destroy,                                            \
+    .reset = prefix##_reset,                                                \
+    .compute = prefix##_compute,                                            \
+    .linear = prefix##_linear,                                              \
+    .combine = prefix##_combine,                                            \
+    .zeros = prefix##_zeros,                                                \
+}
+
+extern uint64_t
+crc_model_table(const struct crc_model *model, uint64_t crc,
+                const void *data, size_t length);
+
+extern uint64_t
+crc_model_pclmul(const struct crc_model *model, uint64_t crc,
+                 const void *data, size_t length);
+
+extern uint64_t
+crc_model_vpclmul(const struct crc_model *model, uint64_t crc,
+                  const void *data, size_t length);
+
+extern void
+crc_model_init(struct crc_model *model, unsigned int width,
+               uint64_t poly, bool reflect);
+
+extern uint64_t
+crc_narrow_update(const struct crc_narrow *narrow, uint64_t crc,
+                  const void *data, size_t length);
+
+extern void
+crc_narrow_init(struct crc_narrow *narrow, unsigned int width,
+                uint64_t (*reference)(uint64_t crc, const void *data, size_t length));
+
+extern uint64_t
+csum_model_zeros(const struct crc_model *model, uint64_t crc, uint64_t length);
+
+extern uint64_t
+csum_model_combine(const struct crc_model *model, uint64_t crc, uint64_t init,
+                   uint64_t next, uint64_t length);
+
+extern bool
+crc_model_verify(uint64_t (*update)(uint64_t crc, const void *data, size_t length),
+                 uint64_t (*reference)(uint64_t crc, const void *data, size_t length),
+                 unsigned int width);
+
+extern int
+crc_impl_register(struct crc_impl *impls, unsigned int count,
+                  const struct csum_algo *template, unsigned int width);
+
+extern void
+crc_impl_unregister(struct crc_impl *impls, unsigned int count);
+
+#endif /* _MODEL_H_ */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _SUMS_H_
+#define _SUMS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <csum.h>
+#include <bfdev/minmax.h>
+
+/*
+ * Largest run in bytes handed to a kernel at once. Up to this size
+ * every vector lane and both raw sums stay clear of overflow, so the
+ * modular reduction is only paid once per run.
+ */
+#define SUMS_RUN 0x1000
+
+#define SUMS_IMPL_SSSE3 \
+    (CSUM_CPU_SSE2 | CSUM_CPU_SSSE3)
+
+#define SUMS_IMPL_AVX2 \
+    (SUMS_IMPL_SSSE3 | CSUM_CPU_AVX2)
+
+/**
+ * struct sums_block - raw sums of one run of little endian words.
+ * @sum1: sum of every word.
+ * @sum2: sum of every word times its distance to the end of the run,
+ *        so the last word counts once and the first one @words times.
+ */
+struct sums_block {
+    uint64_t sum1;
+    uint64_t sum2;
+};
+
+typedef void (*sums_kernel)(struct sums_block *block, const void *data, size_t words);
+
+/**
+ * sums_update - advance a two sum checksum over whole words.
+ * @kernel: kernel matching the word size.
+ * @size: word size in bytes.
+ * @modulus: modulus of both sums.
+ * @sum1: running first sum, reduced.
+ * @sum2: running second sum, reduced.
+ */
+static inline void
+sums_update(sums_kernel kernel, unsigned int size, uint64_t modulus,
+            uint64_t *sum1, uint64_t *sum2, const void *data, size_t words)
+{
+    struct sums_block block;
+    size_t run;
+
+    while (words) {
+        run = bfdev_min(words, (size_t)SUMS_RUN / size);
+        kernel(&block, data, run);
+
+        *sum2 = (*sum2 + *sum1 * run + block.sum2) % modulus;
+        *sum1 = (*sum1 + block.sum1) % modulus;
+
+        data = (const uint8_t *)data + run * size;
+        words -= run;
+    }
+}
+
+extern void
+sums_generic8(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_generic16(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_generic32(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_ssse3_8(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_ssse3_16(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_ssse3_32(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_avx2_8(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_avx2_16(struct sums_block *block, const void *data, size_t words);
+
+extern void
+sums_avx2_32(struct sums_block *block, const void *data, size_t words);
+
+#endif /* _SUMS_H_ */
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <model.h>
+#include <sums.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <bfdev/allocator.h>
+
+#define ADLER32_BASE 65521
+
+struct adler32_context {
+    struct csum_context csum;
+    char result[32];
+    uint32_t init;
+    uint32_t adler;
+};
+
+#define csum_to_adler32(ptr) \
+    bfdev_container_of(ptr, struct adler32_context, csum)
+
+static __always_inline uint64_t
+adler32_sums(sums_kernel kernel, uint64_t adler, const void *data, size_t length)
+{
+    uint64_t sum1 = (adler & 0xffff) % ADLER32_BASE;
+    uint64_t sum2 = (adler >> 16 & 0xffff) % ADLER32_BASE;
+
+    sums_update(kernel, 1, ADLER32_BASE, &sum1, &sum2, data, length);
+    return sum2 << 16 | sum1;
+}
+
+static uint64_t
+adler32_update(uint64_t adler, const void *data, size_t length)
+{
+    return adler32_sums(sums_generic8, adler, data, length);
+}
+
+static uint64_t
+adler32_ssse3(uint64_t adler, const void *data, size_t length)
+{
+    return adler32_sums(sums_ssse3_8, adler, data, length);
+}
+
+static uint64_t
+adler32_avx2(uint64_t adler, const void *data, size_t length)
+{
+    return adler32_sums(sums_avx2_8, adler, data, length);
+}
+
+static const char *
+adler32_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct adler32_context *adler32 = csum_to_adler32(ctx);
+    uintptr_t consumed = sta->offset;
+    size_t length;
+    const void *buff;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        adler32->adler = crc_impl_update(ctx, adler32->adler, buff, length);
+        consumed += length;
+    }
+
+    sprintf(adler32->result, "%#010x", adler32->adler);
+    sta->offset = consumed;
+
+    return adler32->result;
+}
+
+static struct csum_context *
+adler32_prepare(const char *args, unsigned long flags)
+{
+    struct adler32_context *adler32;
+    uint32_t init = 1;
+
+    adler32 = bfdev_zalloc(NULL, sizeof(*adler32));
+    if (bfdev_unlikely(!adler32))
+        return NULL;
+
+    if (args)
+        init = (uint32_t)strtoul(args, NULL, 0);
+
+    /* keep both halves reduced, combine works on the raw init */
+    adler32->adler = adler32_update(init, NULL, 0);
+    adler32->init = adler32->adler;
+
+    return &adler32->csum;
+}
+
+static void
+adler32_destroy(struct csum_context *ctx)
+{
+    struct adler32_context *adler32 = csum_to_adler32(ctx);
+    bfdev_free(NULL, adler32);
+}
+
+static void
+adler32_reset(struct csum_context *ctx)
+{
+    struct adler32_context *adler32 = csum_to_adler32(ctx);
+    adler32->adler = adler32->init;
+}
+
+static void
+adler32_combine(struct csum_context *ctx, struct csum_context *next, uint64_t length)
+{
+    struct adler32_context *adler32 = csum_to_adler32(ctx);
+    struct adler32_context *other = csum_to_adler32(next);
+    uint64_t sum1, sum2, init1, init2, count;
+
+    /* 'other' started from init, take its share out of both sums */
+    count = length % ADLER32_BASE;
+    init1 = adler32->init & 0xffff;
+    init2 = adler32->init >> 16;
+    sum1 = adler32->adler & 0xffff;
+    sum2 = adler32->adler >> 16;
+
+    sum2 = (sum2 + count * sum1 + (other->adler >> 16) +
+            ADLER32_BASE * 2 - init2 - count * init1 % ADLER32_BASE) % ADLER32_BASE;
+    sum1 = (sum1 + (other->adler & 0xffff) + ADLER32_BASE - init1) % ADLER32_BASE;
+
+    adler32->adler = sum2 << 16 | sum1;
+}
+
+static void
+adler32_zeros(struct csum_context *ctx, uint64_t length)
+{
+    struct adler32_context *adler32 = csum_to_adler32(ctx);
+    uint64_t sum1 = adler32->adler & 0xffff;
+    uint64_t sum2 = adler32->adler >> 16;
+
+    sum2 = (sum2 + length % ADLER32_BASE * sum1) % ADLER32_BASE;
+    adler32->adler = sum2 << 16 | sum1;
+}
+
+static struct csum_algo adler32 = {
+    .name = "adler32",
+    .prepare = adler32_prepare,
+    .destroy = adler32_destroy,
+    .reset = adler32_reset,
+    .compute = adler32_compute,
+    .combine = adler32_combine,
+    .zeros = adler32_zeros,
+};
+
+static struct crc_impl adler32_impls[] = {
+    {
+        .algo = {
+            .driver = "adler32-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = adler32_update,
+    }, {
+        .algo = {
+            .driver = "adler32-ssse3",
+            .priority = CSUM_PRIO_SIMD,
+            .features = SUMS_IMPL_SSSE3,
+        },
+        .update = adler32_ssse3,
+    }, {
+        .algo = {
+            .driver = "adler32-avx2",
+            .priority = CSUM_PRIO_WIDE,
+            .features = SUMS_IMPL_AVX2,
+        },
+        .update = adler32_avx2,
+    },
+};
+
+static int __bfdev_ctor
+adler32_init(void)
+{
+    return crc_impl_register(adler32_impls, CRC_IMPL_COUNT(adler32_impls),
+                             &adler32, 32);
+}
+
+static void __bfdev_dtor
+adler32_exit(void)
+{
+    crc_impl_unregister(adler32_impls, CRC_IMPL_COUNT(adler32_impls));
+}
@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/if_alg.h>
+#include <afalg.h>
+#include <bfdev/minmax.h>
+
+#ifndef AF_ALG
+# define AF_ALG 38
+#endif
+
+#define AFALG_PIPE 0x100000
+#define AFALG_CHUNK 0x10000
+#define AFALG_LINE 256
+
+/*
+ * Data is moved into the kernel with vmsplice and splice, so mapped
+ * file pages are handed to the hash driver by reference and never
+ * copied through a userspace buffer. Every thread owns one pipe.
+ */
+struct afalg_pipe {
+    int fds[2];
+    size_t size;
+};
+
+static pthread_once_t afalg_once = PTHREAD_ONCE_INIT;
+static pthread_key_t afalg_key;
+
+static void
+afalg_pipe_release(void *pdata)
+{
+    struct afalg_pipe *pipe = pdata;
+
+    close(pipe->fds[0]);
+    close(pipe->fds[1]);
+    free(pipe);
+}
+
+static void
+afalg_key_init(void)
+{
+    pthread_key_create(&afalg_key, afalg_pipe_release);
+}
+
+static struct afalg_pipe *
+afalg_pipe_get(void)
+{
+    struct afalg_pipe *pipe;
+    int retval;
+
+    pthread_once(&afalg_once, afalg_key_init);
+    pipe = pthread_getspecific(afalg_key);
+    if (pipe)
+        return pipe;
+
+    pipe = malloc(sizeof(*pipe));
+    if (!pipe)
+        return NULL;
+
+    if (pipe2(pipe->fds, O_CLOEXEC) < 0) {
+        free(pipe);
+        return NULL;
+    }
+
+    retval = fcntl(pipe->fds[1], F_SETPIPE_SZ, AFALG_PIPE);
+    pipe->size = retval > 0 ? (size_t)retval : AFALG_CHUNK;
+    pthread_setspecific(afalg_key, pipe);
+
+    return pipe;
+}
+
+static void
+afalg_pipe_drop(struct afalg_pipe *pipe)
+{
+    /* a pipe left holding data is useless for the next request */
+    pthread_setspecific(afalg_key, NULL);
+    afalg_pipe_release(pipe);
+}
+
+static int
+afalg_splice(int op, const uint8_t *data, size_t length)
+{
+    struct afalg_pipe *pipe;
+    struct iovec iov;
+    ssize_t sent, moved;
+
+    pipe = afalg_pipe_get();
+    if (!pipe)
+        return -ENOMEM;
+
+    while (length) {
+        iov.iov_base = (void *)data;
+        iov.iov_len = bfdev_min(length, pipe->size);
+
+        sent = vmsplice(pipe->fds[1], &iov, 1, 0);
+        if (sent <= 0)
+            return sent ? -errno : -EIO;
+
+        data += sent;
+        length -= sent;
+
+        while (sent) {
+            moved = splice(pipe->fds[0], NULL, op, NULL, sent, SPLICE_F_MORE);
+            if (moved <= 0) {
+                afalg_pipe_drop(pipe);
+                return moved ? -errno : -EIO;
+            }
+            sent -= moved;
+        }
+    }
+
+    return 0;
+}
+
+static int
+afalg_send(int op, const uint8_t *data, size_t length)
+{
+    ssize_t sent;
+
+    while (length) {
+        sent = send(op, data, bfdev_min(length, (size_t)AFALG_CHUNK), MSG_MORE);
+        if (sent <= 0)
+            return sent ? -errno : -EIO;
+
+        data += sent;
+        length -= sent;
+    }
+
+    return 0;
+}
+
+static int
+afalg_request(struct afalg_hash *hash, const void *data, size_t length,
+              int (*feed)(int op, const uint8_t *data, size_t length),
+              uint8_t *digest)
+{
+    ssize_t retval;
+    int op;
+
+    op = accept4(hash->tfm, NULL, 0, SOCK_CLOEXEC);
+    if (op < 0)
+        return -errno;
+
+    /* reading the result finalizes the request */
+    retval = feed(op, data, length);
+    if (!retval) {
+        retval = read(op, digest, hash->size);
+        if (retval == hash->size)
+            retval = 0;
+        else
+            retval = retval < 0 ? -errno : -EIO;
+    }
+
+    close(op);
+    return retval;
+}
+
+int
+afalg_digest(struct afalg_hash *hash, const void *data,
+             size_t length, uint64_t *value)
+{
+    uint8_t digest[sizeof(*value)];
+    unsigned int count;
+    uint64_t result;
+    int retval, error;
+
+    if (hash->tfm < 0)
+        return -ENODEV;
+
+    /* callers fall back to userspace, keep their errno untouched */
+    error = errno;
+    retval = afalg_request(hash, data, length, afalg_splice, digest);
+    if (retval)
+        retval = afalg_request(hash, data, length, afalg_send, digest);
+    if (retval) {
+        errno = error;
+        return retval;
+    }
+
+    if (hash->little) {
+        result = 0;
+        for (count = hash->size; count--;)
+            result = (result << 8) | digest[count];
+    } else switch (hash->size) {
+        case 1:
+            result = digest[0];
+            break;
+
+        case 2: {
+            uint16_t value16;
+            memcpy(&value16, digest, sizeof(value16));
+            result = value16;
+            break;
+        }
+
+        case 4: {
+            uint32_t value32;
+            memcpy(&value32, digest, sizeof(value32));
+            result = value32;
+            break;
+        }
+
+        default:
+            memcpy(&result, digest, sizeof(result));
+            break;
+    }
+
+    *value = result;
+    return 0;
+}
+
+/*
+ * The kernel picks its highest priority driver for a name. Offload is
+ * only preferred over the userspace tables when that driver is an
+ * accelerated one, a generic kernel loop just adds syscall overhead.
+ */
+static bool
+afalg_accelerated(const char *name)
+{
+    char line[AFALG_LINE], entry[AFALG_LINE], driver[AFALG_LINE] = "";
+    bool matched = false, accelerated = false;
+    int priority, best = -1;
+    size_t length;
+    FILE *proc;
+
+    proc = fopen("/proc/crypto", "re");
+    if (!proc)
+        return false;
+
+    while (fgets(line, sizeof(line), proc)) {
+        if (sscanf(line, "name : %255s", entry) == 1)
+            matched = !strcmp(entry, name);
+        else if (!matched)
+            continue;
+        else if (sscanf(line, "driver : %255s", driver) == 1)
+            continue;
+        else if (sscanf(line, "priority : %d", &priority) == 1 &&
+                 priority > best) {
+            best = priority;
+            length = strlen(driver);
+            accelerated = length < 8 || strcmp(driver + length - 8, "-generic");
+        }
+    }
+
+    fclose(proc);
+    return best >= 0 && accelerated;
+}
+
+int
+afalg_probe(struct afalg_hash *hash, struct csum_algo *algo)
+{
+    struct sockaddr_alg addr = {
+        .salg_family = AF_ALG,
+        .salg_type = "hash",
+    };
+    int retval, error;
+
+    hash->tfm = -1;
+    if (hash->size > sizeof(uint64_t) ||
+        strlen(hash->name) >= sizeof(addr.salg_name))
+        return -EINVAL;
+
+    error = errno;
+    strcpy((char *)addr.salg_name, hash->name);
+    hash->tfm = socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (hash->tfm < 0) {
+        retval = -errno;
+        errno = error;
+        return retval;
+    }
+
+    if (bind(hash->tfm, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        afalg_release(hash);
+        errno = error;
+        return -ENOENT;
+    }
+
+    if (afalg_accelerated(hash->name))
+        algo->priority = CSUM_PRIO_OFFLOAD;
+    else
+        algo->priority = CSUM_PRIO_FALLBACK;
+
+    errno = error;
+    return 0;
+}
+
+void
+afalg_release(struct afalg_hash *hash)
+{
+    if (hash->tfm < 0)
+        return;
+
+    close(hash->tfm);
+    hash->tfm = -1;
+}
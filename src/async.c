@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <async.h>
+#include <bfdev/minmax.h>
+
+#define ASYNC_EVENTS 64
+#define ASYNC_BUDGET 0x100000
+
+int
+csum_async_init(struct csum_async *async)
+{
+    bfdev_list_head_init(&async->entries);
+
+    async->epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (async->epoll < 0)
+        return -errno;
+
+    return 0;
+}
+
+void
+csum_async_exit(struct csum_async *async)
+{
+    struct csum_async_entry *walk, *tmp;
+
+    bfdev_list_for_each_entry_safe(walk, tmp, &async->entries, list)
+        csum_async_remove(async, walk);
+
+    close(async->epoll);
+}
+
+int
+csum_async_add(struct csum_async *async, struct csum_async_entry *entry)
+{
+    struct epoll_event event = {.events = EPOLLIN};
+    int flags;
+
+    flags = fcntl(entry->fd, F_GETFL);
+    if (flags < 0 || fcntl(entry->fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return -errno;
+
+    /* regular files are always ready and get refused by epoll here */
+    event.data.ptr = entry;
+    if (epoll_ctl(async->epoll, EPOLL_CTL_ADD, entry->fd, &event) < 0)
+        return -errno;
+
+    csum_stream_init(entry->ctx, &entry->stream);
+    bfdev_list_add(&async->entries, &entry->list);
+
+    return 0;
+}
+
+void
+csum_async_remove(struct csum_async *async, struct csum_async_entry *entry)
+{
+    epoll_ctl(async->epoll, EPOLL_CTL_DEL, entry->fd, NULL);
+    bfdev_list_del(&entry->list);
+}
+
+static void
+async_finish(struct csum_async *async, struct csum_async_entry *entry,
+             const char *result, int error)
+{
+    csum_async_remove(async, entry);
+    entry->done(entry, result, error);
+}
+
+/*
+ * Level triggered: a stream that still has data after its budget is
+ * reported again by the next wait, so one busy producer cannot starve
+ * the others sharing this thread.
+ */
+static bool
+async_drain(struct csum_async *async, struct csum_async_entry *entry)
+{
+    size_t budget = ASYNC_BUDGET;
+    ssize_t retval;
+
+    while (budget) {
+        retval = read(entry->fd, async->buffer, ASYNC_BUFFER);
+        if (retval > 0) {
+            csum_stream_update(entry->ctx, &entry->stream,
+                               async->buffer, retval);
+            budget -= bfdev_min(budget, (size_t)retval);
+            continue;
+        }
+
+        if (!retval) {
+            async_finish(async, entry, csum_stream_final(entry->ctx,
+                         &entry->stream), 0);
+            return true;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+        async_finish(async, entry, NULL, errno);
+        return true;
+    }
+
+    return false;
+}
+
+int
+csum_async_dispatch(struct csum_async *async, int timeout)
+{
+    struct epoll_event events[ASYNC_EVENTS];
+    int count, index, finished = 0;
+
+    count = epoll_wait(async->epoll, events, ASYNC_EVENTS, timeout);
+    if (count < 0)
+        return errno == EINTR ? 0 : -errno;
+
+    for (index = 0; index < count; ++index)
+        finished += async_drain(async, events[index].data.ptr);
+
+    return finished;
+}
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <string.h>
+#include <time.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+
+#define BENCH_TIME 200000000ULL
+
+static const size_t
+bench_blocks[] = {
+    0x1000, 0x10000, 0x100000, 0x1000000,
+};
+
+static inline uint64_t
+bench_clock(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/*
+ * Each block size is hashed as a run of separate computes over one
+ * buffer, so fixed per call costs such as syscalls of an offload
+ * driver show up in the small block columns.
+ */
+static double
+bench_run(struct csum_context *ctx, const uint8_t *buffer,
+          size_t size, size_t block)
+{
+    struct csum_linear linear;
+    uint64_t start, elapse, bytes = 0;
+    size_t offset;
+
+    start = bench_clock();
+    do {
+        for (offset = 0; offset + block <= size; offset += block) {
+            csum_linear_compute(ctx, &linear, buffer + offset, block);
+            bytes += block;
+        }
+        elapse = bench_clock() - start;
+    } while (elapse < BENCH_TIME);
+
+    return (double)bytes * 1000.0 / elapse;
+}
+
+int
+csum_bench(FILE *stream, const char *name, const char *args, size_t size)
+{
+    struct csum_algo *algo, *active;
+    struct csum_context *ctx;
+    unsigned int count, found = 0;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint8_t *buffer;
+    size_t index;
+
+    active = csum_find(name);
+    if (!active)
+        return -ENOENT;
+
+    buffer = bfdev_malloc(NULL, size);
+    if (bfdev_unlikely(!buffer))
+        return -ENOMEM;
+
+    for (index = 0; index < size; ++index) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        buffer[index] = seed >> 56;
+    }
+
+    fprintf(stream, "%-24s", "driver (MB/s)");
+    for (count = 0; count < sizeof(bench_blocks) / sizeof(*bench_blocks); ++count)
+        fprintf(stream, " %10zuK", bench_blocks[count] >> 10);
+    fprintf(stream, "\n");
+
+    bfdev_list_for_each_entry(algo, &csum_algos, list) {
+        if (strcmp(algo->name, active->name) ||
+            (algo->features & ~csum_cpu_features()))
+            continue;
+
+        ctx = csum_prepare(algo->driver, args, 0);
+        if (!ctx)
+            continue;
+
+        fprintf(stream, "%c%-23s", algo == active ? '*' : ' ', algo->driver);
+        for (count = 0; count < sizeof(bench_blocks) / sizeof(*bench_blocks); ++count) {
+            if (bench_blocks[count] > size)
+                fprintf(stream, " %11s", "-");
+            else
+                fprintf(stream, " %11.1f", bench_run(ctx, buffer, size,
+                        bench_blocks[count]));
+        }
+
+        fprintf(stream, "\n");
+        csum_destroy(ctx);
+        found++;
+    }
+
+    bfdev_free(NULL, buffer);
+    return found ? 0 : -ENOENT;
+}
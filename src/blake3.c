@@ -0,0 +1,1205 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define BLAKE3_KEY 32
+#define BLAKE3_OUT 32
+#define BLAKE3_BLOCK 64
+#define BLAKE3_CHUNK 1024
+#define BLAKE3_DEPTH 54
+#define BLAKE3_DEGREE 16
+#define BLAKE3_ROUNDS 7
+
+/* smallest subtree worth handing to another thread */
+#define BLAKE3_SPLIT 0x100000
+
+enum {
+    BLAKE3_CHUNK_START = BFDEV_BIT(0),
+    BLAKE3_CHUNK_END = BFDEV_BIT(1),
+    BLAKE3_PARENT = BFDEV_BIT(2),
+    BLAKE3_ROOT = BFDEV_BIT(3),
+    BLAKE3_KEYED_HASH = BFDEV_BIT(4),
+};
+
+static const uint32_t blake3_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint8_t blake3_schedule[BLAKE3_ROUNDS][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+/**
+ * struct blake3_kernel - multi input compression of one instruction set.
+ * @hash_many: compress @count inputs of @blocks blocks each, starting
+ *             from @key, and store one chaining value per input.
+ * @degree: inputs hashed side by side, the tree is cut to match.
+ */
+struct blake3_kernel {
+    void (*hash_many)(const uint8_t *const *inputs, size_t count, size_t blocks,
+                      const uint32_t *key, uint64_t counter, bool increment,
+                      uint8_t flags, uint8_t start, uint8_t end, uint8_t *out);
+    unsigned int degree;
+};
+
+struct blake3_impl {
+    struct csum_algo algo;
+    const struct blake3_kernel *kernel;
+    bool registered;
+};
+
+#define algo_to_blake3_impl(ptr) \
+    bfdev_container_of(ptr, struct blake3_impl, algo)
+
+struct blake3_chunk {
+    uint32_t cv[8];
+    uint64_t counter;
+    uint8_t buffer[BLAKE3_BLOCK];
+    uint8_t buffered;
+    uint8_t blocks;
+    uint8_t flags;
+};
+
+/**
+ * struct blake3_hasher - incremental tree state.
+ * @key: key words, the IV unless keyed.
+ * @chunk: chunk being filled, the root when it is the only one.
+ * @stack: chaining values of complete subtrees, merged lazily so the
+ *         last one can still turn into the root.
+ * @depth: entries on @stack.
+ */
+struct blake3_hasher {
+    uint32_t key[8];
+    struct blake3_chunk chunk;
+    uint8_t stack[(BLAKE3_DEPTH + 1) * BLAKE3_OUT];
+    unsigned int depth;
+};
+
+struct blake3_context {
+    struct csum_context csum;
+    char result[BLAKE3_OUT * 2 + 1];
+    uint32_t key[8];
+    uint8_t flags;
+    struct blake3_hasher hasher;
+};
+
+#define csum_to_blake3(ptr) \
+    bfdev_container_of(ptr, struct blake3_context, csum)
+
+static __always_inline uint32_t
+blake3_read32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 |
+           (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static __always_inline void
+blake3_write32(uint8_t *data, uint32_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static __always_inline uint32_t
+blake3_ror32(uint32_t value, unsigned int shift)
+{
+    return value >> shift | value << (32 - shift);
+}
+
+static __always_inline void
+blake3_g(uint32_t *v, unsigned int a, unsigned int b, unsigned int c,
+         unsigned int d, uint32_t x, uint32_t y)
+{
+    v[a] = v[a] + v[b] + x;
+    v[d] = blake3_ror32(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = blake3_ror32(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + y;
+    v[d] = blake3_ror32(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = blake3_ror32(v[b] ^ v[c], 7);
+}
+
+static void
+blake3_compress(uint32_t *cv, const uint8_t *block, uint8_t length,
+                uint64_t counter, uint8_t flags)
+{
+    uint32_t v[16], m[16];
+    const uint8_t *s;
+    unsigned int count;
+
+    for (count = 0; count < 16; ++count)
+        m[count] = blake3_read32(block + count * 4);
+
+    memcpy(v, cv, sizeof(*v) * 8);
+    memcpy(v + 8, blake3_iv, sizeof(*v) * 4);
+    v[12] = counter;
+    v[13] = counter >> 32;
+    v[14] = length;
+    v[15] = flags;
+
+    for (count = 0; count < BLAKE3_ROUNDS; ++count) {
+        s = blake3_schedule[count];
+        blake3_g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        blake3_g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        blake3_g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        blake3_g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        blake3_g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        blake3_g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        blake3_g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        blake3_g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (count = 0; count < 8; ++count)
+        cv[count] = v[count] ^ v[count + 8];
+}
+
+static void
+blake3_generic_many(const uint8_t *const *inputs, size_t count, size_t blocks,
+                    const uint32_t *key, uint64_t counter, bool increment,
+                    uint8_t flags, uint8_t start, uint8_t end, uint8_t *out)
+{
+    uint32_t cv[8];
+    unsigned int index;
+    size_t block;
+
+    for (; count; --count, ++inputs, out += BLAKE3_OUT) {
+        memcpy(cv, key, sizeof(cv));
+        for (block = 0; block < blocks; ++block) {
+            blake3_compress(cv, *inputs + block * BLAKE3_BLOCK, BLAKE3_BLOCK,
+                            counter, flags | (block ? 0 : start) |
+                            (block + 1 < blocks ? 0 : end));
+        }
+
+        for (index = 0; index < 8; ++index)
+            blake3_write32(out + index * 4, cv[index]);
+
+        if (increment)
+            counter++;
+    }
+}
+
+static const struct blake3_kernel
+blake3_generic = {
+    .hash_many = blake3_generic_many,
+    .degree = 1,
+};
+
+#if defined(__x86_64__)
+
+#define BLAKE3_SSSE3_TARGET __attribute__((target("sse2,ssse3")))
+#define BLAKE3_AVX2_TARGET __attribute__((target("sse2,ssse3,avx2")))
+#define BLAKE3_AVX512_TARGET __attribute__((target("sse2,ssse3,avx2,avx512f")))
+
+/*
+ * The vector kernels keep one input per 32 bit lane: message blocks are
+ * transposed in registers so that vector N holds word N of every input,
+ * the rounds then run exactly like the scalar ones on whole vectors.
+ */
+#define BLAKE3_SIMD_G(isa, v, a, b, c, d, x, y) do { \
+    v[a] = blake3_##isa##_add(blake3_##isa##_add(v[a], v[b]), x); \
+    v[d] = blake3_##isa##_rot16(blake3_##isa##_xor(v[d], v[a])); \
+    v[c] = blake3_##isa##_add(v[c], v[d]); \
+    v[b] = blake3_##isa##_rot12(blake3_##isa##_xor(v[b], v[c])); \
+    v[a] = blake3_##isa##_add(blake3_##isa##_add(v[a], v[b]), y); \
+    v[d] = blake3_##isa##_rot8(blake3_##isa##_xor(v[d], v[a])); \
+    v[c] = blake3_##isa##_add(v[c], v[d]); \
+    v[b] = blake3_##isa##_rot7(blake3_##isa##_xor(v[b], v[c])); \
+} while (0)
+
+#define BLAKE3_SIMD_HASH(isa, type, lanes, target) \
+static target void \
+blake3_##isa##_hash(const uint8_t *const *inputs, size_t blocks, \
+                    const uint32_t *key, uint64_t counter, bool increment, \
+                    uint8_t flags, uint8_t start, uint8_t end, uint8_t *out) \
+{ \
+    uint32_t words[8 * lanes], low[lanes], high[lanes]; \
+    type h[8], v[16], m[16]; \
+    unsigned int index, lane; \
+    const uint8_t *s; \
+    size_t block; \
+    \
+    for (lane = 0; lane < lanes; ++lane) { \
+        low[lane] = counter + (increment ? lane : 0); \
+        high[lane] = (counter + (increment ? lane : 0)) >> 32; \
+    } \
+    \
+    for (index = 0; index < 8; ++index) \
+        h[index] = blake3_##isa##_set1(key[index]); \
+    \
+    for (block = 0; block < blocks; ++block) { \
+        blake3_##isa##_message(m, inputs, block * BLAKE3_BLOCK); \
+        for (index = 0; index < 8; ++index) \
+            v[index] = h[index]; \
+        for (index = 0; index < 4; ++index) \
+            v[index + 8] = blake3_##isa##_set1(blake3_iv[index]); \
+        v[12] = blake3_##isa##_load(low); \
+        v[13] = blake3_##isa##_load(high); \
+        v[14] = blake3_##isa##_set1(BLAKE3_BLOCK); \
+        v[15] = blake3_##isa##_set1(flags | (block ? 0 : start) | \
+                                    (block + 1 < blocks ? 0 : end)); \
+        \
+        for (index = 0; index < BLAKE3_ROUNDS; ++index) { \
+            s = blake3_schedule[index]; \
+            BLAKE3_SIMD_G(isa, v, 0, 4, 8, 12, m[s[0]], m[s[1]]); \
+            BLAKE3_SIMD_G(isa, v, 1, 5, 9, 13, m[s[2]], m[s[3]]); \
+            BLAKE3_SIMD_G(isa, v, 2, 6, 10, 14, m[s[4]], m[s[5]]); \
+            BLAKE3_SIMD_G(isa, v, 3, 7, 11, 15, m[s[6]], m[s[7]]); \
+            BLAKE3_SIMD_G(isa, v, 0, 5, 10, 15, m[s[8]], m[s[9]]); \
+            BLAKE3_SIMD_G(isa, v, 1, 6, 11, 12, m[s[10]], m[s[11]]); \
+            BLAKE3_SIMD_G(isa, v, 2, 7, 8, 13, m[s[12]], m[s[13]]); \
+            BLAKE3_SIMD_G(isa, v, 3, 4, 9, 14, m[s[14]], m[s[15]]); \
+        } \
+        \
+        for (index = 0; index < 8; ++index) \
+            h[index] = blake3_##isa##_xor(v[index], v[index + 8]); \
+    } \
+    \
+    for (index = 0; index < 8; ++index) { \
+        blake3_##isa##_store(words + index * lanes, h[index]); \
+        for (lane = 0; lane < lanes; ++lane) \
+            blake3_write32(out + lane * BLAKE3_OUT + index * 4, \
+                           words[index * lanes + lane]); \
+    } \
+}
+
+#define BLAKE3_SIMD_MANY(isa, lanes, target, fallback) \
+static target void \
+blake3_##isa##_many(const uint8_t *const *inputs, size_t count, size_t blocks, \
+                    const uint32_t *key, uint64_t counter, bool increment, \
+                    uint8_t flags, uint8_t start, uint8_t end, uint8_t *out) \
+{ \
+    for (; count >= lanes; count -= lanes) { \
+        blake3_##isa##_hash(inputs, blocks, key, counter, increment, \
+                            flags, start, end, out); \
+        if (increment) \
+            counter += lanes; \
+        inputs += lanes; \
+        out += lanes * BLAKE3_OUT; \
+    } \
+    \
+    fallback(inputs, count, blocks, key, counter, increment, \
+             flags, start, end, out); \
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_set1(uint32_t value)
+{
+    return _mm_set1_epi32((int)value);
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_load(const uint32_t *src)
+{
+    return _mm_loadu_si128((const __m128i *)src);
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline void
+blake3_ssse3_store(uint32_t *dest, __m128i value)
+{
+    _mm_storeu_si128((__m128i *)dest, value);
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_add(__m128i a, __m128i b)
+{
+    return _mm_add_epi32(a, b);
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_xor(__m128i a, __m128i b)
+{
+    return _mm_xor_si128(a, b);
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_rot16(__m128i value)
+{
+    return _mm_shuffle_epi8(value, _mm_set_epi8(
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_rot12(__m128i value)
+{
+    return _mm_or_si128(_mm_srli_epi32(value, 12), _mm_slli_epi32(value, 20));
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_rot8(__m128i value)
+{
+    return _mm_shuffle_epi8(value, _mm_set_epi8(
+        12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline __m128i
+blake3_ssse3_rot7(__m128i value)
+{
+    return _mm_or_si128(_mm_srli_epi32(value, 7), _mm_slli_epi32(value, 25));
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_set1(uint32_t value)
+{
+    return _mm256_set1_epi32((int)value);
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_load(const uint32_t *src)
+{
+    return _mm256_loadu_si256((const __m256i *)src);
+}
+
+static BLAKE3_AVX2_TARGET __always_inline void
+blake3_avx2_store(uint32_t *dest, __m256i value)
+{
+    _mm256_storeu_si256((__m256i *)dest, value);
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_add(__m256i a, __m256i b)
+{
+    return _mm256_add_epi32(a, b);
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_xor(__m256i a, __m256i b)
+{
+    return _mm256_xor_si256(a, b);
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_rot16(__m256i value)
+{
+    return _mm256_shuffle_epi8(value, _mm256_set_epi8(
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_rot12(__m256i value)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(value, 12), _mm256_slli_epi32(value, 20));
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_rot8(__m256i value)
+{
+    return _mm256_shuffle_epi8(value, _mm256_set_epi8(
+        12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+        12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+static BLAKE3_AVX2_TARGET __always_inline __m256i
+blake3_avx2_rot7(__m256i value)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(value, 7), _mm256_slli_epi32(value, 25));
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_set1(uint32_t value)
+{
+    return _mm512_set1_epi32((int)value);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_load(const uint32_t *src)
+{
+    return _mm512_loadu_si512(src);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline void
+blake3_avx512_store(uint32_t *dest, __m512i value)
+{
+    _mm512_storeu_si512(dest, value);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_add(__m512i a, __m512i b)
+{
+    return _mm512_add_epi32(a, b);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_xor(__m512i a, __m512i b)
+{
+    return _mm512_xor_si512(a, b);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_rot16(__m512i value)
+{
+    return _mm512_ror_epi32(value, 16);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_rot12(__m512i value)
+{
+    return _mm512_ror_epi32(value, 12);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_rot8(__m512i value)
+{
+    return _mm512_ror_epi32(value, 8);
+}
+
+static BLAKE3_AVX512_TARGET __always_inline __m512i
+blake3_avx512_rot7(__m512i value)
+{
+    return _mm512_ror_epi32(value, 7);
+}
+
+static BLAKE3_SSSE3_TARGET __always_inline void
+blake3_ssse3_message(__m128i *m, const uint8_t *const *inputs, size_t offset)
+{
+    __m128i v[4], lo[2], hi[2];
+    unsigned int group, lane;
+
+    for (group = 0; group < 4; ++group) {
+        for (lane = 0; lane < 4; ++lane)
+            v[lane] = _mm_loadu_si128((const __m128i *)(inputs[lane] + offset) + group);
+
+        for (lane = 0; lane < 2; ++lane) {
+            lo[lane] = _mm_unpacklo_epi32(v[lane * 2], v[lane * 2 + 1]);
+            hi[lane] = _mm_unpackhi_epi32(v[lane * 2], v[lane * 2 + 1]);
+        }
+
+        m[group * 4 + 0] = _mm_unpacklo_epi64(lo[0], lo[1]);
+        m[group * 4 + 1] = _mm_unpackhi_epi64(lo[0], lo[1]);
+        m[group * 4 + 2] = _mm_unpacklo_epi64(hi[0], hi[1]);
+        m[group * 4 + 3] = _mm_unpackhi_epi64(hi[0], hi[1]);
+    }
+}
+
+static BLAKE3_AVX2_TARGET __always_inline void
+blake3_avx2_message(__m256i *m, const uint8_t *const *inputs, size_t offset)
+{
+    __m256i v[8], lo[4], hi[4], w[2][4];
+    unsigned int half, lane;
+
+    for (half = 0; half < 2; ++half) {
+        for (lane = 0; lane < 8; ++lane)
+            v[lane] = _mm256_loadu_si256((const __m256i *)(inputs[lane] + offset) + half);
+
+        for (lane = 0; lane < 4; ++lane) {
+            lo[lane] = _mm256_unpacklo_epi32(v[lane * 2], v[lane * 2 + 1]);
+            hi[lane] = _mm256_unpackhi_epi32(v[lane * 2], v[lane * 2 + 1]);
+        }
+
+        for (lane = 0; lane < 2; ++lane) {
+            w[lane][0] = _mm256_unpacklo_epi64(lo[lane * 2], lo[lane * 2 + 1]);
+            w[lane][1] = _mm256_unpackhi_epi64(lo[lane * 2], lo[lane * 2 + 1]);
+            w[lane][2] = _mm256_unpacklo_epi64(hi[lane * 2], hi[lane * 2 + 1]);
+            w[lane][3] = _mm256_unpackhi_epi64(hi[lane * 2], hi[lane * 2 + 1]);
+        }
+
+        for (lane = 0; lane < 4; ++lane) {
+            m[half * 8 + lane] = _mm256_permute2x128_si256(w[0][lane], w[1][lane], 0x20);
+            m[half * 8 + lane + 4] = _mm256_permute2x128_si256(w[0][lane], w[1][lane], 0x31);
+        }
+    }
+}
+
+static BLAKE3_AVX512_TARGET __always_inline void
+blake3_avx512_message(__m512i *m, const uint8_t *const *inputs, size_t offset)
+{
+    __m512i v[16], lo[8], hi[8], w[4][4], x[2][8];
+    unsigned int lane;
+
+    for (lane = 0; lane < 16; ++lane)
+        v[lane] = _mm512_loadu_si512(inputs[lane] + offset);
+
+    for (lane = 0; lane < 8; ++lane) {
+        lo[lane] = _mm512_unpacklo_epi32(v[lane * 2], v[lane * 2 + 1]);
+        hi[lane] = _mm512_unpackhi_epi32(v[lane * 2], v[lane * 2 + 1]);
+    }
+
+    for (lane = 0; lane < 4; ++lane) {
+        w[lane][0] = _mm512_unpacklo_epi64(lo[lane * 2], lo[lane * 2 + 1]);
+        w[lane][1] = _mm512_unpackhi_epi64(lo[lane * 2], lo[lane * 2 + 1]);
+        w[lane][2] = _mm512_unpacklo_epi64(hi[lane * 2], hi[lane * 2 + 1]);
+        w[lane][3] = _mm512_unpackhi_epi64(hi[lane * 2], hi[lane * 2 + 1]);
+    }
+
+    /* 0x88 gathers the even 128 bit lanes of both sources, 0xdd the odd */
+    for (lane = 0; lane < 4; ++lane) {
+        x[0][lane] = _mm512_shuffle_i32x4(w[0][lane], w[1][lane], 0x88);
+        x[0][lane + 4] = _mm512_shuffle_i32x4(w[0][lane], w[1][lane], 0xdd);
+        x[1][lane] = _mm512_shuffle_i32x4(w[2][lane], w[3][lane], 0x88);
+        x[1][lane + 4] = _mm512_shuffle_i32x4(w[2][lane], w[3][lane], 0xdd);
+    }
+
+    for (lane = 0; lane < 8; ++lane) {
+        m[lane] = _mm512_shuffle_i32x4(x[0][lane], x[1][lane], 0x88);
+        m[lane + 8] = _mm512_shuffle_i32x4(x[0][lane], x[1][lane], 0xdd);
+    }
+}
+
+BLAKE3_SIMD_HASH(ssse3, __m128i, 4, BLAKE3_SSSE3_TARGET)
+BLAKE3_SIMD_HASH(avx2, __m256i, 8, BLAKE3_AVX2_TARGET)
+BLAKE3_SIMD_HASH(avx512, __m512i, 16, BLAKE3_AVX512_TARGET)
+
+BLAKE3_SIMD_MANY(ssse3, 4, BLAKE3_SSSE3_TARGET, blake3_generic_many)
+BLAKE3_SIMD_MANY(avx2, 8, BLAKE3_AVX2_TARGET, blake3_ssse3_many)
+BLAKE3_SIMD_MANY(avx512, 16, BLAKE3_AVX512_TARGET, blake3_avx2_many)
+
+static const struct blake3_kernel
+blake3_ssse3 = {
+    .hash_many = blake3_ssse3_many,
+    .degree = 4,
+};
+
+static const struct blake3_kernel
+blake3_avx2 = {
+    .hash_many = blake3_avx2_many,
+    .degree = 8,
+};
+
+static const struct blake3_kernel
+blake3_avx512 = {
+    .hash_many = blake3_avx512_many,
+    .degree = 16,
+};
+
+#else /* !__x86_64__ */
+
+# define blake3_ssse3 blake3_generic
+# define blake3_avx2 blake3_generic
+# define blake3_avx512 blake3_generic
+
+#endif /* __x86_64__ */
+
+static void
+blake3_chunk_init(struct blake3_chunk *chunk, const uint32_t *key,
+                  uint64_t counter, uint8_t flags)
+{
+    memcpy(chunk->cv, key, sizeof(chunk->cv));
+    chunk->counter = counter;
+    chunk->buffered = 0;
+    chunk->blocks = 0;
+    chunk->flags = flags;
+}
+
+static __always_inline size_t
+blake3_chunk_length(const struct blake3_chunk *chunk)
+{
+    return (size_t)chunk->blocks * BLAKE3_BLOCK + chunk->buffered;
+}
+
+static __always_inline uint8_t
+blake3_chunk_start(const struct blake3_chunk *chunk)
+{
+    return chunk->blocks ? 0 : BLAKE3_CHUNK_START;
+}
+
+static void
+blake3_chunk_update(struct blake3_chunk *chunk, const uint8_t *data, size_t length)
+{
+    size_t take;
+
+    if (chunk->buffered) {
+        take = bfdev_min(length, (size_t)BLAKE3_BLOCK - chunk->buffered);
+        memcpy(chunk->buffer + chunk->buffered, data, take);
+        chunk->buffered += take;
+        data += take;
+        length -= take;
+
+        if (!length)
+            return;
+
+        blake3_compress(chunk->cv, chunk->buffer, BLAKE3_BLOCK, chunk->counter,
+                        chunk->flags | blake3_chunk_start(chunk));
+        chunk->blocks++;
+        chunk->buffered = 0;
+    }
+
+    /* the last block stays buffered, it may be the end of the chunk */
+    for (; length > BLAKE3_BLOCK; length -= BLAKE3_BLOCK) {
+        blake3_compress(chunk->cv, data, BLAKE3_BLOCK, chunk->counter,
+                        chunk->flags | blake3_chunk_start(chunk));
+        chunk->blocks++;
+        data += BLAKE3_BLOCK;
+    }
+
+    memcpy(chunk->buffer, data, length);
+    chunk->buffered = length;
+}
+
+/**
+ * struct blake3_output - last compression of a node, kept unevaluated
+ * until it is known whether the node is the root.
+ */
+struct blake3_output {
+    uint32_t cv[8];
+    uint8_t block[BLAKE3_BLOCK];
+    uint64_t counter;
+    uint8_t length;
+    uint8_t flags;
+};
+
+static void
+blake3_chunk_output(const struct blake3_chunk *chunk, struct blake3_output *output)
+{
+    memcpy(output->cv, chunk->cv, sizeof(output->cv));
+    memset(output->block, 0, sizeof(output->block));
+    memcpy(output->block, chunk->buffer, chunk->buffered);
+    output->counter = chunk->counter;
+    output->length = chunk->buffered;
+    output->flags = chunk->flags | blake3_chunk_start(chunk) | BLAKE3_CHUNK_END;
+}
+
+static void
+blake3_parent_output(const uint8_t *block, const uint32_t *key, uint8_t flags,
+                     struct blake3_output *output)
+{
+    memcpy(output->cv, key, sizeof(output->cv));
+    memcpy(output->block, block, BLAKE3_BLOCK);
+    output->counter = 0;
+    output->length = BLAKE3_BLOCK;
+    output->flags = flags | BLAKE3_PARENT;
+}
+
+static void
+blake3_output_cv(const struct blake3_output *output, uint8_t *cv, bool root)
+{
+    uint32_t words[8];
+    unsigned int count;
+
+    memcpy(words, output->cv, sizeof(words));
+    blake3_compress(words, output->block, output->length, root ? 0 : output->counter,
+                    output->flags | (root ? BLAKE3_ROOT : 0));
+
+    for (count = 0; count < 8; ++count)
+        blake3_write32(cv + count * 4, words[count]);
+}
+
+static size_t
+blake3_chunks(const struct blake3_kernel *kernel, const uint8_t *data, size_t length,
+              const uint32_t *key, uint64_t counter, uint8_t flags, uint8_t *out)
+{
+    const uint8_t *inputs[BLAKE3_DEGREE];
+    struct blake3_output output;
+    struct blake3_chunk chunk;
+    size_t count;
+
+    for (count = 0; length - count * BLAKE3_CHUNK >= BLAKE3_CHUNK; ++count)
+        inputs[count] = data + count * BLAKE3_CHUNK;
+
+    kernel->hash_many(inputs, count, BLAKE3_CHUNK / BLAKE3_BLOCK, key, counter,
+                      true, flags, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, out);
+
+    if (length == count * BLAKE3_CHUNK)
+        return count;
+
+    blake3_chunk_init(&chunk, key, counter + count, flags);
+    blake3_chunk_update(&chunk, data + count * BLAKE3_CHUNK, length - count * BLAKE3_CHUNK);
+    blake3_chunk_output(&chunk, &output);
+    blake3_output_cv(&output, out + count * BLAKE3_OUT, false);
+
+    return count + 1;
+}
+
+static size_t
+blake3_parents(const struct blake3_kernel *kernel, const uint8_t *cvs, size_t count,
+               const uint32_t *key, uint8_t flags, uint8_t *out)
+{
+    const uint8_t *inputs[BLAKE3_DEGREE];
+    size_t parents;
+
+    for (parents = 0; count - parents * 2 >= 2; ++parents)
+        inputs[parents] = cvs + parents * BLAKE3_BLOCK;
+
+    kernel->hash_many(inputs, parents, 1, key, 0, false,
+                      flags | BLAKE3_PARENT, 0, 0, out);
+
+    if (count == parents * 2)
+        return parents;
+
+    /* an odd child is passed up unchanged */
+    memcpy(out + parents * BLAKE3_OUT, cvs + parents * BLAKE3_BLOCK, BLAKE3_OUT);
+    return parents + 1;
+}
+
+struct blake3_subtree {
+    const struct blake3_kernel *kernel;
+    const uint8_t *data;
+    size_t length;
+    const uint32_t *key;
+    uint64_t counter;
+    uint8_t flags;
+    unsigned int jobs;
+    uint8_t *out;
+    size_t count;
+    pthread_t thread;
+};
+
+static void *
+blake3_subtree_worker(void *pdata);
+
+/*
+ * Compress a subtree down to at most twice the kernel degree chaining
+ * values. Every level hands the left half to a new thread while there
+ * are jobs left, the right half stays on the calling thread.
+ */
+static size_t
+blake3_subtree_wide(const struct blake3_kernel *kernel, const uint8_t *data,
+                    size_t length, const uint32_t *key, uint64_t counter,
+                    uint8_t flags, uint8_t *out, unsigned int jobs)
+{
+    uint8_t cvs[2 * BLAKE3_DEGREE * BLAKE3_OUT];
+    struct blake3_subtree left;
+    size_t degree, lcount, rcount;
+    bool threaded = false;
+    uint8_t *right;
+
+    if (length <= kernel->degree * BLAKE3_CHUNK)
+        return blake3_chunks(kernel, data, length, key, counter, flags, out);
+
+    /* the left subtree is the largest power of two chunks that leaves input */
+    left.length = BLAKE3_CHUNK;
+    while (left.length * 2 < length)
+        left.length *= 2;
+
+    degree = kernel->degree;
+    if (left.length > BLAKE3_CHUNK && degree == 1)
+        degree = 2;
+    right = cvs + degree * BLAKE3_OUT;
+
+    left.kernel = kernel;
+    left.data = data;
+    left.key = key;
+    left.counter = counter;
+    left.flags = flags;
+    left.jobs = jobs / 2;
+    left.out = cvs;
+
+    if (left.jobs && length >= BLAKE3_SPLIT)
+        threaded = !pthread_create(&left.thread, NULL, blake3_subtree_worker, &left);
+    if (!threaded) {
+        left.jobs = 0;
+        blake3_subtree_worker(&left);
+    }
+
+    rcount = blake3_subtree_wide(kernel, data + left.length, length - left.length,
+                                 key, counter + left.length / BLAKE3_CHUNK,
+                                 flags, right, jobs - left.jobs);
+    if (threaded)
+        pthread_join(left.thread, NULL);
+    lcount = left.count;
+
+    /* a degree one kernel returns both halves as they are */
+    if (lcount == 1) {
+        memcpy(out, cvs, 2 * BLAKE3_OUT);
+        return 2;
+    }
+
+    return blake3_parents(kernel, cvs, lcount + rcount, key, flags, out);
+}
+
+static void *
+blake3_subtree_worker(void *pdata)
+{
+    struct blake3_subtree *subtree = pdata;
+
+    subtree->count = blake3_subtree_wide(subtree->kernel, subtree->data,
+                                         subtree->length, subtree->key,
+                                         subtree->counter, subtree->flags,
+                                         subtree->out, subtree->jobs);
+
+    return NULL;
+}
+
+static void
+blake3_subtree(const struct blake3_kernel *kernel, const uint8_t *data,
+               size_t length, const uint32_t *key, uint64_t counter,
+               uint8_t flags, uint8_t *out, unsigned int jobs)
+{
+    uint8_t cvs[2 * BLAKE3_DEGREE * BLAKE3_OUT];
+    uint8_t parents[BLAKE3_DEGREE * BLAKE3_OUT];
+    size_t count;
+
+    count = blake3_subtree_wide(kernel, data, length, key, counter,
+                                flags, cvs, jobs);
+    while (count > 2) {
+        count = blake3_parents(kernel, cvs, count, key, flags, parents);
+        memcpy(cvs, parents, count * BLAKE3_OUT);
+    }
+
+    memcpy(out, cvs, 2 * BLAKE3_OUT);
+}
+
+static void
+blake3_init(struct blake3_hasher *hasher, const uint32_t *key, uint8_t flags)
+{
+    memcpy(hasher->key, key, sizeof(hasher->key));
+    blake3_chunk_init(&hasher->chunk, key, 0, flags);
+    hasher->depth = 0;
+}
+
+/*
+ * Subtrees are only merged once more input shows up behind them, so
+ * the stack always holds one entry per set bit of the chunk count.
+ */
+static void
+blake3_merge(struct blake3_hasher *hasher, uint64_t chunks)
+{
+    struct blake3_output output;
+    uint8_t *parent;
+
+    while (hasher->depth > (unsigned int)__builtin_popcountll(chunks)) {
+        parent = hasher->stack + (hasher->depth - 2) * BLAKE3_OUT;
+        blake3_parent_output(parent, hasher->key, hasher->chunk.flags, &output);
+        blake3_output_cv(&output, parent, false);
+        hasher->depth--;
+    }
+}
+
+static void
+blake3_push(struct blake3_hasher *hasher, const uint8_t *cv, uint64_t counter)
+{
+    blake3_merge(hasher, counter);
+    memcpy(hasher->stack + hasher->depth * BLAKE3_OUT, cv, BLAKE3_OUT);
+    hasher->depth++;
+}
+
+static void
+blake3_update(const struct blake3_kernel *kernel, struct blake3_hasher *hasher,
+              const uint8_t *data, size_t length, unsigned int jobs)
+{
+    struct blake3_chunk *chunk = &hasher->chunk;
+    uint8_t cvs[2 * BLAKE3_OUT];
+    struct blake3_output output;
+    struct blake3_chunk single;
+    size_t take, subtree;
+
+    if (!length)
+        return;
+
+    if (blake3_chunk_length(chunk)) {
+        take = bfdev_min(length, BLAKE3_CHUNK - blake3_chunk_length(chunk));
+        blake3_chunk_update(chunk, data, take);
+        data += take;
+        length -= take;
+
+        if (!length)
+            return;
+
+        blake3_chunk_output(chunk, &output);
+        blake3_output_cv(&output, cvs, false);
+        blake3_push(hasher, cvs, chunk->counter);
+        blake3_chunk_init(chunk, hasher->key, chunk->counter + 1, chunk->flags);
+    }
+
+    /* whole subtrees aligned to the chunk count take the wide path */
+    while (length > BLAKE3_CHUNK) {
+        subtree = BLAKE3_CHUNK;
+        while (subtree * 2 <= length)
+            subtree *= 2;
+        while ((subtree - 1) & (chunk->counter * BLAKE3_CHUNK))
+            subtree /= 2;
+
+        if (subtree <= BLAKE3_CHUNK) {
+            blake3_chunk_init(&single, hasher->key, chunk->counter, chunk->flags);
+            blake3_chunk_update(&single, data, subtree);
+            blake3_chunk_output(&single, &output);
+            blake3_output_cv(&output, cvs, false);
+            blake3_push(hasher, cvs, chunk->counter);
+        } else {
+            blake3_subtree(kernel, data, subtree, hasher->key, chunk->counter,
+                           chunk->flags, cvs, jobs);
+            blake3_push(hasher, cvs, chunk->counter);
+            blake3_push(hasher, cvs + BLAKE3_OUT, chunk->counter +
+                        subtree / BLAKE3_CHUNK / 2);
+        }
+
+        chunk->counter += subtree / BLAKE3_CHUNK;
+        data += subtree;
+        length -= subtree;
+    }
+
+    if (length) {
+        blake3_chunk_update(chunk, data, length);
+        blake3_merge(hasher, chunk->counter);
+    }
+}
+
+static void
+blake3_final(const struct blake3_hasher *hasher, uint8_t *digest)
+{
+    uint8_t block[BLAKE3_BLOCK];
+    struct blake3_output output;
+    unsigned int remain;
+
+    if (!hasher->depth) {
+        blake3_chunk_output(&hasher->chunk, &output);
+        blake3_output_cv(&output, digest, true);
+        return;
+    }
+
+    if (blake3_chunk_length(&hasher->chunk)) {
+        remain = hasher->depth;
+        blake3_chunk_output(&hasher->chunk, &output);
+    } else {
+        remain = hasher->depth - 2;
+        blake3_parent_output(hasher->stack + remain * BLAKE3_OUT, hasher->key,
+                             hasher->chunk.flags, &output);
+    }
+
+    while (remain--) {
+        memcpy(block, hasher->stack + remain * BLAKE3_OUT, BLAKE3_OUT);
+        blake3_output_cv(&output, block + BLAKE3_OUT, false);
+        blake3_parent_output(block, hasher->key, hasher->chunk.flags, &output);
+    }
+
+    blake3_output_cv(&output, digest, true);
+}
+
+static const char *
+blake3_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct blake3_context *blake3 = csum_to_blake3(ctx);
+    struct blake3_impl *impl = algo_to_blake3_impl(ctx->algo);
+    uint8_t digest[BLAKE3_OUT];
+    uintptr_t consumed = sta->offset;
+    unsigned int count;
+    size_t length;
+    const void *buff;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        blake3_update(impl->kernel, &blake3->hasher, buff, length, ctx->jobs);
+        consumed += length;
+    }
+
+    blake3_final(&blake3->hasher, digest);
+    for (count = 0; count < BLAKE3_OUT; ++count)
+        sprintf(blake3->result + count * 2, "%02x", digest[count]);
+    sta->offset = consumed;
+
+    return blake3->result;
+}
+
+static int
+blake3_parse_key(const char *args, uint32_t *key)
+{
+    uint8_t bytes[BLAKE3_KEY];
+    unsigned int count;
+    char hex[3] = { };
+    char *end;
+
+    if (strlen(args) != BLAKE3_KEY * 2)
+        return -EINVAL;
+
+    for (count = 0; count < BLAKE3_KEY; ++count) {
+        memcpy(hex, args + count * 2, 2);
+        bytes[count] = strtoul(hex, &end, 16);
+        if (*end)
+            return -EINVAL;
+    }
+
+    for (count = 0; count < 8; ++count)
+        key[count] = blake3_read32(bytes + count * 4);
+
+    return 0;
+}
+
+static struct csum_context *
+blake3_prepare(const char *args, unsigned long flags)
+{
+    struct blake3_context *blake3;
+
+    blake3 = bfdev_zalloc(NULL, sizeof(*blake3));
+    if (bfdev_unlikely(!blake3))
+        return NULL;
+
+    memcpy(blake3->key, blake3_iv, sizeof(blake3->key));
+    if (args) {
+        /* a 32 byte hex key selects the keyed hash mode */
+        if (blake3_parse_key(args, blake3->key)) {
+            bfdev_free(NULL, blake3);
+            return NULL;
+        }
+        blake3->flags = BLAKE3_KEYED_HASH;
+    }
+
+    blake3_init(&blake3->hasher, blake3->key, blake3->flags);
+    return &blake3->csum;
+}
+
+static void
+blake3_destroy(struct csum_context *ctx)
+{
+    struct blake3_context *blake3 = csum_to_blake3(ctx);
+    bfdev_free(NULL, blake3);
+}
+
+static void
+blake3_reset(struct csum_context *ctx)
+{
+    struct blake3_context *blake3 = csum_to_blake3(ctx);
+    blake3_init(&blake3->hasher, blake3->key, blake3->flags);
+}
+
+static struct csum_algo blake3 = {
+    .name = "blake3",
+    .coreutils = true,
+    .prepare = blake3_prepare,
+    .destroy = blake3_destroy,
+    .reset = blake3_reset,
+    .compute = blake3_compute,
+};
+
+static struct blake3_impl blake3_impls[] = {
+    {
+        .algo = {
+            .driver = "blake3-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .kernel = &blake3_generic,
+    }, {
+        .algo = {
+            .driver = "blake3-ssse3",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CSUM_CPU_SSE2 | CSUM_CPU_SSSE3,
+        },
+        .kernel = &blake3_ssse3,
+    }, {
+        .algo = {
+            .driver = "blake3-avx2",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CSUM_CPU_SSE2 | CSUM_CPU_SSSE3 | CSUM_CPU_AVX2,
+        },
+        .kernel = &blake3_avx2,
+    }, {
+        .algo = {
+            .driver = "blake3-avx512",
+            .priority = CSUM_PRIO_WIDE + 1,
+            .features = CSUM_CPU_SSE2 | CSUM_CPU_SSSE3 | CSUM_CPU_AVX2 |
+                        CSUM_CPU_AVX512F,
+        },
+        .kernel = &blake3_avx512,
+    },
+};
+
+#define BLAKE3_IMPL_COUNT \
+    (sizeof(blake3_impls) / sizeof(*blake3_impls))
+
+/*
+ * A kernel is only offered once it matches the generic one on chunks
+ * and parents, with input counts around its full lane count.
+ */
+static bool
+blake3_verify(const struct blake3_kernel *kernel)
+{
+    uint8_t expect[(BLAKE3_DEGREE * 2 + 1) * BLAKE3_OUT];
+    uint8_t out[(BLAKE3_DEGREE * 2 + 1) * BLAKE3_OUT];
+    const uint8_t *inputs[BLAKE3_DEGREE * 2 + 1];
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint8_t data[BLAKE3_CHUNK * 2];
+    unsigned int count;
+
+    for (count = 0; count < sizeof(data); ++count) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[count] = seed >> 56;
+    }
+
+    for (count = 0; count < sizeof(inputs) / sizeof(*inputs); ++count)
+        inputs[count] = data + count * 31;
+
+    for (count = 1; count <= sizeof(inputs) / sizeof(*inputs); ++count) {
+        blake3_generic_many(inputs, count, BLAKE3_CHUNK / BLAKE3_BLOCK, blake3_iv,
+                            seed, true, 0, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, expect);
+        kernel->hash_many(inputs, count, BLAKE3_CHUNK / BLAKE3_BLOCK, blake3_iv,
+                          seed, true, 0, BLAKE3_CHUNK_START, BLAKE3_CHUNK_END, out);
+        if (memcmp(out, expect, count * BLAKE3_OUT))
+            return false;
+
+        blake3_generic_many(inputs, count, 1, blake3_iv, 0, false,
+                            BLAKE3_PARENT, 0, 0, expect);
+        kernel->hash_many(inputs, count, 1, blake3_iv, 0, false,
+                          BLAKE3_PARENT, 0, 0, out);
+        if (memcmp(out, expect, count * BLAKE3_OUT))
+            return false;
+    }
+
+    return true;
+}
+
+static void
+blake3_impl_unregister(void)
+{
+    unsigned int index;
+
+    for (index = 0; index < BLAKE3_IMPL_COUNT; ++index) {
+        if (!blake3_impls[index].registered)
+            continue;
+
+        csum_unregister(&blake3_impls[index].algo);
+        blake3_impls[index].registered = false;
+    }
+}
+
+static int __bfdev_ctor
+blake3_register(void)
+{
+    struct blake3_impl *impl;
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < BLAKE3_IMPL_COUNT; ++index) {
+        impl = &blake3_impls[index];
+        impl->algo.name = blake3.name;
+        impl->algo.desc = blake3.desc;
+        impl->algo.coreutils = blake3.coreutils;
+        impl->algo.prepare = blake3.prepare;
+        impl->algo.destroy = blake3.destroy;
+        impl->algo.reset = blake3.reset;
+        impl->algo.compute = blake3.compute;
+
+        if (index && !(impl->algo.features & ~csum_cpu_features()) &&
+            !blake3_verify(impl->kernel))
+            continue;
+
+        retval = csum_register(&impl->algo);
+        if (retval) {
+            blake3_impl_unregister();
+            return retval;
+        }
+
+        impl->registered = true;
+    }
+
+    return 0;
+}
+
+static void __bfdev_dtor
+blake3_unregister(void)
+{
+    blake3_impl_unregister();
+}
@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <csum.h>
+#include <model.h>
+#include <bfdev/bits.h>
+
+/*
+ * Every crc register update is affine over GF(2): feeding a zero byte
+ * maps state 'crc' to 'M * crc ^ k'. The operator is recovered from the
+ * algorithm's own update function, so no polynomial knowledge is needed
+ * here, and powers of it are taken by repeated squaring.
+ *
+ * The squarings only depend on the register, so the operator raised to
+ * every power of two is kept per register once it has been built. A
+ * combine then costs one matrix times vector step per set length bit.
+ */
+
+#define GF2_CACHE 32
+
+struct gf2_key {
+    const void *update;
+    uint64_t poly;
+    unsigned int width;
+    bool reflect;
+};
+
+struct gf2_cache {
+    struct gf2_key key;
+    uint64_t konst[BFDEV_BITS_PER_U64];
+    uint64_t mat[BFDEV_BITS_PER_U64][BFDEV_BITS_PER_U64];
+};
+
+static struct gf2_cache *gf2_caches[GF2_CACHE];
+static pthread_mutex_t gf2_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+gf2_times(const uint64_t *mat, uint64_t vec)
+{
+    uint64_t sum = 0;
+
+    while (vec) {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+
+    return sum;
+}
+
+static void
+gf2_square(uint64_t *square, const uint64_t *mat, unsigned int width)
+{
+    unsigned int count;
+
+    for (count = 0; count < width; ++count)
+        square[count] = gf2_times(mat, mat[count]);
+}
+
+static uint64_t
+gf2_operator(uint64_t *mat, unsigned int width,
+             uint64_t (*update)(const void *pdata, uint64_t crc), const void *pdata)
+{
+    unsigned int count;
+    uint64_t konst;
+
+    konst = update(pdata, 0);
+    for (count = 0; count < width; ++count)
+        mat[count] = update(pdata, BFDEV_BIT_ULL(count)) ^ konst;
+
+    return konst;
+}
+
+struct gf2_plain {
+    uint64_t (*update)(uint64_t crc, const void *data, size_t length);
+};
+
+static uint64_t
+gf2_plain_zero(const void *pdata, uint64_t crc)
+{
+    const struct gf2_plain *plain = pdata;
+    static const uint8_t zero;
+
+    return plain->update(crc, &zero, 1);
+}
+
+static uint64_t
+gf2_model_zero(const void *pdata, uint64_t crc)
+{
+    static const uint8_t zero;
+    return crc_model_table(pdata, crc, &zero, 1);
+}
+
+static uint64_t
+gf2_power(uint64_t *mat, uint64_t konst, unsigned int width,
+          uint64_t crc, uint64_t length)
+{
+    uint64_t square[BFDEV_BITS_PER_U64];
+
+    for (;;) {
+        if (length & 1)
+            crc = gf2_times(mat, crc) ^ konst;
+        if (!(length >>= 1))
+            break;
+
+        konst ^= gf2_times(mat, konst);
+        gf2_square(square, mat, width);
+        memcpy(mat, square, sizeof(*mat) * width);
+    }
+
+    return crc;
+}
+
+static inline bool
+gf2_key_equal(const struct gf2_key *a, const struct gf2_key *b)
+{
+    return a->update == b->update && a->poly == b->poly &&
+           a->width == b->width && a->reflect == b->reflect;
+}
+
+static struct gf2_cache *
+gf2_cache_find(const struct gf2_key *key, unsigned int *pindex)
+{
+    struct gf2_cache *cache;
+    unsigned int index;
+
+    for (index = 0; index < GF2_CACHE; ++index) {
+        cache = __atomic_load_n(&gf2_caches[index], __ATOMIC_ACQUIRE);
+        if (!cache)
+            break;
+        if (gf2_key_equal(&cache->key, key))
+            return cache;
+    }
+
+    *pindex = index;
+    return NULL;
+}
+
+static const struct gf2_cache *
+gf2_cache_get(const struct gf2_key *key,
+              uint64_t (*update)(const void *pdata, uint64_t crc), const void *pdata)
+{
+    struct gf2_cache *cache;
+    unsigned int index, level, width = key->width;
+
+    cache = gf2_cache_find(key, &index);
+    if (cache)
+        return cache;
+
+    pthread_mutex_lock(&gf2_lock);
+    cache = gf2_cache_find(key, &index);
+    if (cache || index == GF2_CACHE)
+        goto unlock;
+
+    cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        goto unlock;
+
+    cache->key = *key;
+    cache->konst[0] = gf2_operator(cache->mat[0], width, update, pdata);
+    for (level = 1; level < BFDEV_BITS_PER_U64; ++level) {
+        cache->konst[level] = cache->konst[level - 1] ^
+            gf2_times(cache->mat[level - 1], cache->konst[level - 1]);
+        gf2_square(cache->mat[level], cache->mat[level - 1], width);
+    }
+
+    __atomic_store_n(&gf2_caches[index], cache, __ATOMIC_RELEASE);
+
+unlock:
+    pthread_mutex_unlock(&gf2_lock);
+    return cache;
+}
+
+static uint64_t
+gf2_cached(const struct gf2_cache *cache, bool affine,
+           uint64_t crc, uint64_t length)
+{
+    unsigned int level;
+
+    /* powers of one operator commute, so the bit order is free */
+    for (level = 0; length; ++level, length >>= 1) {
+        if (!(length & 1))
+            continue;
+
+        crc = gf2_times(cache->mat[level], crc);
+        if (affine)
+            crc ^= cache->konst[level];
+    }
+
+    return crc;
+}
+
+static uint64_t
+gf2_zeros(uint64_t (*update)(const void *pdata, uint64_t crc), const void *pdata,
+          const struct gf2_key *key, uint64_t crc, uint64_t length)
+{
+    uint64_t mat[BFDEV_BITS_PER_U64];
+    const struct gf2_cache *cache;
+    unsigned int width = key->width;
+    uint64_t konst;
+
+    if (!length)
+        return crc;
+
+    cache = gf2_cache_get(key, update, pdata);
+    if (cache)
+        return gf2_cached(cache, true, crc, length);
+
+    konst = gf2_operator(mat, width, update, pdata);
+    return gf2_power(mat, konst, width, crc, length);
+}
+
+static uint64_t
+gf2_combine(uint64_t (*update)(const void *pdata, uint64_t crc), const void *pdata,
+            const struct gf2_key *key, uint64_t crc, uint64_t init,
+            uint64_t next, uint64_t length)
+{
+    uint64_t mat[BFDEV_BITS_PER_U64];
+    const struct gf2_cache *cache;
+    unsigned int width = key->width;
+
+    if (!length)
+        return crc;
+
+    /*
+     * 'next' was started from 'init', so only the linear part of the
+     * zero operator is needed to move the difference across it.
+     */
+    cache = gf2_cache_get(key, update, pdata);
+    if (cache)
+        return gf2_cached(cache, false, crc ^ init, length) ^ next;
+
+    gf2_operator(mat, width, update, pdata);
+    return gf2_power(mat, 0, width, crc ^ init, length) ^ next;
+}
+
+uint64_t
+csum_crc_zeros(uint64_t (*update)(uint64_t crc, const void *data, size_t length),
+               unsigned int width, uint64_t crc, uint64_t length)
+{
+    struct gf2_key key = {.update = update, .width = width};
+    struct gf2_plain plain = {update};
+    return gf2_zeros(gf2_plain_zero, &plain, &key, crc, length);
+}
+
+uint64_t
+csum_crc_combine(uint64_t (*update)(uint64_t crc, const void *data, size_t length),
+                 unsigned int width, uint64_t crc, uint64_t init,
+                 uint64_t next, uint64_t length)
+{
+    struct gf2_key key = {.update = update, .width = width};
+    struct gf2_plain plain = {update};
+    return gf2_combine(gf2_plain_zero, &plain, &key, crc, init, next, length);
+}
+
+uint64_t
+csum_model_zeros(const struct crc_model *model, uint64_t crc, uint64_t length)
+{
+    struct gf2_key key = {
+        .poly = model->poly, .width = model->width, .reflect = model->reflect,
+    };
+    return gf2_zeros(gf2_model_zero, model, &key, crc, length);
+}
+
+uint64_t
+csum_model_combine(const struct crc_model *model, uint64_t crc, uint64_t init,
+                   uint64_t next, uint64_t length)
+{
+    struct gf2_key key = {
+        .poly = model->poly, .width = model->width, .reflect = model->reflect,
+    };
+    return gf2_combine(gf2_model_zero, model, &key, crc, init, next, length);
+}
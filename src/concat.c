@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define CONCAT_JOBS 64
+
+/*
+ * Every part is mapped and checksummed on its own by whichever worker
+ * picks it up, then the parts are merged in order with the length
+ * aware combine op. Algorithms without one walk the mapped parts as a
+ * single stream instead, on the calling thread.
+ */
+struct concat_part {
+    struct csum_context *ctx;
+    struct csum_linear linear;
+    const char *path;
+    const char *result;
+    void *mmaped;
+    size_t size;
+};
+
+struct concat_work {
+    struct concat_part *parts;
+    unsigned int count;
+    unsigned int index;
+    unsigned int cursor;
+    unsigned int failed;
+    uint64_t base;
+    int error;
+};
+
+/* the first error wins, along with the part it came from */
+static void
+concat_error(struct concat_work *work, unsigned int index, int error)
+{
+    int expect = 0;
+
+    if (__atomic_compare_exchange_n(&work->error, &expect, error, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        work->failed = index;
+}
+
+static int
+concat_map(struct concat_part *part)
+{
+    struct stat stat;
+    int handle, retval = 0;
+
+    if ((handle = open(part->path, O_RDONLY)) < 0)
+        return -errno;
+
+    if (fstat(handle, &stat) < 0)
+        retval = -errno;
+    else if (!S_ISREG(stat.st_mode))
+        retval = -EINVAL;
+    else if ((part->size = stat.st_size)) {
+        part->mmaped = mmap(NULL, part->size, PROT_READ, MAP_PRIVATE, handle, 0);
+        if (part->mmaped == MAP_FAILED) {
+            part->mmaped = NULL;
+            retval = -errno;
+        }
+    }
+
+    close(handle);
+    return retval;
+}
+
+static void *
+concat_worker(void *pdata)
+{
+    struct concat_work *work = pdata;
+    struct concat_part *part;
+    unsigned int index;
+    int retval;
+
+    for (;;) {
+        index = __atomic_fetch_add(&work->index, 1, __ATOMIC_RELAXED);
+        if (index >= work->count || __atomic_load_n(&work->error, __ATOMIC_RELAXED))
+            break;
+
+        part = &work->parts[index];
+        if ((retval = concat_map(part))) {
+            concat_error(work, index, -retval);
+            break;
+        }
+
+        part->result = csum_linear_compute(part->ctx, &part->linear,
+                                           part->mmaped, part->size);
+        if (!part->result)
+            concat_error(work, index, EFAULT);
+    }
+
+    return NULL;
+}
+
+static size_t
+concat_next_block(struct csum_context *ctx, struct csum_state *sta,
+                  uintptr_t consumed, const void **dest)
+{
+    struct concat_work *work = sta->pdata;
+    struct concat_part *part;
+
+    while (work->cursor < work->count) {
+        part = &work->parts[work->cursor];
+        if (consumed < work->base + part->size) {
+            *dest = part->mmaped + (consumed - work->base);
+            return work->base + part->size - consumed;
+        }
+
+        work->base += part->size;
+        work->cursor++;
+    }
+
+    return 0;
+}
+
+static size_t
+concat_empty_block(struct csum_context *ctx, struct csum_state *sta,
+                   uintptr_t consumed, const void **dest)
+{
+    return 0;
+}
+
+static const char *
+concat_stream(struct csum_context *ctx, struct csum_state *sta,
+              struct concat_work *work)
+{
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < work->count; ++index) {
+        if ((retval = concat_map(&work->parts[index]))) {
+            work->failed = index;
+            errno = -retval;
+            return NULL;
+        }
+    }
+
+    sta->pdata = work;
+    ctx->next_block = concat_next_block;
+
+    return csum_compute(ctx, sta);
+}
+
+static const char *
+concat_parallel(struct csum_context *ctx, struct csum_state *sta,
+                struct concat_work *work, unsigned int jobs)
+{
+    pthread_t *threads;
+    unsigned int index;
+
+    for (index = 0; index < work->count; ++index) {
+        work->parts[index].ctx = index ? csum_clone(ctx) : ctx;
+        if (!work->parts[index].ctx) {
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    bfdev_min_adj(jobs, CONCAT_JOBS);
+    bfdev_min_adj(jobs, work->count);
+    if (!jobs)
+        jobs = 1;
+
+    threads = bfdev_malloc(NULL, sizeof(*threads) * jobs);
+    if (bfdev_unlikely(!threads)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (index = 1; index < jobs; ++index) {
+        if (pthread_create(&threads[index], NULL, concat_worker, work))
+            break;
+    }
+
+    concat_worker(work);
+    while (--index)
+        pthread_join(threads[index], NULL);
+    bfdev_free(NULL, threads);
+
+    if (work->error) {
+        errno = work->error;
+        return NULL;
+    }
+
+    /* the first part ran on @ctx itself, fold the others in behind it */
+    *sta = work->parts[0].linear.sta;
+    for (index = 1; index < work->count; ++index) {
+        if (work->parts[index].size)
+            csum_combine(ctx, sta, work->parts[index].ctx,
+                         &work->parts[index].linear.sta);
+    }
+
+    ctx->next_block = concat_empty_block;
+    return csum_next(ctx, sta);
+}
+
+const char *
+csum_concat_compute(struct csum_context *ctx, struct csum_state *sta,
+                    const char *const *paths, unsigned int count, unsigned int jobs,
+                    unsigned int *failed)
+{
+    struct concat_work work = {};
+    struct concat_part *part;
+    const char *result;
+    unsigned int index;
+
+    *failed = 0;
+    if (!count) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    work.parts = bfdev_zalloc(NULL, sizeof(*work.parts) * count);
+    if (bfdev_unlikely(!work.parts)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    work.count = count;
+    for (index = 0; index < count; ++index)
+        work.parts[index].path = paths[index];
+
+    errno = 0;
+    if (ctx->algo->combine && count > 1)
+        result = concat_parallel(ctx, sta, &work, jobs);
+    else
+        result = concat_stream(ctx, sta, &work);
+
+    for (index = 0; index < count; ++index) {
+        part = &work.parts[index];
+        if (index && part->ctx)
+            csum_destroy(part->ctx);
+        if (part->mmaped)
+            munmap(part->mmaped, part->size);
+    }
+
+    *failed = work.failed;
+    bfdev_free(NULL, work.parts);
+    return result;
+}
@@ -4,80 +4,78 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/crc.h>
 
-struct ccitt_context {
-    struct csum_context csum;
-    char result[32];
-    uint16_t crc;
-};
-
-#define csum_to_ccitt(ptr) \
-    bfdev_container_of(ptr, struct ccitt_context, csum)
+static struct crc_model ccitt_model;
 
-static const char *
-ccitt_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+ccitt_update(uint64_t crc, const void *data, size_t length)
 {
-    struct ccitt_context *ccitt = csum_to_ccitt(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        ccitt->crc = bfdev_crc_ccitt(buff, length, ccitt->crc);
-        consumed += length;
-    }
-
-    sprintf(ccitt->result, "%#06x", ccitt->crc);
-    sta->offset = consumed;
-
-    return ccitt->result;
+    return bfdev_crc_ccitt(data, length, (uint16_t)crc);
 }
 
-static struct csum_context *
-ccitt_prepare(const char *args, unsigned long flags)
+static uint64_t
+ccitt_table(uint64_t crc, const void *data, size_t length)
 {
-    struct ccitt_context *ccitt;
-
-    ccitt = bfdev_zalloc(NULL, sizeof(*ccitt));
-    if (bfdev_unlikely(!ccitt))
-        return NULL;
-
-    if (args)
-        ccitt->crc = (uint16_t)strtoul(args, NULL, 0);
+    return crc_model_table(&ccitt_model, crc, data, length);
+}
 
-    return &ccitt->csum;
+static uint64_t
+ccitt_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&ccitt_model, crc, data, length);
 }
 
-static void
-ccitt_destroy(struct csum_context *ctx)
+static uint64_t
+ccitt_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct ccitt_context *ccitt = csum_to_ccitt(ctx);
-    bfdev_free(NULL, ccitt);
+    return crc_model_vpclmul(&ccitt_model, crc, data, length);
 }
 
-static struct csum_algo ccitt = {
-    .name = "crc-ccitt",
-    .prepare = ccitt_prepare,
-    .destroy = ccitt_destroy,
-    .compute = ccitt_compute,
+CRC_ALGO_TEMPLATE(ccitt, "crc-ccitt", uint16_t, 16, 6);
+
+static struct crc_impl ccitt_impls[] = {
+    {
+        .algo = {
+            .driver = "crc-ccitt-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = ccitt_update,
+    }, {
+        .algo = {
+            .driver = "crc-ccitt-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = ccitt_table,
+    }, {
+        .algo = {
+            .driver = "crc-ccitt-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = ccitt_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc-ccitt-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = ccitt_vpclmul,
+    },
 };
 
 static int __bfdev_ctor
 ccitt_init(void)
 {
-    return csum_register(&ccitt);
+    crc_model_init(&ccitt_model, 16, 0x1021, true);
+
+    return crc_impl_register(ccitt_impls, CRC_IMPL_COUNT(ccitt_impls),
+                             &ccitt, 16);
 }
 
 static void __bfdev_dtor
 ccitt_exit(void)
 {
-    csum_unregister(&ccitt);
+    crc_impl_unregister(ccitt_impls, CRC_IMPL_COUNT(ccitt_impls));
 }
@@ -4,80 +4,78 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/crc.h>
 
-struct itut_context {
-    struct csum_context csum;
-    char result[32];
-    uint16_t crc;
-};
-
-#define csum_to_itut(ptr) \
-    bfdev_container_of(ptr, struct itut_context, csum)
+static struct crc_model itut_model;
 
-static const char *
-itut_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+itut_update(uint64_t crc, const void *data, size_t length)
 {
-    struct itut_context *itut = csum_to_itut(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        itut->crc = bfdev_crc_itut(buff, length, itut->crc);
-        consumed += length;
-    }
-
-    sprintf(itut->result, "%#06x", itut->crc);
-    sta->offset = consumed;
-
-    return itut->result;
+    return bfdev_crc_itut(data, length, (uint16_t)crc);
 }
 
-static struct csum_context *
-itut_prepare(const char *args, unsigned long flags)
+static uint64_t
+itut_table(uint64_t crc, const void *data, size_t length)
 {
-    struct itut_context *itut;
-
-    itut = bfdev_zalloc(NULL, sizeof(*itut));
-    if (bfdev_unlikely(!itut))
-        return NULL;
-
-    if (args)
-        itut->crc = (uint16_t)strtoul(args, NULL, 0);
+    return crc_model_table(&itut_model, crc, data, length);
+}
 
-    return &itut->csum;
+static uint64_t
+itut_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&itut_model, crc, data, length);
 }
 
-static void
-itut_destroy(struct csum_context *ctx)
+static uint64_t
+itut_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct itut_context *itut = csum_to_itut(ctx);
-    bfdev_free(NULL, itut);
+    return crc_model_vpclmul(&itut_model, crc, data, length);
 }
 
-static struct csum_algo itut = {
-    .name = "crc-itut",
-    .prepare = itut_prepare,
-    .destroy = itut_destroy,
-    .compute = itut_compute,
+CRC_ALGO_TEMPLATE(itut, "crc-itut", uint16_t, 16, 6);
+
+static struct crc_impl itut_impls[] = {
+    {
+        .algo = {
+            .driver = "crc-itut-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = itut_update,
+    }, {
+        .algo = {
+            .driver = "crc-itut-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = itut_table,
+    }, {
+        .algo = {
+            .driver = "crc-itut-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = itut_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc-itut-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = itut_vpclmul,
+    },
 };
 
 static int __bfdev_ctor
 itut_init(void)
 {
-    return csum_register(&itut);
+    crc_model_init(&itut_model, 16, 0x1021, false);
+
+    return crc_impl_register(itut_impls, CRC_IMPL_COUNT(itut_impls),
+                             &itut, 16);
 }
 
 static void __bfdev_dtor
 itut_exit(void)
 {
-    csum_unregister(&itut);
+    crc_impl_unregister(itut_impls, CRC_IMPL_COUNT(itut_impls));
 }
@@ -4,80 +4,111 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
+#include <afalg.h>
 #include <bfdev/crc.h>
 
-struct rocksoft_context {
-    struct csum_context csum;
-    char result[32];
-    uint64_t crc;
-};
+static struct crc_model rocksoft_model;
 
-#define csum_to_rocksoft(ptr) \
-    bfdev_container_of(ptr, struct rocksoft_context, csum)
+static struct afalg_hash rocksoft_hash = {
+    .name = "crc64-rocksoft",
+    .size = 8,
+    .little = true,
+    .tfm = -1,
+};
 
-static const char *
-rocksoft_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+rocksoft_update(uint64_t crc, const void *data, size_t length)
 {
-    struct rocksoft_context *rocksoft = csum_to_rocksoft(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        rocksoft->crc = bfdev_crc_rocksoft(buff, length, rocksoft->crc);
-        consumed += length;
-    }
+    return bfdev_crc_rocksoft(data, length, (uint64_t)crc);
+}
 
-    sprintf(rocksoft->result, "%#018llx", (unsigned long long)rocksoft->crc);
-    sta->offset = consumed;
+static uint64_t
+rocksoft_table(uint64_t crc, const void *data, size_t length)
+{
+    return ~crc_model_table(&rocksoft_model, ~crc, data, length);
+}
 
-    return rocksoft->result;
+static uint64_t
+rocksoft_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return ~crc_model_pclmul(&rocksoft_model, ~crc, data, length);
 }
 
-static struct csum_context *
-rocksoft_prepare(const char *args, unsigned long flags)
+static uint64_t
+rocksoft_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct rocksoft_context *rocksoft;
+    return ~crc_model_vpclmul(&rocksoft_model, ~crc, data, length);
+}
 
-    rocksoft = bfdev_zalloc(NULL, sizeof(*rocksoft));
-    if (bfdev_unlikely(!rocksoft))
-        return NULL;
+static uint64_t
+rocksoft_afalg(uint64_t crc, const void *data, size_t length)
+{
+    uint64_t value;
 
-    if (args)
-        rocksoft->crc = (uint64_t)strtoul(args, NULL, 0);
+    /* the kernel starts from zero, the initial register is folded in */
+    if (afalg_digest(&rocksoft_hash, data, length, &value))
+        return rocksoft_update(crc, data, length);
 
-    return &rocksoft->csum;
+    return csum_crc_combine(rocksoft_update, 64, crc, 0, value, length);
 }
 
-static void
-rocksoft_destroy(struct csum_context *ctx)
+static int
+rocksoft_probe(struct crc_impl *impl)
 {
-    struct rocksoft_context *rocksoft = csum_to_rocksoft(ctx);
-    bfdev_free(NULL, rocksoft);
+    return afalg_probe(&rocksoft_hash, &impl->algo);
 }
 
-static struct csum_algo rocksoft = {
-    .name = "crc-rocksoft",
-    .prepare = rocksoft_prepare,
-    .destroy = rocksoft_destroy,
-    .compute = rocksoft_compute,
+CRC_ALGO_TEMPLATE(rocksoft, "crc-rocksoft", uint64_t, 64, 18);
+
+static struct crc_impl rocksoft_impls[] = {
+    {
+        .algo = {
+            .driver = "crc-rocksoft-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = rocksoft_update,
+    }, {
+        .algo = {
+            .driver = "crc-rocksoft-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = rocksoft_table,
+    }, {
+        .algo = {
+            .driver = "crc-rocksoft-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = rocksoft_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc-rocksoft-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = rocksoft_vpclmul,
+    }, {
+        .algo = {
+            .driver = "crc-rocksoft-afalg",
+        },
+        .update = rocksoft_afalg,
+        .probe = rocksoft_probe,
+    },
 };
 
 static int __bfdev_ctor
 rocksoft_init(void)
 {
-    return csum_register(&rocksoft);
+    crc_model_init(&rocksoft_model, 64, 0xad93d23594c93659ULL, true);
+
+    return crc_impl_register(rocksoft_impls, CRC_IMPL_COUNT(rocksoft_impls),
+                             &rocksoft, 64);
 }
 
 static void __bfdev_dtor
 rocksoft_exit(void)
 {
-    csum_unregister(&rocksoft);
+    crc_impl_unregister(rocksoft_impls, CRC_IMPL_COUNT(rocksoft_impls));
+    afalg_release(&rocksoft_hash);
 }
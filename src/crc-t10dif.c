@@ -4,80 +4,110 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
+#include <afalg.h>
 #include <bfdev/crc.h>
 
-struct t10dif_context {
-    struct csum_context csum;
-    char result[32];
-    uint16_t crc;
-};
+static struct crc_model t10dif_model;
 
-#define csum_to_t10dif(ptr) \
-    bfdev_container_of(ptr, struct t10dif_context, csum)
+static struct afalg_hash t10dif_hash = {
+    .name = "crct10dif",
+    .size = 2,
+    .tfm = -1,
+};
 
-static const char *
-t10dif_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+t10dif_update(uint64_t crc, const void *data, size_t length)
 {
-    struct t10dif_context *t10dif = csum_to_t10dif(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        t10dif->crc = bfdev_crc_t10dif(buff, length, t10dif->crc);
-        consumed += length;
-    }
+    return bfdev_crc_t10dif(data, length, (uint16_t)crc);
+}
 
-    sprintf(t10dif->result, "%#06x", t10dif->crc);
-    sta->offset = consumed;
+static uint64_t
+t10dif_table(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_table(&t10dif_model, crc, data, length);
+}
 
-    return t10dif->result;
+static uint64_t
+t10dif_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&t10dif_model, crc, data, length);
 }
 
-static struct csum_context *
-t10dif_prepare(const char *args, unsigned long flags)
+static uint64_t
+t10dif_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct t10dif_context *t10dif;
+    return crc_model_vpclmul(&t10dif_model, crc, data, length);
+}
 
-    t10dif = bfdev_zalloc(NULL, sizeof(*t10dif));
-    if (bfdev_unlikely(!t10dif))
-        return NULL;
+static uint64_t
+t10dif_afalg(uint64_t crc, const void *data, size_t length)
+{
+    uint64_t value;
 
-    if (args)
-        t10dif->crc = (uint16_t)strtoul(args, NULL, 0);
+    /* the kernel starts from zero, the initial register is folded in */
+    if (afalg_digest(&t10dif_hash, data, length, &value))
+        return t10dif_update(crc, data, length);
 
-    return &t10dif->csum;
+    return csum_crc_combine(t10dif_update, 16, crc, 0, value, length);
 }
 
-static void
-t10dif_destroy(struct csum_context *ctx)
+static int
+t10dif_probe(struct crc_impl *impl)
 {
-    struct t10dif_context *t10dif = csum_to_t10dif(ctx);
-    bfdev_free(NULL, t10dif);
+    return afalg_probe(&t10dif_hash, &impl->algo);
 }
 
-static struct csum_algo t10dif = {
-    .name = "crc-t10dif",
-    .prepare = t10dif_prepare,
-    .destroy = t10dif_destroy,
-    .compute = t10dif_compute,
+CRC_ALGO_TEMPLATE(t10dif, "crc-t10dif", uint16_t, 16, 6);
+
+static struct crc_impl t10dif_impls[] = {
+    {
+        .algo = {
+            .driver = "crc-t10dif-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = t10dif_update,
+    }, {
+        .algo = {
+            .driver = "crc-t10dif-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = t10dif_table,
+    }, {
+        .algo = {
+            .driver = "crc-t10dif-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = t10dif_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc-t10dif-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = t10dif_vpclmul,
+    }, {
+        .algo = {
+            .driver = "crc-t10dif-afalg",
+        },
+        .update = t10dif_afalg,
+        .probe = t10dif_probe,
+    },
 };
 
 static int __bfdev_ctor
 t10dif_init(void)
 {
-    return csum_register(&t10dif);
+    crc_model_init(&t10dif_model, 16, 0x8bb7, false);
+
+    return crc_impl_register(t10dif_impls, CRC_IMPL_COUNT(t10dif_impls),
+                             &t10dif, 16);
 }
 
 static void __bfdev_dtor
 t10dif_exit(void)
 {
-    csum_unregister(&t10dif);
+    crc_impl_unregister(t10dif_impls, CRC_IMPL_COUNT(t10dif_impls));
+    afalg_release(&t10dif_hash);
 }
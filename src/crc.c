@@ -0,0 +1,372 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <model.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <bfdev/allocator.h>
+#include <bfdev/bits.h>
+
+#define CRC_DEFAULT "crc32/iso-hdlc"
+#define CRC_CHECK "123456789"
+
+struct crc_preset {
+    const char *name;
+    unsigned int width;
+    uint64_t poly;
+    uint64_t init;
+    bool refin;
+    bool refout;
+    uint64_t xorout;
+    uint64_t check;
+    bool verify;
+};
+
+struct crc_cache {
+    struct bfdev_list_head list;
+    struct crc_model model;
+};
+
+struct crc_context {
+    struct csum_context csum;
+    struct crc_model *model;
+    char result[32];
+    unsigned int digits;
+    bool reverse;
+    uint64_t xorout;
+    uint64_t init;
+    uint64_t crc;
+};
+
+#define csum_to_crc(ptr) \
+    bfdev_container_of(ptr, struct crc_context, csum)
+
+/* parameters and check values as catalogued by the CRC RevEng project */
+static const struct crc_preset
+crc_presets[] = {
+    {"crc4/g-704", 4, 0x3, 0x0, true, true, 0x0, 0x7},
+    {"crc4/interlaken", 4, 0x3, 0xf, false, false, 0xf, 0xb},
+    {"crc5/usb", 5, 0x05, 0x1f, true, true, 0x1f, 0x19},
+    {"crc7/mmc", 7, 0x09, 0x00, false, false, 0x00, 0x75},
+    {"crc8/smbus", 8, 0x07, 0x00, false, false, 0x00, 0xf4},
+    {"crc8/maxim-dow", 8, 0x31, 0x00, true, true, 0x00, 0xa1},
+    {"crc8/autosar", 8, 0x2f, 0xff, false, false, 0xff, 0xdf},
+    {"crc8/bluetooth", 8, 0xa7, 0x00, true, true, 0x00, 0x26},
+    {"crc10/atm", 10, 0x233, 0x000, false, false, 0x000, 0x199},
+    {"crc11/flexray", 11, 0x385, 0x01a, false, false, 0x000, 0x5a3},
+    {"crc12/umts", 12, 0x80f, 0x000, false, true, 0x000, 0xdaf},
+    {"crc15/can", 15, 0x4599, 0x0000, false, false, 0x0000, 0x059e},
+    {"crc16/arc", 16, 0x8005, 0x0000, true, true, 0x0000, 0xbb3d},
+    {"crc16/modbus", 16, 0x8005, 0xffff, true, true, 0x0000, 0x4b37},
+    {"crc16/usb", 16, 0x8005, 0xffff, true, true, 0xffff, 0xb4c8},
+    {"crc16/maxim-dow", 16, 0x8005, 0x0000, true, true, 0xffff, 0x44c2},
+    {"crc16/xmodem", 16, 0x1021, 0x0000, false, false, 0x0000, 0x31c3},
+    {"crc16/kermit", 16, 0x1021, 0x0000, true, true, 0x0000, 0x2189},
+    {"crc16/ibm-3740", 16, 0x1021, 0xffff, false, false, 0x0000, 0x29b1},
+    {"crc16/ibm-sdlc", 16, 0x1021, 0xffff, true, true, 0xffff, 0x906e},
+    {"crc16/genibus", 16, 0x1021, 0xffff, false, false, 0xffff, 0xd64e},
+    {"crc16/riello", 16, 0x1021, 0xb2aa, true, true, 0x0000, 0x63d0},
+    {"crc16/t10-dif", 16, 0x8bb7, 0x0000, false, false, 0x0000, 0xd0db},
+    {"crc16/dnp", 16, 0x3d65, 0x0000, true, true, 0xffff, 0xea82},
+    {"crc17/can-fd", 17, 0x1685b, 0x00000, false, false, 0x00000, 0x04f03},
+    {"crc21/can-fd", 21, 0x102899, 0x000000, false, false, 0x000000, 0x0ed841},
+    {"crc24/openpgp", 24, 0x864cfb, 0xb704ce, false, false, 0x000000, 0x21cf02},
+    {"crc31/philips", 31, 0x04c11db7, 0x7fffffff, false, false, 0x7fffffff, 0x0ce9e46c},
+    {"crc32/iso-hdlc", 32, 0x04c11db7, 0xffffffff, true, true, 0xffffffff, 0xcbf43926},
+    {"crc32/iscsi", 32, 0x1edc6f41, 0xffffffff, true, true, 0xffffffff, 0xe3069283},
+    {"crc32/bzip2", 32, 0x04c11db7, 0xffffffff, false, false, 0xffffffff, 0xfc891918},
+    {"crc32/mpeg-2", 32, 0x04c11db7, 0xffffffff, false, false, 0x00000000, 0x0376e6e7},
+    {"crc32/cksum", 32, 0x04c11db7, 0x00000000, false, false, 0xffffffff, 0x765e7680},
+    {"crc32/jamcrc", 32, 0x04c11db7, 0xffffffff, true, true, 0x00000000, 0x340bc6d9},
+    {"crc32/autosar", 32, 0xf4acfb13, 0xffffffff, true, true, 0xffffffff, 0x1697d06a},
+    {"crc32/base91-d", 32, 0xa833982b, 0xffffffff, true, true, 0xffffffff, 0x87315576},
+    {"crc40/gsm", 40, 0x0004820009, 0x0000000000, false, false, 0xffffffffff, 0xd4164fc646},
+    {"crc64/ecma-182", 64, 0x42f0e1eba9ea3693, 0x0, false, false, 0x0, 0x6c40df5f0b497347},
+    {"crc64/xz", 64, 0x42f0e1eba9ea3693, ~0ULL, true, true, ~0ULL, 0x995dc9bbdf1939fa},
+    {"crc64/we", 64, 0x42f0e1eba9ea3693, ~0ULL, false, false, ~0ULL, 0x62ec59e3f1a4f00a},
+    {"crc64/go-iso", 64, 0x000000000000001b, ~0ULL, true, true, ~0ULL, 0xb90956c775a41001},
+    {"crc64/nvme", 64, 0xad93d23594c93659, ~0ULL, true, true, ~0ULL, 0xae8b14860a799888},
+    { }, /* NULL */
+};
+
+static BFDEV_LIST_HEAD(crc_models);
+static pthread_mutex_t crc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+crc_reverse(uint64_t value, unsigned int width)
+{
+    uint64_t result = 0;
+
+    while (width--) {
+        result = (result << 1) | (value & 1);
+        value >>= 1;
+    }
+
+    return result;
+}
+
+static struct crc_model *
+crc_cache_get(unsigned int width, uint64_t poly, bool reflect)
+{
+    struct crc_cache *walk;
+
+    pthread_mutex_lock(&crc_lock);
+    bfdev_list_for_each_entry(walk, &crc_models, list) {
+        if (walk->model.width == width && walk->model.poly == poly &&
+            walk->model.reflect == reflect)
+            goto finish;
+    }
+
+    walk = bfdev_malloc(NULL, sizeof(*walk));
+    if (bfdev_unlikely(!walk))
+        goto finish;
+
+    crc_model_init(&walk->model, width, poly, reflect);
+    bfdev_list_add(&crc_models, &walk->list);
+
+finish:
+    pthread_mutex_unlock(&crc_lock);
+    return walk ? &walk->model : NULL;
+}
+
+static const struct crc_preset *
+crc_preset_find(const char *name)
+{
+    const struct crc_preset *walk;
+    const char *cmp;
+
+    for (walk = crc_presets; walk->name; ++walk) {
+        /* also accept the RevEng spelling, as in "CRC-32/ISCSI" */
+        cmp = name;
+        if (!strncasecmp(cmp, "crc-", 4))
+            cmp += 4;
+        else if (!strncasecmp(cmp, "crc", 3))
+            cmp += 3;
+
+        if (!strcasecmp(cmp, walk->name + 3))
+            return walk;
+    }
+
+    return NULL;
+}
+
+static bool
+crc_parse_bool(const char *value, bool *result)
+{
+    if (!strcasecmp(value, "true") || !strcmp(value, "1"))
+        *result = true;
+    else if (!strcasecmp(value, "false") || !strcmp(value, "0"))
+        *result = false;
+    else
+        return false;
+
+    return true;
+}
+
+static bool
+crc_parse(const char *args, struct crc_preset *param)
+{
+    const struct crc_preset *preset;
+    char *buffer, *walk, *value, *save;
+    bool explicit_check = false;
+    bool retval = false;
+
+    buffer = strdup(args);
+    if (bfdev_unlikely(!buffer))
+        return false;
+
+    for (walk = strtok_r(buffer, ",", &save); walk;
+         walk = strtok_r(NULL, ",", &save)) {
+        value = strchr(walk, '=');
+        if (!value) {
+            preset = crc_preset_find(walk);
+            if (!preset)
+                goto failed;
+            *param = *preset;
+            param->verify = true;
+            continue;
+        }
+
+        /* the check value of a preset no longer holds once it is tweaked */
+        *value++ = '\0';
+        if (!strcmp(walk, "check"))
+            explicit_check = true;
+        else
+            param->verify = false;
+
+        if (!strcmp(walk, "width"))
+            param->width = strtoul(value, NULL, 0);
+        else if (!strcmp(walk, "poly"))
+            param->poly = strtoull(value, NULL, 0);
+        else if (!strcmp(walk, "init"))
+            param->init = strtoull(value, NULL, 0);
+        else if (!strcmp(walk, "xorout"))
+            param->xorout = strtoull(value, NULL, 0);
+        else if (!strcmp(walk, "check"))
+            param->check = strtoull(value, NULL, 0);
+        else if (!strcmp(walk, "refin")) {
+            if (!crc_parse_bool(value, &param->refin))
+                goto failed;
+        } else if (!strcmp(walk, "refout")) {
+            if (!crc_parse_bool(value, &param->refout))
+                goto failed;
+        } else
+            goto failed;
+    }
+
+    param->verify |= explicit_check;
+    retval = param->width && param->width <= BFDEV_BITS_PER_U64;
+
+failed:
+    free(buffer);
+    return retval;
+}
+
+static uint64_t
+crc_finish(struct crc_context *crc, uint64_t value)
+{
+    if (crc->reverse)
+        value = crc_reverse(value, crc->model->width);
+
+    return value ^ crc->xorout;
+}
+
+static const char *
+crc_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct crc_context *crc = csum_to_crc(ctx);
+    uintptr_t consumed = sta->offset;
+    size_t length;
+    const void *buff;
+    uint64_t value;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        crc->crc = crc_model_update(crc->model, crc->crc, buff, length);
+        consumed += length;
+    }
+
+    value = crc_finish(crc, crc->crc);
+    sprintf(crc->result, "%#0*llx", crc->digits, (unsigned long long)value);
+    sta->offset = consumed;
+
+    return crc->result;
+}
+
+static struct csum_context *
+crc_prepare(const char *args, unsigned long flags)
+{
+    struct crc_preset param = { };
+    struct crc_context *crc;
+    uint64_t mask, value;
+
+    if (!crc_parse(args ? args : CRC_DEFAULT, &param))
+        return NULL;
+
+    crc = bfdev_zalloc(NULL, sizeof(*crc));
+    if (bfdev_unlikely(!crc))
+        return NULL;
+
+    mask = UINT64_MAX >> (BFDEV_BITS_PER_U64 - param.width);
+    crc->model = crc_cache_get(param.width, param.poly & mask, param.refin);
+    if (bfdev_unlikely(!crc->model)) {
+        bfdev_free(NULL, crc);
+        return NULL;
+    }
+
+    /* init is given unreflected, the reflected register holds it mirrored */
+    crc->init = param.init & mask;
+    if (param.refin)
+        crc->init = crc_reverse(crc->init, param.width);
+
+    crc->crc = crc->init;
+    crc->xorout = param.xorout & mask;
+    crc->reverse = param.refin != param.refout;
+    crc->digits = (param.width + 3) / 4 + 2;
+
+    /* refuse a model that does not reproduce its catalogued check value */
+    if (param.verify) {
+        value = crc_model_update(crc->model, crc->init, CRC_CHECK,
+                                 sizeof(CRC_CHECK) - 1);
+        value = crc_finish(crc, value);
+        if (value != (param.check & mask)) {
+            csum_prepare_fail("check value mismatch (expected %#llx, got %#llx)",
+                              (unsigned long long)(param.check & mask),
+                              (unsigned long long)value);
+            bfdev_free(NULL, crc);
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    return &crc->csum;
+}
+
+static void
+crc_destroy(struct csum_context *ctx)
+{
+    struct crc_context *crc = csum_to_crc(ctx);
+    bfdev_free(NULL, crc);
+}
+
+static void
+crc_reset(struct csum_context *ctx)
+{
+    struct crc_context *crc = csum_to_crc(ctx);
+    crc->crc = crc->init;
+}
+
+static void
+crc_combine(struct csum_context *ctx, struct csum_context *next, uint64_t length)
+{
+    struct crc_context *crc = csum_to_crc(ctx);
+    struct crc_context *other = csum_to_crc(next);
+
+    crc->crc = csum_model_combine(crc->model, crc->crc, crc->init,
+                                  other->crc, length);
+}
+
+static void
+crc_zeros(struct csum_context *ctx, uint64_t length)
+{
+    struct crc_context *crc = csum_to_crc(ctx);
+    crc->crc = csum_model_zeros(crc->model, crc->crc, length);
+}
+
+static struct csum_algo crc = {
+    .name = "crc",
+    .desc = "parameterized crc, -p PRESET or width=,poly=,init=,refin=,refout=,xorout=,check=",
+    .prepare = crc_prepare,
+    .destroy = crc_destroy,
+    .reset = crc_reset,
+    .compute = crc_compute,
+    .combine = crc_combine,
+    .zeros = crc_zeros,
+};
+
+static int __bfdev_ctor
+crc_init(void)
+{
+    return csum_register(&crc);
+}
+
+static void __bfdev_dtor
+crc_exit(void)
+{
+    struct crc_cache *walk, *tmp;
+
+    csum_unregister(&crc);
+    bfdev_list_for_each_entry_safe(walk, tmp, &crc_models, list) {
+        bfdev_list_del(&walk->list);
+        bfdev_free(NULL, walk);
+    }
+}
@@ -4,80 +4,78 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/crc.h>
 
-struct crc16_context {
-    struct csum_context csum;
-    char result[32];
-    uint16_t crc;
-};
-
-#define csum_to_crc16(ptr) \
-    bfdev_container_of(ptr, struct crc16_context, csum)
+static struct crc_model crc16_model;
 
-static const char *
-crc16_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+crc16_update(uint64_t crc, const void *data, size_t length)
 {
-    struct crc16_context *crc16 = csum_to_crc16(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        crc16->crc = bfdev_crc16(buff, length, crc16->crc);
-        consumed += length;
-    }
-
-    sprintf(crc16->result, "%#06x", crc16->crc);
-    sta->offset = consumed;
-
-    return crc16->result;
+    return bfdev_crc16(data, length, (uint16_t)crc);
 }
 
-static struct csum_context *
-crc16_prepare(const char *args, unsigned long flags)
+static uint64_t
+crc16_table(uint64_t crc, const void *data, size_t length)
 {
-    struct crc16_context *crc16;
-
-    crc16 = bfdev_zalloc(NULL, sizeof(*crc16));
-    if (bfdev_unlikely(!crc16))
-        return NULL;
-
-    if (args)
-        crc16->crc = (uint16_t)strtoul(args, NULL, 0);
+    return crc_model_table(&crc16_model, crc, data, length);
+}
 
-    return &crc16->csum;
+static uint64_t
+crc16_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&crc16_model, crc, data, length);
 }
 
-static void
-crc16_destroy(struct csum_context *ctx)
+static uint64_t
+crc16_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct crc16_context *crc16 = csum_to_crc16(ctx);
-    bfdev_free(NULL, crc16);
+    return crc_model_vpclmul(&crc16_model, crc, data, length);
 }
 
-static struct csum_algo crc16 = {
-    .name = "crc16",
-    .prepare = crc16_prepare,
-    .destroy = crc16_destroy,
-    .compute = crc16_compute,
+CRC_ALGO_TEMPLATE(crc16, "crc16", uint16_t, 16, 6);
+
+static struct crc_impl crc16_impls[] = {
+    {
+        .algo = {
+            .driver = "crc16-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = crc16_update,
+    }, {
+        .algo = {
+            .driver = "crc16-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = crc16_table,
+    }, {
+        .algo = {
+            .driver = "crc16-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = crc16_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc16-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = crc16_vpclmul,
+    },
 };
 
 static int __bfdev_ctor
 crc16_init(void)
 {
-    return csum_register(&crc16);
+    crc_model_init(&crc16_model, 16, 0x8005, true);
+
+    return crc_impl_register(crc16_impls, CRC_IMPL_COUNT(crc16_impls),
+                             &crc16, 16);
 }
 
 static void __bfdev_dtor
 crc16_exit(void)
 {
-    csum_unregister(&crc16);
+    crc_impl_unregister(crc16_impls, CRC_IMPL_COUNT(crc16_impls));
 }
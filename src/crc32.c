@@ -4,80 +4,111 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
+#include <afalg.h>
 #include <bfdev/crc.h>
 
-struct crc32_context {
-    struct csum_context csum;
-    char result[32];
-    uint32_t crc;
-};
+static struct crc_model crc32_model;
 
-#define csum_to_crc32(ptr) \
-    bfdev_container_of(ptr, struct crc32_context, csum)
+static struct afalg_hash crc32_hash = {
+    .name = "crc32",
+    .size = 4,
+    .little = true,
+    .tfm = -1,
+};
 
-static const char *
-crc32_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+crc32_update(uint64_t crc, const void *data, size_t length)
 {
-    struct crc32_context *crc32 = csum_to_crc32(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        crc32->crc = bfdev_crc32(buff, length, crc32->crc);
-        consumed += length;
-    }
+    return bfdev_crc32(data, length, (uint32_t)crc);
+}
 
-    sprintf(crc32->result, "%#010x", crc32->crc);
-    sta->offset = consumed;
+static uint64_t
+crc32_table(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_table(&crc32_model, crc, data, length);
+}
 
-    return crc32->result;
+static uint64_t
+crc32_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&crc32_model, crc, data, length);
 }
 
-static struct csum_context *
-crc32_prepare(const char *args, unsigned long flags)
+static uint64_t
+crc32_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct crc32_context *crc32;
+    return crc_model_vpclmul(&crc32_model, crc, data, length);
+}
 
-    crc32 = bfdev_zalloc(NULL, sizeof(*crc32));
-    if (bfdev_unlikely(!crc32))
-        return NULL;
+static uint64_t
+crc32_afalg(uint64_t crc, const void *data, size_t length)
+{
+    uint64_t value;
 
-    if (args)
-        crc32->crc = (uint32_t)strtoul(args, NULL, 0);
+    /* the kernel starts from zero, the initial register is folded in */
+    if (afalg_digest(&crc32_hash, data, length, &value))
+        return crc32_update(crc, data, length);
 
-    return &crc32->csum;
+    return csum_crc_combine(crc32_update, 32, crc, 0, value, length);
 }
 
-static void
-crc32_destroy(struct csum_context *ctx)
+static int
+crc32_probe(struct crc_impl *impl)
 {
-    struct crc32_context *crc32 = csum_to_crc32(ctx);
-    bfdev_free(NULL, crc32);
+    return afalg_probe(&crc32_hash, &impl->algo);
 }
 
-static struct csum_algo crc32 = {
-    .name = "crc32",
-    .prepare = crc32_prepare,
-    .destroy = crc32_destroy,
-    .compute = crc32_compute,
+CRC_ALGO_TEMPLATE(crc32, "crc32", uint32_t, 32, 10);
+
+static struct crc_impl crc32_impls[] = {
+    {
+        .algo = {
+            .driver = "crc32-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = crc32_update,
+    }, {
+        .algo = {
+            .driver = "crc32-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = crc32_table,
+    }, {
+        .algo = {
+            .driver = "crc32-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = crc32_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc32-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = crc32_vpclmul,
+    }, {
+        .algo = {
+            .driver = "crc32-afalg",
+        },
+        .update = crc32_afalg,
+        .probe = crc32_probe,
+    },
 };
 
 static int __bfdev_ctor
 crc32_init(void)
 {
-    return csum_register(&crc32);
+    crc_model_init(&crc32_model, 32, 0x04c11db7, true);
+
+    return crc_impl_register(crc32_impls, CRC_IMPL_COUNT(crc32_impls),
+                             &crc32, 32);
 }
 
 static void __bfdev_dtor
 crc32_exit(void)
 {
-    csum_unregister(&crc32);
+    crc_impl_unregister(crc32_impls, CRC_IMPL_COUNT(crc32_impls));
+    afalg_release(&crc32_hash);
 }
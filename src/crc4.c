@@ -4,81 +4,81 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/bits.h>
 #include <bfdev/crc.h>
 
-struct crc4_context {
-    struct csum_context csum;
-    char result[32];
-    uint8_t crc;
-};
-
-#define csum_to_crc4(ptr) \
-    bfdev_container_of(ptr, struct crc4_context, csum)
+static struct crc_narrow crc4_narrow;
+static struct crc_model crc4_model;
 
-static const char *
-crc4_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+crc4_update(uint64_t crc, const void *data, size_t length)
 {
-    struct crc4_context *crc4 = csum_to_crc4(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        crc4->crc = bfdev_crc4(buff, length * BFDEV_BITS_PER_U8, crc4->crc);
-        consumed += length;
-    }
-
-    sprintf(crc4->result, "%#03x", crc4->crc);
-    sta->offset = consumed;
-
-    return crc4->result;
+    return bfdev_crc4(data, length * BFDEV_BITS_PER_U8, (uint8_t)crc);
 }
 
-static struct csum_context *
-crc4_prepare(const char *args, unsigned long flags)
+static uint64_t
+crc4_slice(uint64_t crc, const void *data, size_t length)
 {
-    struct crc4_context *crc4;
-
-    crc4 = bfdev_zalloc(NULL, sizeof(*crc4));
-    if (bfdev_unlikely(!crc4))
-        return NULL;
-
-    if (args)
-        crc4->crc = (uint8_t)strtoul(args, NULL, 0);
+    return crc_narrow_update(&crc4_narrow, crc, data, length);
+}
 
-    return &crc4->csum;
+static uint64_t
+crc4_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&crc4_model, crc, data, length);
 }
 
-static void
-crc4_destroy(struct csum_context *ctx)
+static uint64_t
+crc4_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct crc4_context *crc4 = csum_to_crc4(ctx);
-    bfdev_free(NULL, crc4);
+    return crc_model_vpclmul(&crc4_model, crc, data, length);
 }
 
-static struct csum_algo crc4 = {
-    .name = "crc4",
-    .prepare = crc4_prepare,
-    .destroy = crc4_destroy,
-    .compute = crc4_compute,
+CRC_ALGO_TEMPLATE(crc4, "crc4", uint8_t, 4, 3);
+
+static struct crc_impl crc4_impls[] = {
+    {
+        .algo = {
+            .driver = "crc4-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = crc4_update,
+    }, {
+        .algo = {
+            .driver = "crc4-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = crc4_slice,
+    }, {
+        .algo = {
+            .driver = "crc4-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = crc4_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc4-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = crc4_vpclmul,
+    },
 };
 
 static int __bfdev_ctor
 crc4_init(void)
 {
-    return csum_register(&crc4);
+    crc_narrow_init(&crc4_narrow, 4, crc4_update);
+    crc_model_init(&crc4_model, 4, 0x7, false);
+
+    return crc_impl_register(crc4_impls, CRC_IMPL_COUNT(crc4_impls),
+                             &crc4, 4);
 }
 
 static void __bfdev_dtor
 crc4_exit(void)
 {
-    csum_unregister(&crc4);
+    crc_impl_unregister(crc4_impls, CRC_IMPL_COUNT(crc4_impls));
 }
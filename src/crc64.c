@@ -4,80 +4,78 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/crc.h>
 
-struct crc64_context {
-    struct csum_context csum;
-    char result[32];
-    uint64_t crc;
-};
-
-#define csum_to_crc64(ptr) \
-    bfdev_container_of(ptr, struct crc64_context, csum)
+static struct crc_model crc64_model;
 
-static const char *
-crc64_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+crc64_update(uint64_t crc, const void *data, size_t length)
 {
-    struct crc64_context *crc64 = csum_to_crc64(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        crc64->crc = bfdev_crc64(buff, length, crc64->crc);
-        consumed += length;
-    }
-
-    sprintf(crc64->result, "%#018llx", (unsigned long long)crc64->crc);
-    sta->offset = consumed;
-
-    return crc64->result;
+    return bfdev_crc64(data, length, (uint64_t)crc);
 }
 
-static struct csum_context *
-crc64_prepare(const char *args, unsigned long flags)
+static uint64_t
+crc64_table(uint64_t crc, const void *data, size_t length)
 {
-    struct crc64_context *crc64;
-
-    crc64 = bfdev_zalloc(NULL, sizeof(*crc64));
-    if (bfdev_unlikely(!crc64))
-        return NULL;
-
-    if (args)
-        crc64->crc = (uint64_t)strtoul(args, NULL, 0);
+    return crc_model_table(&crc64_model, crc, data, length);
+}
 
-    return &crc64->csum;
+static uint64_t
+crc64_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc_model_pclmul(&crc64_model, crc, data, length);
 }
 
-static void
-crc64_destroy(struct csum_context *ctx)
+static uint64_t
+crc64_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct crc64_context *crc64 = csum_to_crc64(ctx);
-    bfdev_free(NULL, crc64);
+    return crc_model_vpclmul(&crc64_model, crc, data, length);
 }
 
-static struct csum_algo crc64 = {
-    .name = "crc64",
-    .prepare = crc64_prepare,
-    .destroy = crc64_destroy,
-    .compute = crc64_compute,
+CRC_ALGO_TEMPLATE(crc64, "crc64", uint64_t, 64, 18);
+
+static struct crc_impl crc64_impls[] = {
+    {
+        .algo = {
+            .driver = "crc64-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = crc64_update,
+    }, {
+        .algo = {
+            .driver = "crc64-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = crc64_table,
+    }, {
+        .algo = {
+            .driver = "crc64-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = crc64_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc64-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = crc64_vpclmul,
+    },
 };
 
 static int __bfdev_ctor
 crc64_init(void)
 {
-    return csum_register(&crc64);
+    crc_model_init(&crc64_model, 64, 0x42f0e1eba9ea3693ULL, false);
+
+    return crc_impl_register(crc64_impls, CRC_IMPL_COUNT(crc64_impls),
+                             &crc64, 64);
 }
 
 static void __bfdev_dtor
 crc64_exit(void)
 {
-    csum_unregister(&crc64);
+    crc_impl_unregister(crc64_impls, CRC_IMPL_COUNT(crc64_impls));
 }
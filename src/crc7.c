@@ -4,80 +4,92 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/crc.h>
 
-struct ccitt_context {
-    struct csum_context csum;
-    char result[32];
-    uint8_t crc;
-};
-
-#define csum_to_ccitt(ptr) \
-    bfdev_container_of(ptr, struct ccitt_context, csum)
+static struct crc_narrow crc7_narrow;
+static struct crc_model crc7_model;
 
-static const char *
-ccitt_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+crc7_update(uint64_t crc, const void *data, size_t length)
 {
-    struct ccitt_context *ccitt = csum_to_ccitt(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        ccitt->crc = bfdev_crc7(buff, length, ccitt->crc);
-        consumed += length;
-    }
-
-    sprintf(ccitt->result, "%#02x", ccitt->crc);
-    sta->offset = consumed;
-
-    return ccitt->result;
+    return bfdev_crc7(data, length, (uint8_t)crc);
 }
 
-static struct csum_context *
-ccitt_prepare(const char *args, unsigned long flags)
+static uint64_t
+crc7_slice(uint64_t crc, const void *data, size_t length)
 {
-    struct ccitt_context *ccitt;
+    return crc_narrow_update(&crc7_narrow, crc, data, length);
+}
 
-    ccitt = bfdev_zalloc(NULL, sizeof(*ccitt));
-    if (bfdev_unlikely(!ccitt))
-        return NULL;
+static inline uint64_t
+crc7_fold(uint64_t (*kernel)(const struct crc_model *model, uint64_t crc,
+                             const void *data, size_t length),
+          uint64_t crc, const void *data, size_t length)
+{
+    /* the register lives in the upper 7 bits, bit 0 is not part of it */
+    if (crc & 1)
+        return crc_narrow_update(&crc7_narrow, crc, data, length);
 
-    if (args)
-        ccitt->crc = (uint8_t)strtoul(args, NULL, 0);
+    return kernel(&crc7_model, crc >> 1, data, length) << 1;
+}
 
-    return &ccitt->csum;
+static uint64_t
+crc7_pclmul(uint64_t crc, const void *data, size_t length)
+{
+    return crc7_fold(crc_model_pclmul, crc, data, length);
 }
 
-static void
-ccitt_destroy(struct csum_context *ctx)
+static uint64_t
+crc7_vpclmul(uint64_t crc, const void *data, size_t length)
 {
-    struct ccitt_context *ccitt = csum_to_ccitt(ctx);
-    bfdev_free(NULL, ccitt);
+    return crc7_fold(crc_model_vpclmul, crc, data, length);
 }
 
-static struct csum_algo ccitt = {
-    .name = "crc7",
-    .prepare = ccitt_prepare,
-    .destroy = ccitt_destroy,
-    .compute = ccitt_compute,
+CRC_ALGO_TEMPLATE(crc7, "crc7", uint8_t, 8, 2);
+
+static struct crc_impl crc7_impls[] = {
+    {
+        .algo = {
+            .driver = "crc7-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = crc7_update,
+    }, {
+        .algo = {
+            .driver = "crc7-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = crc7_slice,
+    }, {
+        .algo = {
+            .driver = "crc7-pclmul",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CRC_IMPL_PCLMUL,
+        },
+        .update = crc7_pclmul,
+    }, {
+        .algo = {
+            .driver = "crc7-vpclmul",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CRC_IMPL_VPCLMUL,
+        },
+        .update = crc7_vpclmul,
+    },
 };
 
 static int __bfdev_ctor
-ccitt_init(void)
+crc7_init(void)
 {
-    return csum_register(&ccitt);
+    crc_narrow_init(&crc7_narrow, 8, crc7_update);
+    crc_model_init(&crc7_model, 7, 0x09, false);
+
+    return crc_impl_register(crc7_impls, CRC_IMPL_COUNT(crc7_impls),
+                             &crc7, 8);
 }
 
 static void __bfdev_dtor
-ccitt_exit(void)
+crc7_exit(void)
 {
-    csum_unregister(&ccitt);
+    crc_impl_unregister(crc7_impls, CRC_IMPL_COUNT(crc7_impls));
 }
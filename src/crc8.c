@@ -4,80 +4,52 @@
  */
 
 #include <csum.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <bfdev/allocator.h>
+#include <model.h>
 #include <bfdev/crc.h>
 
-struct crc8_context {
-    struct csum_context csum;
-    char result[32];
-    uint8_t crc;
-};
-
-#define csum_to_crc8(ptr) \
-    bfdev_container_of(ptr, struct crc8_context, csum)
+static struct crc_narrow crc8_narrow;
 
-static const char *
-crc8_compute(struct csum_context *ctx, struct csum_state *sta)
+static uint64_t
+crc8_update(uint64_t crc, const void *data, size_t length)
 {
-    struct crc8_context *crc8 = csum_to_crc8(ctx);
-    uintptr_t consumed = sta->offset;
-    size_t length;
-    const void *buff;
-
-    for (;;) {
-        length = ctx->next_block(ctx, sta, consumed, &buff);
-        if (!length)
-            break;
-
-        crc8->crc = bfdev_crc8(buff, length, crc8->crc);
-        consumed += length;
-    }
-
-    sprintf(crc8->result, "%#04x", crc8->crc);
-    sta->offset = consumed;
-
-    return crc8->result;
+    return bfdev_crc8(data, length, (uint8_t)crc);
 }
 
-static struct csum_context *
-crc8_prepare(const char *args, unsigned long flags)
+static uint64_t
+crc8_slice(uint64_t crc, const void *data, size_t length)
 {
-    struct crc8_context *crc8;
-
-    crc8 = bfdev_zalloc(NULL, sizeof(*crc8));
-    if (bfdev_unlikely(!crc8))
-        return NULL;
-
-    if (args)
-        crc8->crc = (uint8_t)strtoul(args, NULL, 0);
-
-    return &crc8->csum;
-}
-
-static void
-crc8_destroy(struct csum_context *ctx)
-{
-    struct crc8_context *crc8 = csum_to_crc8(ctx);
-    bfdev_free(NULL, crc8);
+    return crc_narrow_update(&crc8_narrow, crc, data, length);
 }
 
-static struct csum_algo crc8 = {
-    .name = "crc8",
-    .prepare = crc8_prepare,
-    .destroy = crc8_destroy,
-    .compute = crc8_compute,
+CRC_ALGO_TEMPLATE(crc8, "crc8", uint8_t, 8, 4);
+
+static struct crc_impl crc8_impls[] = {
+    {
+        .algo = {
+            .driver = "crc8-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = crc8_update,
+    }, {
+        .algo = {
+            .driver = "crc8-table",
+            .priority = CSUM_PRIO_TABLE,
+        },
+        .update = crc8_slice,
+    },
 };
 
 static int __bfdev_ctor
 crc8_init(void)
 {
-    return csum_register(&crc8);
+    crc_narrow_init(&crc8_narrow, 8, crc8_update);
+
+    return crc_impl_register(crc8_impls, CRC_IMPL_COUNT(crc8_impls),
+                             &crc8, 8);
 }
 
 static void __bfdev_dtor
 crc8_exit(void)
 {
-    csum_unregister(&crc8);
+    crc_impl_unregister(crc8_impls, CRC_IMPL_COUNT(crc8_impls));
 }
@@ -4,24 +4,119 @@
  */
 
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 #include <csum.h>
 
 BFDEV_LIST_HEAD(csum_algos);
 
+/* why the last prepare on this thread refused its arguments */
+static __thread char prepare_error[128];
+
+static const char *
+cpu_names[__CSUM_CPU_NR] = {
+    [__CSUM_CPU_SSE2] = "sse2",
+    [__CSUM_CPU_SSSE3] = "ssse3",
+    [__CSUM_CPU_SSE41] = "sse4.1",
+    [__CSUM_CPU_PCLMUL] = "pclmul",
+    [__CSUM_CPU_AVX2] = "avx2",
+    [__CSUM_CPU_AVX512F] = "avx512f",
+    [__CSUM_CPU_AVX512BW] = "avx512bw",
+    [__CSUM_CPU_VPCLMUL] = "vpclmulqdq",
+    [__CSUM_CPU_SHA] = "sha",
+};
+
+unsigned long
+csum_cpu_features(void)
+{
+    static unsigned long features;
+    static bool probed;
+
+    if (bfdev_likely(probed))
+        return features;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        features |= CSUM_CPU_SSE2;
+    if (__builtin_cpu_supports("ssse3"))
+        features |= CSUM_CPU_SSSE3;
+    if (__builtin_cpu_supports("sse4.1"))
+        features |= CSUM_CPU_SSE41;
+    if (__builtin_cpu_supports("pclmul"))
+        features |= CSUM_CPU_PCLMUL;
+    if (__builtin_cpu_supports("avx2"))
+        features |= CSUM_CPU_AVX2;
+    if (__builtin_cpu_supports("avx512f"))
+        features |= CSUM_CPU_AVX512F;
+    if (__builtin_cpu_supports("avx512bw"))
+        features |= CSUM_CPU_AVX512BW;
+    if (__builtin_cpu_supports("vpclmulqdq"))
+        features |= CSUM_CPU_VPCLMUL;
+    if (__builtin_cpu_supports("sha"))
+        features |= CSUM_CPU_SHA;
+#endif
+
+    probed = true;
+    return features;
+}
+
+const char *
+csum_cpu_name(unsigned int feature)
+{
+    if (feature >= __CSUM_CPU_NR)
+        return NULL;
+    return cpu_names[feature];
+}
+
+static inline bool
+algo_usable(struct csum_algo *algo)
+{
+    return !(algo->features & ~csum_cpu_features());
+}
+
 static struct csum_algo *
-algo_find(const char *name)
+driver_find(const char *driver)
 {
     struct csum_algo *walk;
 
     bfdev_list_for_each_entry(walk, &csum_algos, list) {
-        if (!strcmp(walk->name, name))
+        if (!strcmp(walk->driver, driver))
             return walk;
     }
 
     return NULL;
 }
 
+/*
+ * A driver name picks that implementation directly. An algorithm name
+ * picks the implementation selected by the user, or else the usable
+ * one with the highest priority.
+ */
+static struct csum_algo *
+algo_find(const char *name)
+{
+    struct csum_algo *walk, *best = NULL;
+
+    walk = driver_find(name);
+    if (walk)
+        return algo_usable(walk) ? walk : NULL;
+
+    bfdev_list_for_each_entry(walk, &csum_algos, list) {
+        if (strcmp(walk->name, name) || !algo_usable(walk))
+            continue;
+
+        if (walk->selected)
+            return walk;
+
+        if (!best || walk->priority > best->priority)
+            best = walk;
+    }
+
+    return best;
+}
+
 static bool
 algo_exist(struct csum_algo *algo)
 {
@@ -35,6 +130,33 @@ algo_exist(struct csum_algo *algo)
     return false;
 }
 
+struct csum_algo *
+csum_find(const char *name)
+{
+    return algo_find(name);
+}
+
+int
+csum_select(const char *driver)
+{
+    struct csum_algo *algo, *walk;
+
+    algo = driver_find(driver);
+    if (!algo)
+        return -ENOENT;
+
+    if (!algo_usable(algo))
+        return -EOPNOTSUPP;
+
+    bfdev_list_for_each_entry(walk, &csum_algos, list) {
+        if (!strcmp(walk->name, algo->name))
+            walk->selected = false;
+    }
+
+    algo->selected = true;
+    return 0;
+}
+
 int
 csum_register(struct csum_algo *algo)
 {
@@ -42,7 +164,10 @@ csum_register(struct csum_algo *algo)
         !algo->destroy)
         return -EINVAL;
 
-    if (algo_find(algo->name))
+    if (!algo->driver)
+        algo->driver = algo->name;
+
+    if (driver_find(algo->driver))
         return -EALREADY;
 
     bfdev_list_add(&csum_algos, &algo->list);
@@ -66,6 +191,7 @@ csum_prepare(const char *name, const char *args,
     struct csum_algo *algo;
     struct csum_context *tsc;
 
+    prepare_error[0] = '\0';
     algo = algo_find(name);
     if (!algo)
         return NULL;
@@ -75,7 +201,41 @@ csum_prepare(const char *name, const char *args,
         return NULL;
 
     tsc->algo = algo;
+    tsc->args = args;
     tsc->flags = flags;
 
     return tsc;
 }
+
+void
+csum_prepare_fail(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(prepare_error, sizeof(prepare_error), fmt, args);
+    va_end(args);
+}
+
+const char *
+csum_prepare_error(void)
+{
+    return prepare_error[0] ? prepare_error : NULL;
+}
+
+struct csum_context *
+csum_clone(struct csum_context *ctx)
+{
+    struct csum_algo *algo = ctx->algo;
+    struct csum_context *tsc;
+
+    tsc = algo->prepare(ctx->args, ctx->flags);
+    if (!tsc)
+        return NULL;
+
+    tsc->algo = algo;
+    tsc->args = ctx->args;
+    tsc->flags = ctx->flags;
+
+    return tsc;
+}
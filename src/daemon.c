@@ -0,0 +1,629 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/fs.h>
+#include <csum.h>
+#include <daemon.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define DAEMON_BUFFER 0x10000
+#define DAEMON_LINE 0x1000
+#define DAEMON_CACHE 16
+#define DAEMON_BACKLOG 64
+#define DAEMON_WORKERS 256
+
+struct daemon_cache {
+    struct csum_context *ctx;
+    char *algo;
+    char *args;
+};
+
+struct daemon_server {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    int queue[DAEMON_BACKLOG];
+    unsigned int head;
+    unsigned int tail;
+};
+
+/*
+ * Every worker owns its contexts, so warm contexts are reset and reused
+ * without any locking. The cache is small and evicted round robin.
+ */
+struct daemon_worker {
+    struct daemon_server *server;
+    struct daemon_cache cache[DAEMON_CACHE];
+    unsigned int victim;
+    pthread_t thread;
+};
+
+struct daemon_stream {
+    uint8_t buffer[DAEMON_BUFFER];
+    uint64_t remain;
+    uint64_t total;
+    bool ended;
+    FILE *in;
+    int error;
+};
+
+static bool
+daemon_chunk(struct daemon_stream *stream, const char *field)
+{
+    char line[DAEMON_LINE], *end;
+
+    if (!field) {
+        if (!fgets(line, sizeof(line), stream->in)) {
+            stream->error = EIO;
+            return false;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        field = line;
+    }
+
+    stream->remain = strtoull(field, &end, 10);
+    if (*field < '0' || *field > '9' || *end) {
+        stream->error = EPROTO;
+        return false;
+    }
+
+    stream->total += stream->remain;
+    stream->ended = !stream->remain;
+
+    return !stream->ended;
+}
+
+static size_t
+daemon_next_block(struct csum_context *ctx, struct csum_state *sta,
+                  uintptr_t consumed, const void **dest)
+{
+    struct daemon_stream *stream = sta->pdata;
+    size_t size;
+
+    if (!stream->remain && (stream->ended || !daemon_chunk(stream, NULL)))
+        return 0;
+
+    size = bfdev_min(stream->remain, (uint64_t)DAEMON_BUFFER);
+    size = fread(stream->buffer, 1, size, stream->in);
+    if (bfdev_unlikely(!size)) {
+        stream->error = EIO;
+        return 0;
+    }
+
+    stream->remain -= size;
+    *dest = stream->buffer;
+
+    return size;
+}
+
+static inline bool
+daemon_same(const char *a, const char *b)
+{
+    if (!a || !b)
+        return a == b;
+    return !strcmp(a, b);
+}
+
+static void
+daemon_evict(struct daemon_cache *cache)
+{
+    if (!cache->ctx)
+        return;
+
+    csum_destroy(cache->ctx);
+    free(cache->algo);
+    free(cache->args);
+    cache->ctx = NULL;
+}
+
+static struct csum_context *
+daemon_context(struct daemon_worker *worker, const char *algo, const char *args)
+{
+    struct daemon_cache *cache;
+    unsigned int count;
+
+    for (count = 0; count < DAEMON_CACHE; ++count) {
+        cache = &worker->cache[count];
+        if (!cache->ctx || strcmp(cache->algo, algo) ||
+            !daemon_same(cache->args, args))
+            continue;
+
+        if (!csum_reset(cache->ctx))
+            return cache->ctx;
+
+        daemon_evict(cache);
+        goto prepare;
+    }
+
+    cache = &worker->cache[worker->victim++ % DAEMON_CACHE];
+    daemon_evict(cache);
+
+prepare:
+    cache->algo = strdup(algo);
+    cache->args = args ? strdup(args) : NULL;
+    if (!cache->algo || (args && !cache->args))
+        goto failed;
+
+    /* the context keeps a reference to the cached argument string */
+    cache->ctx = csum_prepare(cache->algo, cache->args, 0);
+    if (!cache->ctx)
+        goto failed;
+
+    return cache->ctx;
+
+failed:
+    free(cache->algo);
+    free(cache->args);
+    return NULL;
+}
+
+static const char *
+daemon_file(struct csum_context *ctx, const char *path, uint64_t *length)
+{
+    const char *result = NULL;
+    struct csum_linear linear;
+    struct csum_state sta;
+    struct stat stat;
+    uint64_t size;
+    void *mmaped;
+    int fd, align;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &stat) < 0)
+        goto finish;
+
+    if (S_ISREG(stat.st_mode)) {
+        if (!stat.st_size) {
+            result = csum_linear_compute(ctx, &linear, NULL, 0);
+            *length = 0;
+            goto finish;
+        }
+
+        mmaped = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mmaped == MAP_FAILED)
+            goto finish;
+
+        result = csum_linear_compute(ctx, &linear, mmaped, stat.st_size);
+        *length = stat.st_size;
+        munmap(mmaped, stat.st_size);
+    }
+
+    else if (S_ISBLK(stat.st_mode)) {
+        if (ioctl(fd, BLKGETSIZE64, &size) < 0 ||
+            ioctl(fd, BLKSSZGET, &align) < 0)
+            goto finish;
+
+        result = csum_range_compute(ctx, &sta, fd, 0, size, align, 1);
+        *length = size;
+    }
+
+    else
+        errno = EINVAL;
+
+finish:
+    close(fd);
+    return result;
+}
+
+static int
+daemon_request(struct daemon_worker *worker, FILE *in, FILE *out, char *line)
+{
+    char *fields[4], *walk = line;
+    struct csum_context *ctx;
+    const char *result, *args;
+    struct daemon_stream *stream;
+    struct csum_state sta;
+    uint64_t length = 0;
+    unsigned int count;
+
+    /* the last field is taken verbatim, paths may contain tabs */
+    for (count = 0; count < 3; ++count) {
+        fields[count] = walk;
+        walk = strchr(walk, '\t');
+        if (!walk)
+            return -EINVAL;
+        *walk++ = '\0';
+    }
+
+    fields[3] = walk;
+    args = strcmp(fields[2], DAEMON_NONE) ? fields[2] : NULL;
+
+    /* the payload of a refused DATA request is left unread, drop it */
+    ctx = daemon_context(worker, fields[1], args);
+    if (!ctx) {
+        fprintf(out, DAEMON_ERR "\t%d\n", EINVAL);
+        return strcmp(fields[0], DAEMON_DATA) ? 0 : -EIO;
+    }
+
+    errno = 0;
+    if (!strcmp(fields[0], DAEMON_FILE)) {
+        result = daemon_file(ctx, fields[3], &length);
+        if (!result) {
+            fprintf(out, DAEMON_ERR "\t%d\n", errno ? errno : EFAULT);
+            return 0;
+        }
+    }
+
+    else if (!strcmp(fields[0], DAEMON_DATA)) {
+        stream = malloc(sizeof(*stream));
+        if (!stream)
+            return -ENOMEM;
+
+        stream->in = in;
+        stream->error = 0;
+        stream->total = 0;
+
+        result = NULL;
+        if (daemon_chunk(stream, fields[3]) || stream->ended) {
+            sta.pdata = stream;
+            ctx->next_block = daemon_next_block;
+            result = csum_compute(ctx, &sta);
+        }
+
+        count = stream->error;
+        length = stream->total;
+        free(stream);
+
+        /* a short payload leaves the stream out of sync, drop it */
+        if (count || !result) {
+            fprintf(out, DAEMON_ERR "\t%d\n", count ? count : EFAULT);
+            return -EIO;
+        }
+    }
+
+    else
+        return -EINVAL;
+
+    fprintf(out, DAEMON_OK "\t%llu\t%s\n", (unsigned long long)length, result);
+    return 0;
+}
+
+static void
+daemon_drain(FILE *in)
+{
+    int ch;
+
+    do
+        ch = getc(in);
+    while (ch != EOF && ch != '\n');
+}
+
+static void
+daemon_session(struct daemon_worker *worker, int fd)
+{
+    char line[DAEMON_LINE];
+    FILE *in, *out;
+    int retval;
+
+    in = fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        return;
+    }
+
+    fd = dup(fd);
+    if (fd < 0 || !(out = fdopen(fd, "w"))) {
+        if (fd >= 0)
+            close(fd);
+        fclose(in);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        /* an over-long request is refused whole, not read as two */
+        if (!strchr(line, '\n') && !feof(in)) {
+            daemon_drain(in);
+            fprintf(out, DAEMON_ERR "\t%d\n", EMSGSIZE);
+            if (fflush(out))
+                break;
+            continue;
+        }
+
+        line[strcspn(line, "\n")] = '\0';
+        retval = daemon_request(worker, in, out, line);
+        if (retval == -EINVAL)
+            fprintf(out, DAEMON_ERR "\t%d\n", EINVAL);
+        if (fflush(out) || retval < 0)
+            break;
+    }
+
+    fclose(out);
+    fclose(in);
+}
+
+static bool
+daemon_trusted(int fd)
+{
+    struct ucred cred;
+    socklen_t size = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) < 0)
+        return false;
+
+    return !cred.uid || cred.uid == geteuid();
+}
+
+static void *
+daemon_worker(void *pdata)
+{
+    struct daemon_worker *worker = pdata;
+    struct daemon_server *server = worker->server;
+    int fd;
+
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (server->head == server->tail)
+            pthread_cond_wait(&server->ready, &server->lock);
+        fd = server->queue[server->tail++ % DAEMON_BACKLOG];
+        pthread_cond_signal(&server->space);
+        pthread_mutex_unlock(&server->lock);
+
+        daemon_session(worker, fd);
+    }
+
+    return NULL;
+}
+
+static int
+daemon_listen(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct stat stat;
+    mode_t mask;
+    int fd, retval;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -ENAMETOOLONG;
+    strcpy(addr.sun_path, path);
+
+    /* only a stale socket may be replaced, never a regular file */
+    if (!lstat(path, &stat) && S_ISSOCK(stat.st_mode))
+        unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+
+    mask = umask(0077);
+    retval = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+
+    if (retval < 0 || listen(fd, DAEMON_BACKLOG) < 0) {
+        close(fd);
+        return -errno;
+    }
+
+    return fd;
+}
+
+int
+csum_daemon_serve(const char *path, unsigned int workers)
+{
+    struct daemon_server server;
+    struct daemon_worker *pool;
+    unsigned int count;
+    int listener, fd;
+
+    if (!workers)
+        workers = 1;
+    bfdev_min_adj(workers, DAEMON_WORKERS);
+
+    listener = daemon_listen(path);
+    if (listener < 0)
+        return listener;
+
+    pool = bfdev_zalloc(NULL, sizeof(*pool) * workers);
+    if (bfdev_unlikely(!pool)) {
+        close(listener);
+        return -ENOMEM;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+    pthread_cond_init(&server.space, NULL);
+    server.head = server.tail = 0;
+
+    for (count = 0; count < workers; ++count) {
+        pool[count].server = &server;
+        if (pthread_create(&pool[count].thread, NULL, daemon_worker, &pool[count]))
+            break;
+    }
+
+    if (!count) {
+        bfdev_free(NULL, pool);
+        close(listener);
+        return -EAGAIN;
+    }
+
+    for (;;) {
+        fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return -errno;
+        }
+
+        if (!daemon_trusted(fd)) {
+            close(fd);
+            continue;
+        }
+
+        pthread_mutex_lock(&server.lock);
+        while (server.head - server.tail == DAEMON_BACKLOG)
+            pthread_cond_wait(&server.space, &server.lock);
+        server.queue[server.head++ % DAEMON_BACKLOG] = fd;
+        pthread_cond_signal(&server.ready);
+        pthread_mutex_unlock(&server.lock);
+    }
+}
+
+int
+csum_client_connect(struct csum_client *client, const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd, dupfd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -ENAMETOOLONG;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        goto failed;
+
+    dupfd = dup(fd);
+    if (dupfd < 0)
+        goto failed;
+
+    client->in = fdopen(fd, "r");
+    client->out = fdopen(dupfd, "w");
+    if (!client->in || !client->out) {
+        close(dupfd);
+        goto failed;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    return 0;
+
+failed:
+    close(fd);
+    return -errno;
+}
+
+static int
+client_stream(struct csum_client *client, const char *algo, const char *args)
+{
+    char line[DAEMON_LINE];
+    uint8_t *buffer;
+    size_t length;
+    bool first;
+
+    /* the longest length field still has to fit the request line */
+    if (snprintf(line, sizeof(line), DAEMON_DATA "\t%s\t%s\t%zu\n",
+                 algo, args, SIZE_MAX) >= (int)sizeof(line))
+        return -EMSGSIZE;
+
+    buffer = malloc(DAEMON_BUFFER);
+    if (!buffer)
+        return -ENOMEM;
+
+    for (first = true;; first = false) {
+        length = fread(buffer, 1, DAEMON_BUFFER, stdin);
+        if (ferror(stdin)) {
+            free(buffer);
+            return -EIO;
+        }
+
+        if (first)
+            fprintf(client->out, DAEMON_DATA "\t%s\t%s\t%zu\n", algo, args, length);
+        else
+            fprintf(client->out, "%zu\n", length);
+
+        if (!length)
+            break;
+
+        if (fwrite(buffer, 1, length, client->out) != length) {
+            free(buffer);
+            return -errno;
+        }
+    }
+
+    free(buffer);
+    return 0;
+}
+
+int
+csum_client_request(struct csum_client *client, const char *algo,
+                    const char *args, const char *file, uint64_t *length,
+                    char *result, size_t size)
+{
+    char line[DAEMON_LINE], path[PATH_MAX], *walk, *save;
+    int retval;
+
+    if (!args)
+        args = DAEMON_NONE;
+
+    if (!strcmp(file, "-")) {
+        /* a refused payload is cut short, the answer tells why */
+        retval = client_stream(client, algo, args);
+        if (retval && retval != -EPIPE)
+            return retval;
+    }
+
+    else {
+        /* the daemon has its own working directory */
+        if (!realpath(file, path))
+            return -errno;
+
+        if (strchr(path, '\n'))
+            return -EINVAL;
+
+        /* the daemon reads requests a line at a time */
+        if (snprintf(line, sizeof(line), DAEMON_FILE "\t%s\t%s\t%s\n",
+                     algo, args, path) >= (int)sizeof(line))
+            return -EMSGSIZE;
+
+        fputs(line, client->out);
+    }
+
+    if (fflush(client->out) && errno != EPIPE)
+        return -errno;
+
+    if (!fgets(line, sizeof(line), client->in))
+        return -ECONNRESET;
+    line[strcspn(line, "\n")] = '\0';
+
+    walk = strtok_r(line, "\t", &save);
+    if (!walk)
+        return -EPROTO;
+
+    if (!strcmp(walk, DAEMON_ERR)) {
+        walk = strtok_r(NULL, "\t", &save);
+        return walk ? -atoi(walk) : -EPROTO;
+    }
+
+    if (strcmp(walk, DAEMON_OK))
+        return -EPROTO;
+
+    walk = strtok_r(NULL, "\t", &save);
+    if (!walk)
+        return -EPROTO;
+    *length = strtoull(walk, NULL, 0);
+
+    walk = strtok_r(NULL, "\t", &save);
+    if (!walk || strlen(walk) >= size)
+        return -EPROTO;
+    strcpy(result, walk);
+
+    return 0;
+}
+
+void
+csum_client_close(struct csum_client *client)
+{
+    fclose(client->out);
+    fclose(client->in);
+}
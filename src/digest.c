@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <digest.h>
+#include <stdio.h>
+#include <string.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+static void
+digest_init(const struct digest_model *model, struct digest_state *state)
+{
+    memcpy(state->hash, model->init, model->words * sizeof(*state->hash));
+    state->buffered = 0;
+    state->total = 0;
+}
+
+void
+digest_update(const struct digest_impl *impl, struct digest_state *state,
+              const void *data, size_t length)
+{
+    const uint8_t *buff = data;
+    size_t blocks, fill;
+
+    state->total += length;
+
+    if (state->buffered) {
+        fill = bfdev_min(length, DIGEST_BLOCK - state->buffered);
+        memcpy(state->buffer + state->buffered, buff, fill);
+        state->buffered += fill;
+        buff += fill;
+        length -= fill;
+
+        if (state->buffered < DIGEST_BLOCK)
+            return;
+
+        impl->compress(state->hash, state->buffer, 1);
+        state->buffered = 0;
+    }
+
+    blocks = length / DIGEST_BLOCK;
+    if (blocks) {
+        impl->compress(state->hash, buff, blocks);
+        buff += blocks * DIGEST_BLOCK;
+        length -= blocks * DIGEST_BLOCK;
+    }
+
+    memcpy(state->buffer, buff, length);
+    state->buffered = length;
+}
+
+/*
+ * Pads a copy of the state, so the running hash can keep growing
+ * after a result was handed out.
+ */
+const char *
+digest_final(const struct digest_impl *impl, const struct digest_state *state,
+             char *result)
+{
+    uint8_t block[DIGEST_BLOCK * 2];
+    uint32_t hash[DIGEST_WORDS];
+    uint64_t bits = state->total * 8;
+    size_t length, count;
+
+    memcpy(hash, state->hash, sizeof(hash));
+    memcpy(block, state->buffer, state->buffered);
+    length = state->buffered;
+
+    block[length++] = 0x80;
+    while (length % DIGEST_BLOCK != DIGEST_BLOCK - 8)
+        block[length++] = 0;
+
+    for (count = 0; count < 8; ++count)
+        block[length++] = bits >> (56 - count * 8);
+
+    impl->compress(hash, block, length / DIGEST_BLOCK);
+    for (count = 0; count < impl->model->words; ++count)
+        sprintf(result + count * 8, "%08x", hash[count]);
+
+    return result;
+}
+
+struct csum_context *
+digest_prepare(const struct digest_model *model)
+{
+    struct digest_context *digest;
+
+    digest = bfdev_malloc(NULL, sizeof(*digest));
+    if (bfdev_unlikely(!digest))
+        return NULL;
+
+    digest_init(model, &digest->state);
+    return &digest->csum;
+}
+
+void
+digest_destroy(struct csum_context *ctx)
+{
+    struct digest_context *digest = csum_to_digest(ctx);
+    bfdev_free(NULL, digest);
+}
+
+void
+digest_reset(struct csum_context *ctx)
+{
+    struct digest_context *digest = csum_to_digest(ctx);
+    struct digest_impl *impl = algo_to_digest_impl(ctx->algo);
+    digest_init(impl->model, &digest->state);
+}
+
+const char *
+digest_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct digest_context *digest = csum_to_digest(ctx);
+    struct digest_impl *impl = algo_to_digest_impl(ctx->algo);
+    uintptr_t consumed = sta->offset;
+    size_t length;
+    const void *buff;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        digest_update(impl, &digest->state, buff, length);
+        consumed += length;
+    }
+
+    sta->offset = consumed;
+    return digest_final(impl, &digest->state, digest->result);
+}
+
+struct digest_lane {
+    struct csum_context *ctx;
+    struct csum_state *sta;
+    struct digest_state *state;
+    const uint8_t *buff;
+    size_t length;
+    bool live;
+};
+
+static bool
+digest_lane_next(struct digest_lane *lane)
+{
+    const void *buff;
+
+    lane->length = lane->ctx->next_block(lane->ctx, lane->sta,
+                                         lane->sta->offset, &buff);
+    lane->buff = buff;
+    lane->live = !!lane->length;
+
+    return lane->live;
+}
+
+/*
+ * Feeds up to DIGEST_LANES contexts through the multi buffer kernel
+ * together. Partial blocks are absorbed with the single message path
+ * of the same implementation, only whole blocks go side by side.
+ */
+static void
+digest_many_lanes(struct digest_impl *impl, struct digest_lane *lanes,
+                  unsigned int count)
+{
+    static const uint8_t idle[DIGEST_BLOCK];
+    uint32_t spare[DIGEST_WORDS];
+    uint32_t *hashes[DIGEST_LANES];
+    const uint8_t *data[DIGEST_LANES];
+    size_t blocks[DIGEST_LANES];
+    struct digest_lane *lane;
+    struct digest_state *state;
+    unsigned int index, active;
+    size_t fill;
+
+    for (index = 0; index < DIGEST_LANES; ++index) {
+        hashes[index] = spare;
+        data[index] = idle;
+        blocks[index] = 0;
+    }
+
+    for (index = active = 0; index < count; ++index)
+        active += digest_lane_next(&lanes[index]);
+
+    while (active) {
+        for (index = 0; index < count; ++index) {
+            lane = &lanes[index];
+            state = lane->state;
+            blocks[index] = 0;
+
+            if (!lane->live)
+                continue;
+
+            state->total += lane->length;
+            lane->sta->offset += lane->length;
+
+            if (state->buffered) {
+                fill = bfdev_min(lane->length, DIGEST_BLOCK - state->buffered);
+                memcpy(state->buffer + state->buffered, lane->buff, fill);
+                state->buffered += fill;
+                lane->buff += fill;
+                lane->length -= fill;
+
+                if (state->buffered < DIGEST_BLOCK)
+                    continue;
+
+                impl->compress(state->hash, state->buffer, 1);
+                state->buffered = 0;
+            }
+
+            hashes[index] = state->hash;
+            data[index] = lane->buff;
+            blocks[index] = lane->length / DIGEST_BLOCK;
+        }
+
+        impl->lanes(hashes, data, blocks);
+
+        for (index = active = 0; index < count; ++index) {
+            lane = &lanes[index];
+            state = lane->state;
+
+            if (!lane->live)
+                continue;
+
+            fill = lane->length - blocks[index] * DIGEST_BLOCK;
+            if (fill) {
+                memcpy(state->buffer + state->buffered,
+                       lane->buff + blocks[index] * DIGEST_BLOCK, fill);
+                state->buffered += fill;
+            }
+
+            active += digest_lane_next(lane);
+        }
+    }
+}
+
+void
+digest_many(struct csum_context **ctxs, struct csum_state **stas,
+            const char **results, unsigned int count)
+{
+    struct digest_impl *impl = algo_to_digest_impl(ctxs[0]->algo);
+    struct digest_lane lanes[DIGEST_LANES];
+    struct digest_context *digest;
+    unsigned int index, base, lane;
+
+    for (base = 0; base < count; base += DIGEST_LANES) {
+        lane = bfdev_min(count - base, DIGEST_LANES);
+
+        for (index = 0; index < lane; ++index) {
+            digest = csum_to_digest(ctxs[base + index]);
+            lanes[index].ctx = ctxs[base + index];
+            lanes[index].sta = stas[base + index];
+            lanes[index].state = &digest->state;
+        }
+
+        digest_many_lanes(impl, lanes, lane);
+
+        for (index = 0; index < lane; ++index) {
+            digest = csum_to_digest(ctxs[base + index]);
+            results[base + index] = digest_final(impl, &digest->state, digest->result);
+        }
+    }
+}
+
+/*
+ * A kernel is only offered once it matches the generic compression,
+ * for single messages and for lanes of uneven length.
+ */
+static bool
+digest_verify(const struct digest_impl *impl)
+{
+    const struct digest_model *model = impl->model;
+    uint32_t expect[DIGEST_LANES][DIGEST_WORDS];
+    uint32_t hash[DIGEST_LANES][DIGEST_WORDS];
+    uint8_t data[DIGEST_BLOCK * (DIGEST_LANES + 4)];
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    const uint8_t *inputs[DIGEST_LANES];
+    uint32_t *hashes[DIGEST_LANES];
+    size_t blocks[DIGEST_LANES];
+    unsigned int count;
+
+    for (count = 0; count < sizeof(data); ++count) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[count] = seed >> 56;
+    }
+
+    memset(expect, 0, sizeof(expect));
+    memset(hash, 0, sizeof(hash));
+
+    for (count = 0; count < DIGEST_LANES; ++count) {
+        memcpy(expect[count], model->init, model->words * sizeof(**expect));
+        memcpy(hash[count], model->init, model->words * sizeof(**hash));
+        inputs[count] = data + count * 13;
+        hashes[count] = hash[count];
+        blocks[count] = (count * 5) % 7;
+
+        model->reference(expect[count], inputs[count], blocks[count]);
+    }
+
+    if (impl->compress != model->reference) {
+        for (count = 0; count < DIGEST_LANES; ++count) {
+            impl->compress(hash[count], inputs[count], blocks[count]);
+            if (memcmp(hash[count], expect[count], model->words * sizeof(**hash)))
+                return false;
+            memcpy(hash[count], model->init, model->words * sizeof(**hash));
+        }
+    }
+
+    if (impl->lanes) {
+        impl->lanes(hashes, inputs, blocks);
+        if (memcmp(hash, expect, sizeof(hash)))
+            return false;
+    }
+
+    return true;
+}
+
+void
+digest_impl_unregister(struct digest_impl *impls, unsigned int count)
+{
+    unsigned int index;
+
+    for (index = 0; index < count; ++index) {
+        if (!impls[index].registered)
+            continue;
+
+        csum_unregister(&impls[index].algo);
+        impls[index].registered = false;
+    }
+}
+
+int
+digest_impl_register(struct digest_impl *impls, unsigned int count,
+                     const struct csum_algo *template)
+{
+    struct digest_impl *impl;
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < count; ++index) {
+        impl = &impls[index];
+        impl->algo.name = template->name;
+        impl->algo.desc = template->desc;
+        impl->algo.coreutils = template->coreutils;
+        impl->algo.prepare = template->prepare;
+        impl->algo.destroy = template->destroy;
+        impl->algo.reset = template->reset;
+        impl->algo.compute = template->compute;
+        impl->algo.many = impl->lanes ? template->many : NULL;
+
+        if (index && !(impl->algo.features & ~csum_cpu_features()) &&
+            !digest_verify(impl))
+            continue;
+
+        retval = csum_register(&impl->algo);
+        if (retval) {
+            digest_impl_unregister(impls, index);
+            return retval;
+        }
+
+        impl->registered = true;
+    }
+
+    return 0;
+}
@@ -0,0 +1,464 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define DUPS_BLOCK 0x1000
+#define DUPS_COMPARE 0x10000
+#define DUPS_FDS 64
+#define DUPS_JOBS 64
+
+/*
+ * Duplicates are narrowed in stages that each cost more I/O than the
+ * last: the size from the directory walk, a checksum of the first and
+ * last block, the full checksum, and finally a byte compare against
+ * the first file of the group. Only files that still share a group with
+ * another file move on to the next stage.
+ */
+struct dups_entry {
+    char *path;
+    uint64_t size;
+    char *digest;
+    unsigned int class;
+    bool whole;
+};
+
+struct dups_worker;
+
+struct dups_work {
+    struct csum_context *ctx;
+    struct dups_entry *entries;
+    unsigned int count;
+    unsigned int limit;
+    unsigned int index;
+    void (*handle)(struct dups_worker *worker, struct dups_entry *entry);
+};
+
+struct dups_worker {
+    struct dups_work *work;
+    struct csum_context *ctx;
+    pthread_t thread;
+};
+
+static struct dups_work *dups_walking;
+
+static int
+dups_add(struct dups_work *work, const char *path, uint64_t size)
+{
+    struct dups_entry *block;
+
+    if (work->count == work->limit) {
+        work->limit = work->limit ? work->limit * 2 : 256;
+        block = bfdev_realloc(NULL, work->entries, sizeof(*block) * work->limit);
+        if (bfdev_unlikely(!block))
+            return -ENOMEM;
+        work->entries = block;
+    }
+
+    block = &work->entries[work->count];
+    block->path = strdup(path);
+    if (bfdev_unlikely(!block->path))
+        return -ENOMEM;
+
+    block->size = size;
+    block->digest = NULL;
+    block->class = 0;
+    block->whole = false;
+    work->count++;
+
+    return 0;
+}
+
+static int
+dups_walk(const char *path, const struct stat *stat, int flag, struct FTW *ftw)
+{
+    if (flag != FTW_F || !S_ISREG(stat->st_mode))
+        return 0;
+
+    return dups_add(dups_walking, path, stat->st_size);
+}
+
+static int
+dups_collect(struct dups_work *work, const char *path)
+{
+    struct stat stat;
+    int retval;
+
+    if (lstat(path, &stat) < 0)
+        return -errno;
+
+    if (S_ISREG(stat.st_mode))
+        return dups_add(work, path, stat.st_size);
+
+    if (!S_ISDIR(stat.st_mode))
+        return 0;
+
+    /* symlinks are not followed, a linked tree would be counted twice */
+    dups_walking = work;
+    retval = nftw(path, dups_walk, DUPS_FDS, FTW_PHYS);
+    dups_walking = NULL;
+
+    if (retval < 0)
+        return -errno;
+
+    return retval;
+}
+
+static struct csum_context *
+dups_context(struct dups_worker *worker)
+{
+    /* contexts keep their running value, start every file afresh */
+    if (worker->ctx && !csum_reset(worker->ctx))
+        return worker->ctx;
+
+    if (worker->ctx)
+        csum_destroy(worker->ctx);
+
+    worker->ctx = csum_clone(worker->work->ctx);
+    return worker->ctx;
+}
+
+static void
+dups_partial(struct dups_worker *worker, struct dups_entry *entry)
+{
+    uint8_t buffer[DUPS_BLOCK];
+    struct csum_context *ctx;
+    struct csum_stream stream;
+    const char *result;
+    uint64_t offset;
+    ssize_t length;
+    int fd;
+
+    ctx = dups_context(worker);
+    if (!ctx)
+        return;
+
+    fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    csum_stream_init(ctx, &stream);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    length = pread(fd, buffer, bfdev_min(entry->size, (uint64_t)DUPS_BLOCK), 0);
+    if (length < 0)
+        goto finish;
+    csum_stream_update(ctx, &stream, buffer, length);
+
+    if (entry->size > DUPS_BLOCK) {
+        offset = bfdev_max(entry->size - DUPS_BLOCK, (uint64_t)DUPS_BLOCK);
+        length = pread(fd, buffer, entry->size - offset, offset);
+        if (length < 0)
+            goto finish;
+        csum_stream_update(ctx, &stream, buffer, length);
+    }
+
+    result = csum_stream_final(ctx, &stream);
+    if (result) {
+        entry->digest = strdup(result);
+        entry->whole = entry->size <= DUPS_BLOCK * 2;
+    }
+
+finish:
+    close(fd);
+}
+
+static void
+dups_full(struct dups_worker *worker, struct dups_entry *entry)
+{
+    struct csum_context *ctx;
+    struct csum_linear linear;
+    const char *result;
+    void *mmaped;
+    int fd;
+
+    /* the partial checksum already covered every byte */
+    if (entry->whole)
+        return;
+
+    free(entry->digest);
+    entry->digest = NULL;
+
+    ctx = dups_context(worker);
+    if (!ctx)
+        return;
+
+    fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    mmaped = mmap(NULL, entry->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mmaped == MAP_FAILED)
+        return;
+
+    madvise(mmaped, entry->size, MADV_SEQUENTIAL);
+    result = csum_linear_compute(ctx, &linear, mmaped, entry->size);
+    if (result)
+        entry->digest = strdup(result);
+
+    munmap(mmaped, entry->size);
+}
+
+static bool
+dups_identical(const struct dups_entry *a, const struct dups_entry *b)
+{
+    uint8_t buffa[DUPS_COMPARE], buffb[DUPS_COMPARE];
+    ssize_t lengtha, lengthb;
+    uint64_t offset;
+    bool retval = false;
+    int fda, fdb;
+
+    fda = open(a->path, O_RDONLY | O_CLOEXEC);
+    if (fda < 0)
+        return false;
+
+    fdb = open(b->path, O_RDONLY | O_CLOEXEC);
+    if (fdb < 0)
+        goto finish;
+
+    posix_fadvise(fda, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fdb, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (offset = 0; offset < a->size; offset += lengtha) {
+        lengtha = pread(fda, buffa, sizeof(buffa), offset);
+        lengthb = pread(fdb, buffb, sizeof(buffb), offset);
+        if (lengtha <= 0 || lengtha != lengthb ||
+            memcmp(buffa, buffb, lengtha))
+            goto failed;
+    }
+
+    retval = true;
+
+failed:
+    close(fdb);
+finish:
+    close(fda);
+    return retval;
+}
+
+static inline bool
+dups_candidate(const struct dups_entry *a, const struct dups_entry *b)
+{
+    return a->size == b->size && a->digest && b->digest &&
+           !strcmp(a->digest, b->digest);
+}
+
+/*
+ * Equal digests are only candidates, a 32 bit checksum collides within
+ * a few ten thousand files of one size. The first file of every group
+ * splits it into classes of files with the very same bytes.
+ */
+static void
+dups_verify(struct dups_worker *worker, struct dups_entry *entry)
+{
+    struct dups_work *work = worker->work;
+    unsigned int index, end, walk;
+
+    index = entry - work->entries;
+    if (index && dups_candidate(&work->entries[index - 1], entry))
+        return;
+
+    for (end = index + 1; end < work->count; ++end) {
+        if (!dups_candidate(entry, &work->entries[end]))
+            break;
+
+        for (walk = index; walk < end; ++walk) {
+            if (work->entries[walk].class == walk - index &&
+                dups_identical(&work->entries[walk], &work->entries[end]))
+                break;
+        }
+
+        /* a class is named after the offset of its first file */
+        work->entries[end].class = walk - index;
+    }
+}
+
+static void *
+dups_worker(void *pdata)
+{
+    struct dups_worker *worker = pdata;
+    struct dups_work *work = worker->work;
+    unsigned int index;
+
+    for (;;) {
+        index = __atomic_fetch_add(&work->index, 1, __ATOMIC_RELAXED);
+        if (index >= work->count)
+            break;
+
+        work->handle(worker, &work->entries[index]);
+    }
+
+    return NULL;
+}
+
+static int
+dups_parallel(struct dups_work *work, unsigned int jobs,
+              void (*handle)(struct dups_worker *worker, struct dups_entry *entry))
+{
+    struct dups_worker *workers;
+    unsigned int index;
+
+    bfdev_min_adj(jobs, work->count);
+    if (!jobs)
+        return 0;
+
+    workers = bfdev_zalloc(NULL, sizeof(*workers) * jobs);
+    if (bfdev_unlikely(!workers))
+        return -ENOMEM;
+
+    work->index = 0;
+    work->handle = handle;
+
+    for (index = 0; index < jobs; ++index)
+        workers[index].work = work;
+
+    for (index = 1; index < jobs; ++index) {
+        if (pthread_create(&workers[index].thread, NULL,
+                           dups_worker, &workers[index]))
+            break;
+    }
+
+    dups_worker(&workers[0]);
+    while (--index)
+        pthread_join(workers[index].thread, NULL);
+
+    for (index = 0; index < jobs; ++index) {
+        if (workers[index].ctx)
+            csum_destroy(workers[index].ctx);
+    }
+
+    bfdev_free(NULL, workers);
+    return 0;
+}
+
+static int
+dups_compare(const void *a, const void *b)
+{
+    const struct dups_entry *ea = a, *eb = b;
+    int retval;
+
+    if (ea->size != eb->size)
+        return ea->size < eb->size ? -1 : 1;
+
+    if (!ea->digest || !eb->digest)
+        return !eb->digest - !ea->digest;
+
+    retval = strcmp(ea->digest, eb->digest);
+    if (retval)
+        return retval;
+
+    return (ea->class > eb->class) - (ea->class < eb->class);
+}
+
+static inline bool
+dups_same(const struct dups_entry *a, const struct dups_entry *b)
+{
+    return a->size == b->size && (!a->digest == !b->digest) &&
+           (!a->digest || !strcmp(a->digest, b->digest)) &&
+           a->class == b->class;
+}
+
+static void
+dups_release(struct dups_entry *entry)
+{
+    free(entry->path);
+    free(entry->digest);
+}
+
+/*
+ * Sort by size and digest, then drop every entry that no longer shares
+ * its group with another one. Entries whose last stage failed carry no
+ * digest and are dropped as well, once digests are in use.
+ */
+static void
+dups_filter(struct dups_work *work, bool digest)
+{
+    unsigned int index, end, keep = 0;
+
+    qsort(work->entries, work->count, sizeof(*work->entries), dups_compare);
+
+    for (index = 0; index < work->count; index = end) {
+        for (end = index + 1; end < work->count; ++end) {
+            if (!dups_same(&work->entries[index], &work->entries[end]))
+                break;
+        }
+
+        if (end - index < 2 || (digest && !work->entries[index].digest)) {
+            while (index < end)
+                dups_release(&work->entries[index++]);
+            continue;
+        }
+
+        while (index < end)
+            work->entries[keep++] = work->entries[index++];
+    }
+
+    work->count = keep;
+}
+
+int
+csum_dups(FILE *stream, const char *name, const char *args,
+          const char *const *paths, unsigned int count, unsigned int jobs)
+{
+    struct dups_work work = { };
+    unsigned int index;
+    int retval = 0;
+
+    work.ctx = csum_prepare(name, args, 0);
+    if (!work.ctx)
+        return -ENOENT;
+
+    if (!jobs)
+        jobs = 1;
+    bfdev_min_adj(jobs, DUPS_JOBS);
+
+    for (index = 0; index < count; ++index) {
+        if ((retval = dups_collect(&work, paths[index])) < 0)
+            goto finish;
+    }
+
+    dups_filter(&work, false);
+    if ((retval = dups_parallel(&work, jobs, dups_partial)) < 0)
+        goto finish;
+
+    dups_filter(&work, true);
+    if ((retval = dups_parallel(&work, jobs, dups_full)) < 0)
+        goto finish;
+
+    dups_filter(&work, true);
+    if ((retval = dups_parallel(&work, jobs, dups_verify)) < 0)
+        goto finish;
+
+    dups_filter(&work, true);
+    for (index = 0; index < work.count; ++index) {
+        struct dups_entry *entry = &work.entries[index];
+
+        if (index && !dups_same(&work.entries[index - 1], entry))
+            fprintf(stream, "\n");
+        fprintf(stream, "%s %llu %s\n", entry->digest,
+                (unsigned long long)entry->size, entry->path);
+    }
+
+finish:
+    for (index = 0; index < work.count; ++index)
+        dups_release(&work.entries[index]);
+
+    bfdev_free(NULL, work.entries);
+    csum_destroy(work.ctx);
+
+    return retval;
+}
@@ -0,0 +1,373 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+#include <bfdev/bits.h>
+#include <bfdev/minmax.h>
+
+#define EXTENT_JOBS 64
+
+/*
+ * Ranges are cut at every range boundary into elementary segments.
+ * Each covered segment is hashed once and the segments become the
+ * leaves of a tree whose nodes combine their two children. A range
+ * is then assembled from at most two nodes per tree level, so bytes
+ * shared by overlapping ranges are only read and hashed a single time
+ * and no range pays for every segment it spans.
+ */
+struct extent_segment {
+    struct csum_context *ctx;
+    struct csum_state sta;
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct extent_work {
+    struct csum_context *ctx;
+    struct csum_extent *extents;
+    struct extent_segment *segments;
+    uint64_t *bounds;
+    unsigned int nbounds;
+    unsigned int leaves;
+    unsigned int base;
+    unsigned int index;
+    const uint8_t *data;
+    size_t align;
+    int error;
+    int fd;
+    void (*handle)(struct extent_work *work, unsigned int index);
+};
+
+struct extent_worker {
+    struct extent_work *work;
+    unsigned int count;
+    pthread_t thread;
+};
+
+static size_t
+extent_empty_block(struct csum_context *ctx, struct csum_state *sta,
+                   uintptr_t consumed, const void **dest)
+{
+    return 0;
+}
+
+static const char *
+extent_hash(struct extent_work *work, struct csum_context *ctx,
+            struct csum_state *sta, uint64_t offset, uint64_t length)
+{
+    struct csum_linear linear;
+    const char *result;
+
+    if (!work->data)
+        return csum_range_compute(ctx, sta, work->fd, offset,
+                                  length, work->align, 1);
+
+    result = csum_linear_compute(ctx, &linear, work->data + offset, length);
+    *sta = linear.sta;
+
+    return result;
+}
+
+static void
+extent_error(struct extent_work *work, int error)
+{
+    int expect = 0;
+    __atomic_compare_exchange_n(&work->error, &expect, error, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void
+extent_segment(struct extent_work *work, unsigned int index)
+{
+    struct extent_segment *segment = &work->segments[work->base + index];
+
+    if (!segment->length)
+        return;
+
+    segment->ctx = csum_clone(work->ctx);
+    if (!segment->ctx) {
+        extent_error(work, ENOMEM);
+        return;
+    }
+
+    if (!extent_hash(work, segment->ctx, &segment->sta,
+                     segment->offset, segment->length))
+        extent_error(work, errno ? errno : EFAULT);
+}
+
+static void
+extent_node(struct extent_work *work, unsigned int index)
+{
+    struct extent_segment *node, *left, *right;
+
+    node = &work->segments[work->base + index];
+    left = &work->segments[(work->base + index) * 2];
+    right = left + 1;
+
+    /* only nodes over fully covered segments are ever asked for */
+    if (!left->ctx || !right->ctx)
+        return;
+
+    node->ctx = csum_clone(work->ctx);
+    if (!node->ctx) {
+        extent_error(work, ENOMEM);
+        return;
+    }
+
+    node->sta.offset = 0;
+    csum_combine(node->ctx, &node->sta, left->ctx, &left->sta);
+    csum_combine(node->ctx, &node->sta, right->ctx, &right->sta);
+}
+
+static unsigned int
+extent_bound(struct extent_work *work, uint64_t value)
+{
+    unsigned int low = 0, high = work->nbounds;
+
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (work->bounds[middle] < value)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+static void
+extent_assemble(struct extent_work *work, unsigned int index)
+{
+    struct csum_extent *extent = &work->extents[index];
+    unsigned int rights[BFDEV_BITS_PER_U64];
+    unsigned int left, right, count = 0;
+    struct csum_context *ctx;
+    struct csum_state sta;
+
+    extent->ctx = ctx = csum_clone(work->ctx);
+    if (!ctx) {
+        extent_error(work, ENOMEM);
+        return;
+    }
+
+    if (!work->segments) {
+        extent->result = extent_hash(work, ctx, &sta,
+                                     extent->offset, extent->length);
+        if (!extent->result)
+            extent_error(work, errno ? errno : EFAULT);
+        return;
+    }
+
+    sta.offset = 0;
+    left = work->leaves + extent_bound(work, extent->offset);
+    right = work->leaves + extent_bound(work, extent->offset + extent->length);
+
+    /* left side nodes come in order, right side ones in reverse */
+    for (; left < right; left >>= 1, right >>= 1) {
+        if (left & 1) {
+            struct extent_segment *node = &work->segments[left++];
+            csum_combine(ctx, &sta, node->ctx, &node->sta);
+        }
+        if (right & 1)
+            rights[count++] = --right;
+    }
+
+    while (count--) {
+        struct extent_segment *node = &work->segments[rights[count]];
+        csum_combine(ctx, &sta, node->ctx, &node->sta);
+    }
+
+    ctx->next_block = extent_empty_block;
+    extent->result = csum_next(ctx, &sta);
+}
+
+static void *
+extent_worker(void *pdata)
+{
+    struct extent_worker *worker = pdata;
+    struct extent_work *work = worker->work;
+    unsigned int index;
+
+    for (;;) {
+        index = __atomic_fetch_add(&work->index, 1, __ATOMIC_RELAXED);
+        if (index >= worker->count || __atomic_load_n(&work->error, __ATOMIC_RELAXED))
+            break;
+        work->handle(work, index);
+    }
+
+    return NULL;
+}
+
+static int
+extent_parallel(struct extent_work *work, unsigned int count, unsigned int jobs,
+                void (*handle)(struct extent_work *work, unsigned int index))
+{
+    struct extent_worker *workers;
+    unsigned int index;
+
+    bfdev_min_adj(jobs, count);
+    if (!jobs)
+        return -work->error;
+
+    workers = bfdev_zalloc(NULL, sizeof(*workers) * jobs);
+    if (bfdev_unlikely(!workers))
+        return -ENOMEM;
+
+    work->index = 0;
+    work->handle = handle;
+
+    for (index = 0; index < jobs; ++index) {
+        workers[index].work = work;
+        workers[index].count = count;
+    }
+
+    for (index = 1; index < jobs; ++index) {
+        if (pthread_create(&workers[index].thread, NULL,
+                           extent_worker, &workers[index]))
+            break;
+    }
+
+    extent_worker(&workers[0]);
+    while (--index)
+        pthread_join(workers[index].thread, NULL);
+
+    bfdev_free(NULL, workers);
+    return -work->error;
+}
+
+static int
+extent_compare(const void *a, const void *b)
+{
+    const uint64_t *va = a, *vb = b;
+    return *va < *vb ? -1 : *va > *vb;
+}
+
+static int
+extent_split(struct extent_work *work, unsigned int count)
+{
+    struct csum_extent *extents = work->extents;
+    unsigned int index, unique, lo, hi;
+    int *cover, depth;
+
+    work->bounds = bfdev_malloc(NULL, sizeof(*work->bounds) * count * 2);
+    if (bfdev_unlikely(!work->bounds))
+        return -ENOMEM;
+
+    for (index = 0; index < count; ++index) {
+        work->bounds[index * 2] = extents[index].offset;
+        work->bounds[index * 2 + 1] = extents[index].offset + extents[index].length;
+    }
+
+    qsort(work->bounds, count * 2, sizeof(*work->bounds), extent_compare);
+    for (index = unique = 1; index < count * 2; ++index) {
+        if (work->bounds[index] != work->bounds[unique - 1])
+            work->bounds[unique++] = work->bounds[index];
+    }
+    work->nbounds = unique;
+
+    for (work->leaves = 1; work->leaves < unique - 1; work->leaves <<= 1)
+        ;
+
+    work->segments = bfdev_zalloc(NULL, sizeof(*work->segments) * work->leaves * 2);
+    cover = bfdev_zalloc(NULL, sizeof(*cover) * (unique + 1));
+    if (bfdev_unlikely(!work->segments || !cover)) {
+        bfdev_free(NULL, cover);
+        return -ENOMEM;
+    }
+
+    for (index = 0; index < count; ++index) {
+        lo = extent_bound(work, extents[index].offset);
+        hi = extent_bound(work, extents[index].offset + extents[index].length);
+        cover[lo]++;
+        cover[hi]--;
+    }
+
+    /* gaps no range asks for are never read */
+    for (index = depth = 0; index + 1 < unique; ++index) {
+        depth += cover[index];
+        if (!depth)
+            continue;
+
+        work->segments[work->leaves + index].offset = work->bounds[index];
+        work->segments[work->leaves + index].length =
+            work->bounds[index + 1] - work->bounds[index];
+    }
+
+    bfdev_free(NULL, cover);
+    return 0;
+}
+
+int
+csum_extents_compute(struct csum_context *ctx, int fd, const void *data,
+                     struct csum_extent *extents, unsigned int count,
+                     size_t align, unsigned int jobs)
+{
+    struct extent_work work = { };
+    unsigned int index;
+    int retval;
+
+    if (!jobs)
+        jobs = 1;
+    bfdev_min_adj(jobs, EXTENT_JOBS);
+
+    work.ctx = ctx;
+    work.extents = extents;
+    work.data = data;
+    work.align = align ? align : 1;
+    work.fd = fd;
+
+    for (index = 0; index < count; ++index) {
+        extents[index].ctx = NULL;
+        extents[index].result = NULL;
+    }
+
+    if (ctx->algo->combine && count) {
+        retval = extent_split(&work, count);
+        if (retval)
+            goto finish;
+
+        work.base = work.leaves;
+        retval = extent_parallel(&work, work.nbounds - 1, jobs, extent_segment);
+
+        while (!retval && (work.base >>= 1))
+            retval = extent_parallel(&work, work.base, jobs, extent_node);
+        if (retval)
+            goto finish;
+    }
+
+    retval = extent_parallel(&work, count, jobs, extent_assemble);
+
+finish:
+    if (work.segments) {
+        for (index = 1; index < work.leaves * 2; ++index) {
+            if (work.segments[index].ctx)
+                csum_destroy(work.segments[index].ctx);
+        }
+    }
+
+    bfdev_free(NULL, work.segments);
+    bfdev_free(NULL, work.bounds);
+
+    if (retval)
+        csum_extents_release(extents, count);
+
+    return retval;
+}
+
+void
+csum_extents_release(struct csum_extent *extents, unsigned int count)
+{
+    unsigned int index;
+
+    for (index = 0; index < count; ++index) {
+        if (extents[index].ctx)
+            csum_destroy(extents[index].ctx);
+        extents[index].ctx = NULL;
+        extents[index].result = NULL;
+    }
+}
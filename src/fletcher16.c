@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <model.h>
+#include <sums.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <bfdev/allocator.h>
+
+#define FLETCHER16_MOD 255
+
+struct fletcher16_context {
+    struct csum_context csum;
+    char result[32];
+    uint16_t init;
+    uint16_t sum;
+};
+
+#define csum_to_fletcher16(ptr) \
+    bfdev_container_of(ptr, struct fletcher16_context, csum)
+
+static __always_inline uint64_t
+fletcher16_sums(sums_kernel kernel, uint64_t sum, const void *data, size_t length)
+{
+    uint64_t sum1 = (sum & 0xff) % FLETCHER16_MOD;
+    uint64_t sum2 = (sum >> 8 & 0xff) % FLETCHER16_MOD;
+
+    sums_update(kernel, 1, FLETCHER16_MOD, &sum1, &sum2, data, length);
+    return sum2 << 8 | sum1;
+}
+
+static uint64_t
+fletcher16_update(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher16_sums(sums_generic8, sum, data, length);
+}
+
+static uint64_t
+fletcher16_ssse3(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher16_sums(sums_ssse3_8, sum, data, length);
+}
+
+static uint64_t
+fletcher16_avx2(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher16_sums(sums_avx2_8, sum, data, length);
+}
+
+static const char *
+fletcher16_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct fletcher16_context *fletcher16 = csum_to_fletcher16(ctx);
+    uintptr_t consumed = sta->offset;
+    size_t length;
+    const void *buff;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        fletcher16->sum = crc_impl_update(ctx, fletcher16->sum, buff, length);
+        consumed += length;
+    }
+
+    sprintf(fletcher16->result, "%#06x", fletcher16->sum);
+    sta->offset = consumed;
+
+    return fletcher16->result;
+}
+
+static struct csum_context *
+fletcher16_prepare(const char *args, unsigned long flags)
+{
+    struct fletcher16_context *fletcher16;
+    uint16_t init = 0;
+
+    fletcher16 = bfdev_zalloc(NULL, sizeof(*fletcher16));
+    if (bfdev_unlikely(!fletcher16))
+        return NULL;
+
+    if (args)
+        init = (uint16_t)strtoul(args, NULL, 0);
+
+    fletcher16->sum = fletcher16_update(init, NULL, 0);
+    fletcher16->init = fletcher16->sum;
+
+    return &fletcher16->csum;
+}
+
+static void
+fletcher16_destroy(struct csum_context *ctx)
+{
+    struct fletcher16_context *fletcher16 = csum_to_fletcher16(ctx);
+    bfdev_free(NULL, fletcher16);
+}
+
+static void
+fletcher16_reset(struct csum_context *ctx)
+{
+    struct fletcher16_context *fletcher16 = csum_to_fletcher16(ctx);
+    fletcher16->sum = fletcher16->init;
+}
+
+static void
+fletcher16_combine(struct csum_context *ctx, struct csum_context *next, uint64_t length)
+{
+    struct fletcher16_context *fletcher16 = csum_to_fletcher16(ctx);
+    struct fletcher16_context *other = csum_to_fletcher16(next);
+    uint64_t sum1, sum2, init1, init2, count;
+
+    count = length % FLETCHER16_MOD;
+    init1 = fletcher16->init & 0xff;
+    init2 = fletcher16->init >> 8;
+    sum1 = fletcher16->sum & 0xff;
+    sum2 = fletcher16->sum >> 8;
+
+    sum2 = (sum2 + count * sum1 + (other->sum >> 8) + FLETCHER16_MOD * 2 -
+            init2 - count * init1 % FLETCHER16_MOD) % FLETCHER16_MOD;
+    sum1 = (sum1 + (other->sum & 0xff) + FLETCHER16_MOD - init1) % FLETCHER16_MOD;
+
+    fletcher16->sum = sum2 << 8 | sum1;
+}
+
+static void
+fletcher16_zeros(struct csum_context *ctx, uint64_t length)
+{
+    struct fletcher16_context *fletcher16 = csum_to_fletcher16(ctx);
+    uint64_t sum1 = fletcher16->sum & 0xff;
+    uint64_t sum2 = fletcher16->sum >> 8;
+
+    sum2 = (sum2 + length % FLETCHER16_MOD * sum1) % FLETCHER16_MOD;
+    fletcher16->sum = sum2 << 8 | sum1;
+}
+
+static struct csum_algo fletcher16 = {
+    .name = "fletcher16",
+    .prepare = fletcher16_prepare,
+    .destroy = fletcher16_destroy,
+    .reset = fletcher16_reset,
+    .compute = fletcher16_compute,
+    .combine = fletcher16_combine,
+    .zeros = fletcher16_zeros,
+};
+
+static struct crc_impl fletcher16_impls[] = {
+    {
+        .algo = {
+            .driver = "fletcher16-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = fletcher16_update,
+    }, {
+        .algo = {
+            .driver = "fletcher16-ssse3",
+            .priority = CSUM_PRIO_SIMD,
+            .features = SUMS_IMPL_SSSE3,
+        },
+        .update = fletcher16_ssse3,
+    }, {
+        .algo = {
+            .driver = "fletcher16-avx2",
+            .priority = CSUM_PRIO_WIDE,
+            .features = SUMS_IMPL_AVX2,
+        },
+        .update = fletcher16_avx2,
+    },
+};
+
+static int __bfdev_ctor
+fletcher16_init(void)
+{
+    return crc_impl_register(fletcher16_impls, CRC_IMPL_COUNT(fletcher16_impls),
+                             &fletcher16, 16);
+}
+
+static void __bfdev_dtor
+fletcher16_exit(void)
+{
+    crc_impl_unregister(fletcher16_impls, CRC_IMPL_COUNT(fletcher16_impls));
+}
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <model.h>
+#include <sums.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define FLETCHER32_MOD 0xffffULL
+#define FLETCHER32_WORD 2
+
+/*
+ * Sums run over little endian 16 bit words and an odd tail is padded
+ * with zero. A word split across two blocks is held back until its
+ * second half arrives, so results do not depend on the block sizes.
+ */
+struct fletcher32_context {
+    struct csum_context csum;
+    char result[32];
+    uint32_t init;
+    uint32_t sum;
+    uint8_t pending[FLETCHER32_WORD];
+    unsigned int npending;
+};
+
+#define csum_to_fletcher32(ptr) \
+    bfdev_container_of(ptr, struct fletcher32_context, csum)
+
+static __always_inline uint64_t
+fletcher32_sums(sums_kernel kernel, uint64_t sum, const void *data, size_t length)
+{
+    uint64_t sum1 = (sum & FLETCHER32_MOD) % FLETCHER32_MOD;
+    uint64_t sum2 = (sum >> 16 & FLETCHER32_MOD) % FLETCHER32_MOD;
+    uint8_t tail[FLETCHER32_WORD] = { };
+    size_t words = length / FLETCHER32_WORD;
+
+    sums_update(kernel, FLETCHER32_WORD, FLETCHER32_MOD,
+                &sum1, &sum2, data, words);
+
+    if (length % FLETCHER32_WORD) {
+        memcpy(tail, (const uint8_t *)data + words * FLETCHER32_WORD,
+               length % FLETCHER32_WORD);
+        sums_update(sums_generic16, FLETCHER32_WORD, FLETCHER32_MOD,
+                    &sum1, &sum2, tail, 1);
+    }
+
+    return sum2 << 16 | sum1;
+}
+
+static uint64_t
+fletcher32_update(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher32_sums(sums_generic16, sum, data, length);
+}
+
+static uint64_t
+fletcher32_ssse3(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher32_sums(sums_ssse3_16, sum, data, length);
+}
+
+static uint64_t
+fletcher32_avx2(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher32_sums(sums_avx2_16, sum, data, length);
+}
+
+static const char *
+fletcher32_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct fletcher32_context *fletcher32 = csum_to_fletcher32(ctx);
+    uintptr_t consumed = sta->offset;
+    size_t length, count;
+    const uint8_t *buff;
+    uint32_t value;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, (const void **)&buff);
+        if (!length)
+            break;
+        consumed += length;
+
+        if (fletcher32->npending) {
+            count = bfdev_min(length, FLETCHER32_WORD - fletcher32->npending);
+            memcpy(fletcher32->pending + fletcher32->npending, buff, count);
+            fletcher32->npending += count;
+            buff += count;
+            length -= count;
+
+            if (fletcher32->npending < FLETCHER32_WORD)
+                continue;
+
+            fletcher32->sum = crc_impl_update(ctx, fletcher32->sum,
+                                              fletcher32->pending, FLETCHER32_WORD);
+            fletcher32->npending = 0;
+        }
+
+        count = length - length % FLETCHER32_WORD;
+        fletcher32->sum = crc_impl_update(ctx, fletcher32->sum, buff, count);
+        fletcher32->npending = length - count;
+        memcpy(fletcher32->pending, buff + count, fletcher32->npending);
+    }
+
+    value = fletcher32->sum;
+    if (fletcher32->npending)
+        value = crc_impl_update(ctx, value, fletcher32->pending,
+                                fletcher32->npending);
+
+    sprintf(fletcher32->result, "%#010x", value);
+    sta->offset = consumed;
+
+    return fletcher32->result;
+}
+
+static struct csum_context *
+fletcher32_prepare(const char *args, unsigned long flags)
+{
+    struct fletcher32_context *fletcher32;
+    uint32_t init = 0;
+
+    fletcher32 = bfdev_zalloc(NULL, sizeof(*fletcher32));
+    if (bfdev_unlikely(!fletcher32))
+        return NULL;
+
+    if (args)
+        init = (uint32_t)strtoul(args, NULL, 0);
+
+    fletcher32->sum = fletcher32_update(init, NULL, 0);
+    fletcher32->init = fletcher32->sum;
+
+    return &fletcher32->csum;
+}
+
+static void
+fletcher32_destroy(struct csum_context *ctx)
+{
+    struct fletcher32_context *fletcher32 = csum_to_fletcher32(ctx);
+    bfdev_free(NULL, fletcher32);
+}
+
+static void
+fletcher32_reset(struct csum_context *ctx)
+{
+    struct fletcher32_context *fletcher32 = csum_to_fletcher32(ctx);
+
+    fletcher32->sum = fletcher32->init;
+    fletcher32->npending = 0;
+}
+
+static struct csum_algo fletcher32 = {
+    .name = "fletcher32",
+    .prepare = fletcher32_prepare,
+    .destroy = fletcher32_destroy,
+    .reset = fletcher32_reset,
+    .compute = fletcher32_compute,
+};
+
+static struct crc_impl fletcher32_impls[] = {
+    {
+        .algo = {
+            .driver = "fletcher32-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = fletcher32_update,
+    }, {
+        .algo = {
+            .driver = "fletcher32-ssse3",
+            .priority = CSUM_PRIO_SIMD,
+            .features = SUMS_IMPL_SSSE3,
+        },
+        .update = fletcher32_ssse3,
+    }, {
+        .algo = {
+            .driver = "fletcher32-avx2",
+            .priority = CSUM_PRIO_WIDE,
+            .features = SUMS_IMPL_AVX2,
+        },
+        .update = fletcher32_avx2,
+    },
+};
+
+static int __bfdev_ctor
+fletcher32_init(void)
+{
+    return crc_impl_register(fletcher32_impls, CRC_IMPL_COUNT(fletcher32_impls),
+                             &fletcher32, 32);
+}
+
+static void __bfdev_dtor
+fletcher32_exit(void)
+{
+    crc_impl_unregister(fletcher32_impls, CRC_IMPL_COUNT(fletcher32_impls));
+}
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <model.h>
+#include <sums.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define FLETCHER64_MOD 0xffffffffULL
+#define FLETCHER64_WORD 4
+
+/*
+ * Sums run over little endian 32 bit words and a partial tail is padded
+ * with zero. A word split across two blocks is held back until its
+ * second half arrives, so results do not depend on the block sizes.
+ */
+struct fletcher64_context {
+    struct csum_context csum;
+    char result[32];
+    uint64_t init;
+    uint64_t sum;
+    uint8_t pending[FLETCHER64_WORD];
+    unsigned int npending;
+};
+
+#define csum_to_fletcher64(ptr) \
+    bfdev_container_of(ptr, struct fletcher64_context, csum)
+
+static __always_inline uint64_t
+fletcher64_sums(sums_kernel kernel, uint64_t sum, const void *data, size_t length)
+{
+    uint64_t sum1 = (sum & FLETCHER64_MOD) % FLETCHER64_MOD;
+    uint64_t sum2 = (sum >> 32 & FLETCHER64_MOD) % FLETCHER64_MOD;
+    uint8_t tail[FLETCHER64_WORD] = { };
+    size_t words = length / FLETCHER64_WORD;
+
+    sums_update(kernel, FLETCHER64_WORD, FLETCHER64_MOD,
+                &sum1, &sum2, data, words);
+
+    if (length % FLETCHER64_WORD) {
+        memcpy(tail, (const uint8_t *)data + words * FLETCHER64_WORD,
+               length % FLETCHER64_WORD);
+        sums_update(sums_generic32, FLETCHER64_WORD, FLETCHER64_MOD,
+                    &sum1, &sum2, tail, 1);
+    }
+
+    return sum2 << 32 | sum1;
+}
+
+static uint64_t
+fletcher64_update(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher64_sums(sums_generic32, sum, data, length);
+}
+
+static uint64_t
+fletcher64_ssse3(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher64_sums(sums_ssse3_32, sum, data, length);
+}
+
+static uint64_t
+fletcher64_avx2(uint64_t sum, const void *data, size_t length)
+{
+    return fletcher64_sums(sums_avx2_32, sum, data, length);
+}
+
+static const char *
+fletcher64_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct fletcher64_context *fletcher64 = csum_to_fletcher64(ctx);
+    uintptr_t consumed = sta->offset;
+    size_t length, count;
+    const uint8_t *buff;
+    uint64_t value;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, (const void **)&buff);
+        if (!length)
+            break;
+        consumed += length;
+
+        if (fletcher64->npending) {
+            count = bfdev_min(length, FLETCHER64_WORD - fletcher64->npending);
+            memcpy(fletcher64->pending + fletcher64->npending, buff, count);
+            fletcher64->npending += count;
+            buff += count;
+            length -= count;
+
+            if (fletcher64->npending < FLETCHER64_WORD)
+                continue;
+
+            fletcher64->sum = crc_impl_update(ctx, fletcher64->sum,
+                                              fletcher64->pending, FLETCHER64_WORD);
+            fletcher64->npending = 0;
+        }
+
+        count = length - length % FLETCHER64_WORD;
+        fletcher64->sum = crc_impl_update(ctx, fletcher64->sum, buff, count);
+        fletcher64->npending = length - count;
+        memcpy(fletcher64->pending, buff + count, fletcher64->npending);
+    }
+
+    value = fletcher64->sum;
+    if (fletcher64->npending)
+        value = crc_impl_update(ctx, value, fletcher64->pending,
+                                fletcher64->npending);
+
+    sprintf(fletcher64->result, "%#018llx", (unsigned long long)value);
+    sta->offset = consumed;
+
+    return fletcher64->result;
+}
+
+static struct csum_context *
+fletcher64_prepare(const char *args, unsigned long flags)
+{
+    struct fletcher64_context *fletcher64;
+    uint64_t init = 0;
+
+    fletcher64 = bfdev_zalloc(NULL, sizeof(*fletcher64));
+    if (bfdev_unlikely(!fletcher64))
+        return NULL;
+
+    if (args)
+        init = (uint64_t)strtoull(args, NULL, 0);
+
+    fletcher64->sum = fletcher64_update(init, NULL, 0);
+    fletcher64->init = fletcher64->sum;
+
+    return &fletcher64->csum;
+}
+
+static void
+fletcher64_destroy(struct csum_context *ctx)
+{
+    struct fletcher64_context *fletcher64 = csum_to_fletcher64(ctx);
+    bfdev_free(NULL, fletcher64);
+}
+
+static void
+fletcher64_reset(struct csum_context *ctx)
+{
+    struct fletcher64_context *fletcher64 = csum_to_fletcher64(ctx);
+
+    fletcher64->sum = fletcher64->init;
+    fletcher64->npending = 0;
+}
+
+static struct csum_algo fletcher64 = {
+    .name = "fletcher64",
+    .prepare = fletcher64_prepare,
+    .destroy = fletcher64_destroy,
+    .reset = fletcher64_reset,
+    .compute = fletcher64_compute,
+};
+
+static struct crc_impl fletcher64_impls[] = {
+    {
+        .algo = {
+            .driver = "fletcher64-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = fletcher64_update,
+    }, {
+        .algo = {
+            .driver = "fletcher64-ssse3",
+            .priority = CSUM_PRIO_SIMD,
+            .features = SUMS_IMPL_SSSE3,
+        },
+        .update = fletcher64_ssse3,
+    }, {
+        .algo = {
+            .driver = "fletcher64-avx2",
+            .priority = CSUM_PRIO_WIDE,
+            .features = SUMS_IMPL_AVX2,
+        },
+        .update = fletcher64_avx2,
+    },
+};
+
+static int __bfdev_ctor
+fletcher64_init(void)
+{
+    return crc_impl_register(fletcher64_impls, CRC_IMPL_COUNT(fletcher64_impls),
+                             &fletcher64, 64);
+}
+
+static void __bfdev_dtor
+fletcher64_exit(void)
+{
+    crc_impl_unregister(fletcher64_impls, CRC_IMPL_COUNT(fletcher64_impls));
+}
@@ -0,0 +1,302 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <model.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bfdev/allocator.h>
+
+/*
+ * The running state is the folded ones complement sum of the data in
+ * little endian word order, with the parity of the bytes seen so far
+ * kept above it. A block starting at an odd position has its own sum
+ * byte swapped before it is added (RFC 1071, 2. (B)).
+ */
+#define INET_ODD 0x10000
+
+struct inet_context {
+    struct csum_context csum;
+    char result[16];
+    uint16_t init;
+    uint64_t state;
+};
+
+#define csum_to_inet(ptr) \
+    bfdev_container_of(ptr, struct inet_context, csum)
+
+static __always_inline uint16_t
+inet_fold(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (sum & 0xffff) + (sum >> 16);
+}
+
+static __always_inline uint16_t
+inet_swab(uint16_t value)
+{
+    return value << 8 | value >> 8;
+}
+
+static __always_inline uint64_t
+inet_merge(uint64_t state, uint64_t sum, size_t length)
+{
+    uint16_t block = inet_fold(sum);
+
+    if (state & INET_ODD)
+        block = inet_swab(block);
+
+    return inet_fold((state & 0xffff) + block) |
+           ((state ^ (length & 1) << 16) & INET_ODD);
+}
+
+static uint64_t
+inet_generic_sum(const void *data, size_t length)
+{
+    const uint8_t *buff = data;
+    uint64_t sum = 0;
+    uint32_t word;
+
+    for (; length >= 4; length -= 4, buff += 4) {
+        memcpy(&word, buff, 4);
+        sum += word;
+    }
+
+    if (length >= 2) {
+        sum += buff[0] | (uint32_t)buff[1] << 8;
+        length -= 2;
+        buff += 2;
+    }
+
+    if (length)
+        sum += buff[0];
+
+    return sum;
+}
+
+static uint64_t
+inet_update(uint64_t state, const void *data, size_t length)
+{
+    return inet_merge(state, inet_generic_sum(data, length), length);
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+/*
+ * Every 32 bit word is widened into a 64 bit lane, the accumulators
+ * cannot overflow on anything that fits into memory.
+ */
+static __attribute__((target("sse2"))) uint64_t
+inet_sse2_sum(const void *data, size_t length)
+{
+    const __m128i mask = _mm_set1_epi64x(0xffffffff);
+    __m128i acc0 = _mm_setzero_si128(), acc1 = acc0, value;
+    const uint8_t *buff = data;
+    uint64_t lanes[2];
+
+    for (; length >= 16; length -= 16, buff += 16) {
+        value = _mm_loadu_si128((const __m128i *)buff);
+        acc0 = _mm_add_epi64(acc0, _mm_and_si128(value, mask));
+        acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(value, 32));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + inet_generic_sum(buff, length);
+}
+
+static __attribute__((target("sse2,avx2"))) uint64_t
+inet_avx2_sum(const void *data, size_t length)
+{
+    const __m256i mask = _mm256_set1_epi64x(0xffffffff);
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    __m256i value0, value1;
+    const uint8_t *buff = data;
+    uint64_t lanes[4];
+
+    for (; length >= 64; length -= 64, buff += 64) {
+        value0 = _mm256_loadu_si256((const __m256i *)buff);
+        value1 = _mm256_loadu_si256((const __m256i *)(buff + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(value0, mask));
+        acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(value0, 32));
+        acc2 = _mm256_add_epi64(acc2, _mm256_and_si256(value1, mask));
+        acc3 = _mm256_add_epi64(acc3, _mm256_srli_epi64(value1, 32));
+    }
+
+    acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+                            _mm256_add_epi64(acc2, acc3));
+    _mm256_storeu_si256((__m256i *)lanes, acc0);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           inet_sse2_sum(buff, length);
+}
+
+static uint64_t
+inet_sse2(uint64_t state, const void *data, size_t length)
+{
+    return inet_merge(state, inet_sse2_sum(data, length), length);
+}
+
+static uint64_t
+inet_avx2(uint64_t state, const void *data, size_t length)
+{
+    return inet_merge(state, inet_avx2_sum(data, length), length);
+}
+
+#endif /* __x86_64__ */
+
+/*
+ * RFC 1624 equation 3, HC' = ~(~HC + ~m + m'), one big endian word of
+ * the field at a time. The field has to start at an even offset.
+ */
+uint16_t
+csum_inet_adjust(uint16_t check, const void *old, const void *new, size_t length)
+{
+    const uint8_t *before = old, *after = new;
+    uint64_t sum = (uint16_t)~check;
+    uint16_t word;
+    size_t index;
+
+    for (index = 0; index < length; index += 2) {
+        word = before[index] << 8;
+        if (index + 1 < length)
+            word |= before[index + 1];
+        sum += (uint16_t)~word;
+
+        word = after[index] << 8;
+        if (index + 1 < length)
+            word |= after[index + 1];
+        sum += word;
+    }
+
+    return ~inet_fold(sum);
+}
+
+static const char *
+inet_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct inet_context *inet = csum_to_inet(ctx);
+    uintptr_t consumed = sta->offset;
+    uint16_t sum;
+    size_t length;
+    const void *buff;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        inet->state = crc_impl_update(ctx, inet->state, buff, length);
+        consumed += length;
+    }
+
+    /* the initial sum only joins here, so combine stays exact */
+    sum = inet_fold((uint64_t)inet_swab(inet->state & 0xffff) + inet->init);
+    sprintf(inet->result, "%#06x", (uint16_t)~sum);
+    sta->offset = consumed;
+
+    return inet->result;
+}
+
+static struct csum_context *
+inet_prepare(const char *args, unsigned long flags)
+{
+    struct inet_context *inet;
+
+    inet = bfdev_zalloc(NULL, sizeof(*inet));
+    if (bfdev_unlikely(!inet))
+        return NULL;
+
+    /* a folded pseudo header sum, in network order */
+    if (args)
+        inet->init = (uint16_t)strtoul(args, NULL, 0);
+
+    return &inet->csum;
+}
+
+static void
+inet_destroy(struct csum_context *ctx)
+{
+    struct inet_context *inet = csum_to_inet(ctx);
+    bfdev_free(NULL, inet);
+}
+
+static void
+inet_reset(struct csum_context *ctx)
+{
+    struct inet_context *inet = csum_to_inet(ctx);
+    inet->state = 0;
+}
+
+static void
+inet_combine(struct csum_context *ctx, struct csum_context *next, uint64_t length)
+{
+    struct inet_context *inet = csum_to_inet(ctx);
+    struct inet_context *other = csum_to_inet(next);
+
+    inet->state = inet_merge(inet->state, other->state & 0xffff, length);
+}
+
+static void
+inet_zeros(struct csum_context *ctx, uint64_t length)
+{
+    struct inet_context *inet = csum_to_inet(ctx);
+    inet->state ^= (length & 1) << 16;
+}
+
+static struct csum_algo inet = {
+    .name = "inet",
+    .desc = "RFC 1071 internet checksum, -p SUM adds a pseudo header sum",
+    .prepare = inet_prepare,
+    .destroy = inet_destroy,
+    .reset = inet_reset,
+    .compute = inet_compute,
+    .combine = inet_combine,
+    .zeros = inet_zeros,
+};
+
+static struct crc_impl inet_impls[] = {
+    {
+        .algo = {
+            .driver = "inet-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .update = inet_update,
+    },
+#if defined(__x86_64__)
+    {
+        .algo = {
+            .driver = "inet-sse2",
+            .priority = CSUM_PRIO_SIMD,
+            .features = CSUM_CPU_SSE2,
+        },
+        .update = inet_sse2,
+    }, {
+        .algo = {
+            .driver = "inet-avx2",
+            .priority = CSUM_PRIO_WIDE,
+            .features = CSUM_CPU_SSE2 | CSUM_CPU_AVX2,
+        },
+        .update = inet_avx2,
+    },
+#endif
+};
+
+static int __bfdev_ctor
+inet_init(void)
+{
+    /* the parity bit rides along, so verify 17 bits of state */
+    return crc_impl_register(inet_impls, CRC_IMPL_COUNT(inet_impls),
+                             &inet, 17);
+}
+
+static void __bfdev_dtor
+inet_exit(void)
+{
+    crc_impl_unregister(inet_impls, CRC_IMPL_COUNT(inet_impls));
+}
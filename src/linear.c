@@ -23,20 +23,72 @@ const char *
 csum_linear_compute(struct csum_context *ctx, struct csum_linear *linear,
                    const void *data, size_t length)
 {
-    struct csum_algo *algo = ctx->algo;
-
     linear->data = data;
     linear->length = length;
     linear->sta.offset = 0;
     linear->sta.pdata = linear;
     ctx->next_block = linear_next;
 
-    return algo->compute(ctx, &linear->sta);
+    /* the same as one block through compute, timed runs take the loop */
+    if (ctx->algo->linear && !csum_stats_enabled) {
+        linear->sta.offset = length;
+        return ctx->algo->linear(ctx, data, length);
+    }
+
+    return csum_next(ctx, &linear->sta);
+}
+
+const char *
+csum_linear_parallel(struct csum_context *ctx, struct csum_linear *linear,
+                     const void *data, size_t length, unsigned int jobs)
+{
+    const char *result;
+
+    ctx->jobs = jobs;
+    result = csum_linear_compute(ctx, linear, data, length);
+    ctx->jobs = 0;
+
+    return result;
+}
+
+/*
+ * Buffers are handed to the many op in rounds of CSUM_MANY_MAX, every
+ * context has to belong to the same implementation.
+ */
+void
+csum_linear_many(struct csum_context **ctxs, struct csum_linear *linears,
+                 const char **results, unsigned int count)
+{
+    struct csum_state *stas[CSUM_MANY_MAX];
+    struct csum_algo *algo = ctxs[0]->algo;
+    unsigned int index, base, round;
+
+    for (index = 0; index < count; ++index) {
+        linears[index].sta.offset = 0;
+        linears[index].sta.pdata = &linears[index];
+        ctxs[index]->next_block = linear_next;
+    }
+
+    if (!algo->many || count == 1) {
+        for (index = 0; index < count; ++index)
+            results[index] = csum_next(ctxs[index], &linears[index].sta);
+        return;
+    }
+
+    for (base = 0; base < count; base += round) {
+        round = count - base;
+        if (round > CSUM_MANY_MAX)
+            round = CSUM_MANY_MAX;
+
+        for (index = 0; index < round; ++index)
+            stas[index] = &linears[base + index].sta;
+
+        algo->many(ctxs + base, stas, results + base, round);
+    }
 }
 
 const char *
 csum_linear_next(struct csum_context *ctx, struct csum_linear *linear)
 {
-    struct csum_algo *algo = ctx->algo;
-    return algo->compute(ctx, &linear->sta);
+    return csum_next(ctx, &linear->sta);
 }
@@ -3,6 +3,7 @@
  * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -12,23 +13,77 @@
 #include <getopt.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 
 #include <csum.h>
+#include <async.h>
+#include <daemon.h>
 #include <config.h>
 #include <bfdev/bits.h>
 #include <bfdev/minmax.h>
 
 #define DEF_ALGO "crc32"
 #define PIPE_BUFFER 0x10000
+#define DEF_JOBS 8
+#define ENV_IMPL "CSUM_IMPL"
+#define RESULT_SIZE 256
+#define DEF_BENCH 0x4000000
+#define DEF_SELFTEST 32
+#define DEF_SAMPLES 16
+#define DEF_WATCH 200
+#define RANGE_SEPARATORS " \t,+"
+#define BATCH_FILES CSUM_MANY_MAX
+#define BATCH_SIZE 0x10000
 
 enum {
     __CSUM_ZERO = 0,
+    __CSUM_STATS,
+    __CSUM_STATS_JSON,
+    __CSUM_TEE,
+    __CSUM_DUPS,
+    __CSUM_QUICK,
+    __CSUM_WATCH,
+    __CSUM_CONCAT,
+    __CSUM_APPEND_ONLY,
+
     CSUM_ZERO = BFDEV_BIT(__CSUM_ZERO),
+    CSUM_STATS = BFDEV_BIT(__CSUM_STATS),
+    CSUM_STATS_JSON = BFDEV_BIT(__CSUM_STATS_JSON),
+    CSUM_TEE = BFDEV_BIT(__CSUM_TEE),
+    CSUM_DUPS = BFDEV_BIT(__CSUM_DUPS),
+    CSUM_QUICK = BFDEV_BIT(__CSUM_QUICK),
+    CSUM_WATCH = BFDEV_BIT(__CSUM_WATCH),
+    CSUM_CONCAT = BFDEV_BIT(__CSUM_CONCAT),
+    CSUM_APPEND_ONLY = BFDEV_BIT(__CSUM_APPEND_ONLY),
+};
+
+/**
+ * struct batch_context - small files waiting for one many round, or
+ * pipes and sockets waiting to be read together on one event loop.
+ * @entries: event loop state of each queued stream.
+ * @errors: read error of each queued stream.
+ * @paths: names as given on the command line, for printing.
+ * @count: files queued so far.
+ * @streams: whether the queued files are streams.
+ */
+struct batch_context {
+    struct csum_context *ctxs[BATCH_FILES];
+    struct csum_linear linears[BATCH_FILES];
+    struct csum_async_entry entries[BATCH_FILES];
+    const char *results[BATCH_FILES];
+    const char *paths[BATCH_FILES];
+    int errors[BATCH_FILES];
+    struct csum_async async;
+    unsigned int count;
+    bool streams;
 };
 
 struct pipe_context {
     uint8_t buffer[PIPE_BUFFER];
+    bool splice;
     int pipe;
+    int tee;
 };
 
 static const struct option options[] = {
@@ -39,33 +94,83 @@ static const struct option options[] = {
     {"zero",        no_argument,        0,  'z'},
     {"seek",        required_argument,  0,  's'},
     {"len",         required_argument,  0,  'l'},
+    {"jobs",        required_argument,  0,  'j'},
+    {"impl",        required_argument,  0,  'I'},
+    {"list",        no_argument,        0,  'L'},
+    {"stats",       optional_argument,  0,  'S'},
+    {"daemon",      required_argument,  0,  'D'},
+    {"connect",     required_argument,  0,  'C'},
+    {"bench",       optional_argument,  0,  'B'},
+    {"tee",         optional_argument,  0,  'T'},
+    {"ranges",      required_argument,  0,  'R'},
+    {"dups",        no_argument,        0,  'U'},
+    {"quick",       optional_argument,  0,  'Q'},
+    {"watch",       optional_argument,  0,  'W'},
+    {"append-only", no_argument,        0,  'O'},
+    {"format",      required_argument,  0,  'F'},
+    {"concat",      no_argument,        0,  'N'},
+    {"selftest",    optional_argument,  0,  'E'},
     { }, /* NULL */
 };
 
+static enum csum_format format;
+static struct csum_writer *writer;
+
+static ssize_t
+pipe_forward(int fd, const uint8_t *data, size_t size)
+{
+    ssize_t retval;
+
+    while (size) {
+        retval = write(fd, data, size);
+        if (retval < 0)
+            return retval;
+
+        data += retval;
+        size -= retval;
+    }
+
+    return 0;
+}
+
 static size_t
 pipe_next_block(struct csum_context *tsc, struct csum_state *sta,
                 uintptr_t consumed, const void **dest)
 {
     struct pipe_context *pctx = sta->pdata;
-    ssize_t retval;
+    ssize_t retval = PIPE_BUFFER;
 
-    retval = read(pctx->pipe, pctx->buffer, PIPE_BUFFER);
-    if (retval < 0) {
-        errno = retval;
-        return 0;
+    /* duplicate the pipe pages to the output, then consume them */
+    if (pctx->splice) {
+        retval = tee(pctx->pipe, pctx->tee, PIPE_BUFFER, 0);
+        if (retval <= 0)
+            return 0;
     }
+
+    retval = read(pctx->pipe, pctx->buffer, retval);
+    if (retval < 0)
+        return 0;
+
+    if (pctx->tee >= 0 && !pctx->splice &&
+        pipe_forward(pctx->tee, pctx->buffer, retval) < 0)
+        return 0;
     *dest = pctx->buffer;
 
     return retval;
 }
 
 static __always_inline const char *
-compute_pipe(struct csum_context *ctx, struct csum_state *sta, const int pipe)
+compute_pipe(struct csum_context *ctx, struct csum_state *sta,
+             const int pipe, const int tee)
 {
     struct pipe_context pctx;
     const char *result;
+    struct stat in, out;
 
     pctx.pipe = pipe;
+    pctx.tee = tee;
+    pctx.splice = tee >= 0 && !fstat(pipe, &in) && !fstat(tee, &out) &&
+                  S_ISFIFO(in.st_mode) && S_ISFIFO(out.st_mode);
     sta->pdata = &pctx;
     ctx->next_block = pipe_next_block;
     result = csum_compute(ctx, sta);
@@ -74,85 +179,724 @@ compute_pipe(struct csum_context *ctx, struct csum_state *sta, const int pipe)
 }
 
 static __always_inline const char *
-compute_mmap(struct csum_context *ctx, const void *mmap, size_t size)
+compute_mmap(struct csum_context *ctx, const void *mmap, size_t size,
+             unsigned int jobs)
 {
     struct csum_linear linear;
     const char *result;
 
-    result = csum_linear_compute(ctx, &linear, mmap, size);
+    result = csum_linear_parallel(ctx, &linear, mmap, size, jobs);
+
+    return result;
+}
+
+static __always_inline const char *
+compute_blkdev(struct csum_context *ctx, struct csum_state *sta, int handle,
+               off_t offset, size_t size, size_t align, unsigned int jobs)
+{
+    const char *result;
+
+    posix_fadvise(handle, offset, size, POSIX_FADV_SEQUENTIAL);
+    result = csum_range_compute(ctx, sta, handle, offset, size, align, jobs);
+
+    return result;
+}
+
+static __always_inline const char *
+compute_sparse(struct csum_context *ctx, int handle, const void *mmap,
+               off_t offset, size_t size)
+{
+    struct csum_state sta;
+    const char *result;
+
+    result = csum_sparse_compute(ctx, &sta, handle, mmap, offset, size);
 
     return result;
 }
 
+static size_t
+compute_range(size_t size, off_t *offset, size_t length)
+{
+    size_t active = size;
+
+    if (*offset) {
+        if (*offset > 0)
+            active -= *offset;
+        else {
+            *offset += active;
+            active = size - *offset;
+        }
+    }
+
+    if (length)
+        bfdev_min_adj(active, length);
+
+    return active;
+}
+
 static const char *
-do_compute(struct csum_context *ctx, size_t *pactive,
-           off_t offset, size_t length)
+do_compute(struct csum_context *ctx, size_t *pactive, off_t *poffset,
+           size_t length, unsigned int jobs, int tee)
 {
+    off_t offset = *poffset;
     const char *result;
     size_t active;
     int retval;
 
     if (!strcmp(optarg, "-")) {
         struct csum_state sta;
-        result = compute_pipe(ctx, &sta, STDIN_FILENO);
+        result = compute_pipe(ctx, &sta, STDIN_FILENO, tee);
+        active = sta.offset;
+    }
+
+    else if (tee >= 0) {
+        struct csum_state sta;
+        int handle;
+
+        if ((handle = open(optarg, O_RDONLY)) < 0)
+            err(handle, "failed to open '%s'", optarg);
+
+        result = compute_pipe(ctx, &sta, handle, tee);
         active = sta.offset;
+        close(handle);
     }
 
     else {
+        struct csum_clock clock;
         struct stat stat;
-        void *mmaped, *compute;
+        void *mmaped;
         int handle;
 
+        csum_stats_start(&clock);
         if ((handle = open(optarg, O_RDONLY)) < 0)
             err(handle, "failed to open '%s'", optarg);
 
         if ((retval = fstat(handle, &stat)) < 0)
             err(retval, "failed to fstat '%s'", optarg);
 
-        mmaped = compute = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
-        if (mmaped == MAP_FAILED)
-            err(errno, "failed to mmap '%s'", optarg);
+        if (S_ISBLK(stat.st_mode)) {
+            struct csum_state sta;
+            uint64_t size;
+            int align;
 
-        active = stat.st_size;
-        if (offset) {
-            if (offset > 0) {
-                compute += offset;
-                active -= offset;
-            } else {
-                compute += active + offset;
-                active = -offset;
-            }
+            if ((retval = ioctl(handle, BLKGETSIZE64, &size)) < 0)
+                err(retval, "failed to get size of '%s'", optarg);
+
+            if ((retval = ioctl(handle, BLKSSZGET, &align)) < 0)
+                err(retval, "failed to get block size of '%s'", optarg);
+
+            csum_stats_stop(CSUM_STAGE_OPEN, &clock, 0);
+            active = compute_range(size, &offset, length);
+            result = compute_blkdev(ctx, &sta, handle, offset, active, align, jobs);
         }
 
-        if (length)
-            bfdev_min_adj(active, length);
-        result = compute_mmap(ctx, compute, active);
+        else {
+            csum_stats_stop(CSUM_STAGE_OPEN, &clock, 0);
+            csum_stats_start(&clock);
+            mmaped = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+            if (mmaped == MAP_FAILED)
+                err(errno, "failed to mmap '%s'", optarg);
+            csum_stats_stop(CSUM_STAGE_MAP, &clock, stat.st_size);
+
+            active = compute_range(stat.st_size, &offset, length);
+            if (ctx->algo->zeros && stat.st_blocks * 512 < stat.st_size)
+                result = compute_sparse(ctx, handle, mmaped + offset, offset, active);
+            else
+                result = compute_mmap(ctx, mmaped + offset, active, jobs);
+
+            csum_stats_start(&clock);
+            munmap(mmaped, stat.st_size);
+            csum_stats_stop(CSUM_STAGE_MAP, &clock, 0);
+        }
 
-        munmap(mmaped, stat.st_size);
         close(handle);
     }
 
     if (errno || (errno = !result ? EFAULT : 0))
         err(errno, "failed to compute '%s'", optarg);
 
+    *poffset = offset;
     *pactive = active;
     return result;
 }
 
 static void
-print_result(const char *algo, const char *para, size_t active,
-             const char *result, unsigned long flags)
+do_extents(struct csum_context *ctx, struct csum_extent *extents,
+           unsigned int count, unsigned int jobs)
+{
+    struct csum_clock clock;
+    void *mmaped = NULL;
+    struct stat stat;
+    unsigned int index;
+    uint64_t size;
+    int handle, align = 1, retval;
+
+    csum_stats_start(&clock);
+    if (!strcmp(optarg, "-"))
+        handle = STDIN_FILENO;
+    else if ((handle = open(optarg, O_RDONLY)) < 0)
+        err(handle, "failed to open '%s'", optarg);
+
+    if ((retval = fstat(handle, &stat)) < 0)
+        err(retval, "failed to fstat '%s'", optarg);
+
+    if (S_ISBLK(stat.st_mode)) {
+        if ((retval = ioctl(handle, BLKGETSIZE64, &size)) < 0)
+            err(retval, "failed to get size of '%s'", optarg);
+
+        if ((retval = ioctl(handle, BLKSSZGET, &align)) < 0)
+            err(retval, "failed to get block size of '%s'", optarg);
+    } else if (S_ISREG(stat.st_mode))
+        size = stat.st_size;
+    else {
+        errno = ESPIPE;
+        err(errno, "ranges need a seekable '%s'", optarg);
+    }
+
+    for (index = 0; index < count; ++index) {
+        if (extents[index].offset > size ||
+            extents[index].length > size - extents[index].offset) {
+            errno = ERANGE;
+            err(errno, "range %llu+%llu is outside of '%s'",
+                (unsigned long long)extents[index].offset,
+                (unsigned long long)extents[index].length, optarg);
+        }
+    }
+    csum_stats_stop(CSUM_STAGE_OPEN, &clock, 0);
+
+    if (S_ISREG(stat.st_mode) && size) {
+        csum_stats_start(&clock);
+        mmaped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, handle, 0);
+        if (mmaped == MAP_FAILED)
+            err(errno, "failed to mmap '%s'", optarg);
+        csum_stats_stop(CSUM_STAGE_MAP, &clock, size);
+    }
+
+    retval = csum_extents_compute(ctx, handle, mmaped, extents, count, align, jobs);
+    if (retval < 0) {
+        errno = -retval;
+        err(errno, "failed to compute '%s'", optarg);
+    }
+
+    if (mmaped)
+        munmap(mmaped, size);
+    if (handle != STDIN_FILENO)
+        close(handle);
+}
+
+static const char *
+do_quick(struct csum_context *ctx, size_t *pactive, unsigned int samples)
 {
-    if (flags & CSUM_ZERO)
-        printf("%s %lld %s", result, (long long)active, optarg);
+    const char *result;
+    void *mmaped = NULL;
+    struct stat stat;
+    uint64_t size;
+    int handle, retval;
+
+    if (!strcmp(optarg, "-"))
+        handle = STDIN_FILENO;
+    else if ((handle = open(optarg, O_RDONLY)) < 0)
+        err(handle, "failed to open '%s'", optarg);
+
+    if ((retval = fstat(handle, &stat)) < 0)
+        err(retval, "failed to fstat '%s'", optarg);
+
+    if (S_ISBLK(stat.st_mode)) {
+        if ((retval = ioctl(handle, BLKGETSIZE64, &size)) < 0)
+            err(retval, "failed to get size of '%s'", optarg);
+    } else if (S_ISREG(stat.st_mode))
+        size = stat.st_size;
+    else {
+        errno = ESPIPE;
+        err(errno, "fingerprints need a seekable '%s'", optarg);
+    }
+
+    /* only the sampled pages are touched, keep readahead out of it */
+    if (S_ISREG(stat.st_mode) && size) {
+        mmaped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, handle, 0);
+        if (mmaped == MAP_FAILED)
+            err(errno, "failed to mmap '%s'", optarg);
+        madvise(mmaped, size, MADV_RANDOM);
+    }
+
+    result = csum_quick_compute(ctx, handle, mmaped, size, samples);
+    if (!result)
+        err(errno, "failed to fingerprint '%s'", optarg);
+
+    if (mmaped)
+        munmap(mmaped, size);
+    if (handle != STDIN_FILENO)
+        close(handle);
+
+    *pactive = size;
+    return result;
+}
+
+static struct csum_extent *
+load_extents(const char *path, unsigned int *pcount)
+{
+    struct csum_extent *extents = NULL, *block;
+    unsigned int count = 0, limit = 0, line = 0;
+    char *buffer = NULL, *walk, *end;
+    size_t size = 0;
+    FILE *stream;
+
+    if (!strcmp(path, "-"))
+        stream = stdin;
+    else if (!(stream = fopen(path, "re")))
+        err(errno, "failed to open '%s'", path);
+
+    /* one range per line, "OFFSET LENGTH", blank and # lines skipped */
+    while (getline(&buffer, &size, stream) >= 0) {
+        uint64_t offset, length;
+
+        line++;
+        walk = buffer + strspn(buffer, " \t");
+        if (*walk == '#' || *walk == '\n' || !*walk)
+            continue;
+
+        offset = strtoull(walk, &end, 0);
+        if (end == walk)
+            goto invalid;
+
+        walk = end + strspn(end, RANGE_SEPARATORS);
+        length = strtoull(walk, &end, 0);
+        if (end == walk || end[strspn(end, " \t\r\n")])
+            goto invalid;
+
+        if (count == limit) {
+            limit = limit ? limit * 2 : 64;
+            block = realloc(extents, sizeof(*extents) * limit);
+            if (!block)
+                err(ENOMEM, "failed to load ranges '%s'", path);
+            extents = block;
+        }
+
+        extents[count].offset = offset;
+        extents[count].length = length;
+        count++;
+    }
+
+    free(buffer);
+    if (stream != stdin)
+        fclose(stream);
+
+    *pcount = count;
+    return extents;
+
+invalid:
+    errno = EINVAL;
+    err(errno, "invalid range at '%s' line %u", path, line);
+}
+
+/* everything but the coreutils style digests prints as a 0x number */
+static bool
+record_prefixed(const char *algo)
+{
+    struct csum_algo *entry = csum_find(algo);
+
+    return !entry || !entry->coreutils;
+}
+
+/*
+ * Machine readable records bypass stdio, the writer is opened on the
+ * first one so that it follows any --tee redirection.
+ */
+static void
+write_record(FILE *stream, const struct csum_record *record)
+{
+    int retval;
+
+    if (!writer) {
+        fflush(stream);
+        writer = csum_writer_create(fileno(stream), format);
+        if (!writer)
+            err(ENOMEM, "failed to create writer");
+    }
+
+    if ((retval = csum_writer_record(writer, record)) < 0) {
+        errno = -retval;
+        err(errno, "failed to write '%s'", record->path);
+    }
+}
+
+static void
+close_writer(void)
+{
+    int retval;
+
+    if (!writer)
+        return;
+
+    retval = csum_writer_destroy(writer);
+    writer = NULL;
+
+    if (retval < 0) {
+        errno = -retval;
+        err(errno, "failed to write output");
+    }
+}
+
+/* err() exits from anywhere, whatever was buffered still goes out */
+static void
+exit_writer(void)
+{
+    struct csum_writer *pending = writer;
+
+    writer = NULL;
+    if (pending)
+        csum_writer_destroy(pending);
+}
+
+static void
+print_extents(FILE *stream, const char *algo, const char *para,
+              struct csum_extent *extents, unsigned int count,
+              unsigned long flags)
+{
+    unsigned int index;
+
+    for (index = 0; index < count; ++index) {
+        unsigned long long offset = extents[index].offset;
+        unsigned long long length = extents[index].length;
+        const char *result = extents[index].result;
+
+        if (format != CSUM_FORMAT_TEXT) {
+            write_record(stream, &(struct csum_record) {
+                .algo = algo, .para = para, .path = optarg, .result = result,
+                .offset = offset, .size = length, .ranged = true,
+                .prefixed = record_prefixed(algo),
+            });
+        } else if (flags & CSUM_ZERO)
+            fprintf(stream, "%s %llu+%llu %s", result, offset, length, optarg);
+        else if (para)
+            fprintf(stream, "%s [%s]: (%s %llu+%llu) = %s\n", algo, para,
+                    optarg, offset, length, result);
+        else
+            fprintf(stream, "%s: (%s %llu+%llu) = %s\n", algo,
+                    optarg, offset, length, result);
+    }
+}
+
+static const char *
+do_request(struct csum_client *client, size_t *pactive,
+           const char *algo, const char *para)
+{
+    static char result[RESULT_SIZE];
+    uint64_t active;
+    int retval;
+
+    retval = csum_client_request(client, algo, para, optarg,
+                                 &active, result, sizeof(result));
+    if (retval < 0) {
+        errno = -retval;
+        err(errno, "failed to request '%s'", optarg);
+    }
+
+    *pactive = active;
+    return result;
+}
+
+static void
+print_name(FILE *stream, const char *name)
+{
+    for (; *name; ++name) {
+        if (*name == '\\')
+            fputs("\\\\", stream);
+        else if (*name == '\n')
+            fputs("\\n", stream);
+        else
+            fputc(*name, stream);
+    }
+}
+
+static void
+print_result(FILE *stream, const char *algo, const char *para, const char *path,
+             size_t active, const char *result, unsigned long flags)
+{
+    const char *kind = flags & CSUM_QUICK ? " fingerprint" : "";
+    struct csum_algo *entry = csum_find(algo);
+    char quick[RESULT_SIZE + 1];
+
+    if (format != CSUM_FORMAT_TEXT) {
+        /* fingerprints keep their '~' mark, as with --zero */
+        if (flags & CSUM_QUICK) {
+            snprintf(quick, sizeof(quick), "~%s", result);
+            result = quick;
+        }
+
+        write_record(stream, &(struct csum_record) {
+            .algo = algo, .para = para, .path = path,
+            .result = result, .size = active,
+            .prefixed = record_prefixed(algo),
+        });
+    } else if (entry && entry->coreutils && !(flags & CSUM_QUICK)) {
+        /* same lines as the coreutils sum tools, names escaped alike */
+        if (flags & CSUM_ZERO)
+            fprintf(stream, "%s  %s%c", result, path, '\0');
+        else {
+            if (strpbrk(path, "\\\n"))
+                fputc('\\', stream);
+            fprintf(stream, "%s  ", result);
+            print_name(stream, path);
+            fputc('\n', stream);
+        }
+    } else if (flags & CSUM_ZERO)
+        fprintf(stream, "%s%s %lld %s", flags & CSUM_QUICK ? "~" : "",
+                result, (long long)active, path);
     else {
         if (para)
-            printf("%s [%s]: (%s %lld) = %s\n", algo, para,
-                    optarg, (long long)active, result);
+            fprintf(stream, "%s%s [%s]: (%s %lld) = %s\n", algo, kind, para,
+                    path, (long long)active, result);
         else
-            printf("%s: (%s %lld) = %s\n", algo,
-                    optarg, (long long)active, result);
+            fprintf(stream, "%s%s: (%s %lld) = %s\n", algo, kind,
+                    path, (long long)active, result);
+    }
+}
+
+/* parts are named joined with '+', the digest covers them in order */
+static char *
+concat_name(const char *const *paths, unsigned int count)
+{
+    size_t length = 0, used = 0;
+    unsigned int index;
+    char *name;
+
+    for (index = 0; index < count; ++index)
+        length += strlen(paths[index]) + 1;
+
+    if (!(name = malloc(length)))
+        err(ENOMEM, "failed to name '%s'", paths[0]);
+
+    for (index = 0; index < count; ++index) {
+        if (index)
+            name[used++] = '+';
+        used += sprintf(name + used, "%s", paths[index]);
+    }
+
+    return name;
+}
+
+/*
+ * Queues a small regular file for the many op of the algorithm,
+ * anything else is left to the one file at a time path.
+ */
+static void
+batch_done(struct csum_async_entry *entry, const char *result, int error)
+{
+    struct batch_context *batch = entry->pdata;
+    unsigned int index = entry - batch->entries;
+
+    batch->results[index] = result;
+    batch->errors[index] = error;
+}
+
+static void
+batch_drain(struct batch_context *batch, FILE *stream, const char *algo,
+            const char *para, unsigned long flags)
+{
+    struct csum_async_entry *entry;
+    unsigned int index;
+    int retval;
+
+    while (!csum_async_empty(&batch->async)) {
+        if ((retval = csum_async_dispatch(&batch->async, -1)) < 0) {
+            errno = -retval;
+            err(errno, "failed to wait for '%s'", batch->paths[0]);
+        }
+    }
+
+    for (index = 0; index < batch->count; ++index) {
+        entry = &batch->entries[index];
+        if (!batch->results[index]) {
+            errno = batch->errors[index] ? batch->errors[index] : EFAULT;
+            err(errno, "failed to read '%s'", batch->paths[index]);
+        }
+
+        print_result(stream, algo, para, batch->paths[index],
+                     entry->stream.sta.offset, batch->results[index], flags);
+        close(entry->fd);
+        csum_destroy(batch->ctxs[index]);
     }
+
+    /* every drained stream stopped on EAGAIN, that is no error */
+    csum_async_exit(&batch->async);
+    batch->streams = false;
+    errno = 0;
+    batch->count = 0;
+}
+
+static void
+batch_flush(struct batch_context *batch, FILE *stream, const char *algo,
+            const char *para, unsigned long flags)
+{
+    struct csum_linear *linear;
+    unsigned int index;
+
+    if (!batch->count)
+        return;
+
+    if (batch->streams) {
+        batch_drain(batch, stream, algo, para, flags);
+        return;
+    }
+
+    csum_linear_many(batch->ctxs, batch->linears, batch->results, batch->count);
+    for (index = 0; index < batch->count; ++index) {
+        linear = &batch->linears[index];
+        if (!batch->results[index]) {
+            errno = EFAULT;
+            err(errno, "failed to compute '%s'", batch->paths[index]);
+        }
+
+        print_result(stream, algo, para, batch->paths[index], linear->length,
+                     batch->results[index], flags);
+        munmap((void *)linear->data, linear->length);
+        csum_destroy(batch->ctxs[index]);
+    }
+
+    batch->count = 0;
+}
+
+/* pipes and sockets cannot be mapped, they are read as data arrives */
+static void
+batch_stream(struct batch_context *batch, FILE *stream, const char *algo,
+             const char *para, unsigned long flags, int handle)
+{
+    struct csum_async_entry *entry;
+    int retval;
+
+    if (!batch->streams)
+        batch_flush(batch, stream, algo, para, flags);
+
+    if (!batch->count && (retval = csum_async_init(&batch->async)) < 0) {
+        errno = -retval;
+        err(errno, "failed to watch '%s'", optarg);
+    }
+
+    entry = &batch->entries[batch->count];
+    entry->ctx = csum_prepare(algo, para, 0);
+    if (!entry->ctx) {
+        errno = EINVAL;
+        err(errno, "failed to prepare '%s'%s%s", algo,
+            csum_prepare_error() ? ": " : "",
+            csum_prepare_error() ?: "");
+    }
+
+    entry->done = batch_done;
+    entry->pdata = batch;
+    entry->fd = handle;
+
+    if ((retval = csum_async_add(&batch->async, entry)) < 0) {
+        errno = -retval;
+        err(errno, "failed to watch '%s'", optarg);
+    }
+
+    batch->ctxs[batch->count] = entry->ctx;
+    batch->paths[batch->count++] = optarg;
+    batch->streams = true;
+}
+
+static bool
+batch_queue(struct batch_context *batch, FILE *stream, const char *algo,
+            const char *para, unsigned long flags)
+{
+    struct csum_algo *entry;
+    struct stat stat;
+    void *mmaped;
+    int handle;
+
+    entry = csum_find(algo);
+    if (!entry || !strcmp(optarg, "-"))
+        return false;
+
+    if ((handle = open(optarg, O_RDONLY)) < 0)
+        return false;
+
+    if (fstat(handle, &stat) < 0) {
+        close(handle);
+        return false;
+    }
+
+    if (S_ISFIFO(stat.st_mode) || S_ISSOCK(stat.st_mode)) {
+        batch_stream(batch, stream, algo, para, flags, handle);
+        return true;
+    }
+
+    if (!entry->many || !S_ISREG(stat.st_mode) ||
+        !stat.st_size || stat.st_size > BATCH_SIZE) {
+        close(handle);
+        return false;
+    }
+
+    mmaped = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+    close(handle);
+    if (mmaped == MAP_FAILED)
+        return false;
+
+    if (batch->streams)
+        batch_flush(batch, stream, algo, para, flags);
+
+    batch->ctxs[batch->count] = csum_prepare(algo, para, 0);
+    if (!batch->ctxs[batch->count]) {
+        munmap(mmaped, stat.st_size);
+        return false;
+    }
+
+    batch->linears[batch->count].data = mmaped;
+    batch->linears[batch->count].length = stat.st_size;
+    batch->paths[batch->count++] = optarg;
+
+    return true;
+}
+
+static void
+select_impls(const char *drivers)
+{
+    char *buffer, *walk, *save;
+    int retval;
+
+    buffer = strdup(drivers);
+    if (!buffer)
+        err(ENOMEM, "failed to select implementations");
+
+    for (walk = strtok_r(buffer, ",", &save); walk;
+         walk = strtok_r(NULL, ",", &save)) {
+        if ((retval = csum_select(walk)) < 0) {
+            errno = -retval;
+            err(errno, "failed to select implementation '%s'", walk);
+        }
+    }
+
+    free(buffer);
+}
+
+static __bfdev_noreturn void
+list_impls(void)
+{
+    unsigned long features;
+    struct csum_algo *algo;
+    unsigned int bit;
+
+    printf("%-16s %-24s %-8s %s\n", "NAME", "DRIVER", "PRIORITY", "FEATURES");
+    bfdev_list_for_each_entry(algo, &csum_algos, list) {
+        features = algo->features;
+        printf("%-16s %-24s %-8d", algo->name, algo->driver, algo->priority);
+
+        if (!features)
+            printf(" -");
+        for (bit = 0; bit < __CSUM_CPU_NR; ++bit) {
+            if (features & BFDEV_BIT(bit))
+                printf(" %s", csum_cpu_name(bit));
+        }
+
+        if (csum_find(algo->name) == algo)
+            printf(" [active]");
+        else if (features & ~csum_cpu_features())
+            printf(" [unsupported]");
+        printf("\n");
+    }
+
+    exit(0);
 }
 
 static __bfdev_noreturn void
@@ -166,6 +910,7 @@ usage(void)
     fprintf(stderr, "\n");
 
     fprintf(stderr, "With no FILE, or when FILE is -, read standard input.\n");
+    fprintf(stderr, "Pipes and sockets among the FILEs are read together as data arrives.\n");
     fprintf(stderr, "  -v, --version            output version information and exit.\n");
     fprintf(stderr, "  -h, --help               display this help and exit.\n");
     fprintf(stderr, "\n");
@@ -173,6 +918,41 @@ usage(void)
     fprintf(stderr, "Mandatory arguments to long options are mandatory for short options too.\n");
     fprintf(stderr, "  -a, --algorithm=TYPE     select the digest type to use.  See DIGEST below.\n");
     fprintf(stderr, "  -p, --parameter=ARGS     algorithm private parameters.\n");
+    fprintf(stderr, "  -I, --impl=DRIVER[,...]  force the given implementations, see also $%s.\n", ENV_IMPL);
+    fprintf(stderr, "  -L, --list               list every implementation and exit.\n");
+    fprintf(stderr, "      --daemon=SOCKET      serve requests on unix socket <SOCKET>, -j sets workers.\n");
+    fprintf(stderr, "      --connect=SOCKET     compute whole files through the daemon at <SOCKET>.\n");
+    fprintf(stderr, "      --bench[=SIZE]       compare every implementation of the algorithm and exit.\n");
+    fprintf(stderr, "                           Kernel offload drivers (*-afalg) are preferred\n");
+    fprintf(stderr, "                           over tables but rank below the cpu instruction\n");
+    fprintf(stderr, "                           ones, -I picks one explicitly.\n");
+    fprintf(stderr, "      --selftest[=N]       check every implementation against check values and\n");
+    fprintf(stderr, "                           the plain C one over <N> random inputs, then exit.\n");
+    fprintf(stderr, "      --quick[=N]          print a fingerprint of the size, head, tail and\n");
+    fprintf(stderr, "                           <N> sampled blocks instead of a full checksum.\n");
+    fprintf(stderr, "      --dups               print groups of identical files found under the\n");
+    fprintf(stderr, "                           FILE and directory arguments, confirmed byte\n");
+    fprintf(stderr, "                           for byte once their checksums match.\n");
+    fprintf(stderr, "      --watch[=MS]         print the checksum of every file under the FILE\n");
+    fprintf(stderr, "                           and directory arguments, then stream one line\n");
+    fprintf(stderr, "                           per change once writes paused for <MS>. A file\n");
+    fprintf(stderr, "                           that grew and still ends its old data with the\n");
+    fprintf(stderr, "                           same bytes is hashed on from where it left off,\n");
+    fprintf(stderr, "                           so an in-place overwrite of earlier bytes made\n");
+    fprintf(stderr, "                           along with an append is not detected.\n");
+    fprintf(stderr, "      --append-only        with --watch, only resume on files the kernel\n");
+    fprintf(stderr, "                           keeps append-only (chattr +a), rehash the rest.\n");
+    fprintf(stderr, "      --concat             print one checksum of the FILE arguments joined in\n");
+    fprintf(stderr, "                           order, each part mapped and hashed in parallel.\n");
+    fprintf(stderr, "      --tee[=FILE]         copy the input to stdout and write the digest to\n");
+    fprintf(stderr, "                           <FILE>, or stderr by default.\n");
+    fprintf(stderr, "      --format=FORMAT      print results as 'text' (default), 'json', 'ndjson'\n");
+    fprintf(stderr, "                           or 'binary' records, --dups and --watch stay text.\n");
+    fprintf(stderr, "                           A json path that is not valid utf-8 has its bad\n");
+    fprintf(stderr, "                           bytes escaped as \\u00XX and the exact bytes in\n");
+    fprintf(stderr, "                           an extra \"path_b64\" field.\n");
+    fprintf(stderr, "      --stats[=FORMAT]     report per stage timing to stderr at exit,\n");
+    fprintf(stderr, "                           FORMAT is 'text' (default) or 'json'.\n");
     fprintf(stderr, "  -z, --zero               end each output line with NUL, not newline,\n");
     fprintf(stderr, "                           and disable file name escaping.\n");
     fprintf(stderr, "\n");
@@ -180,10 +960,17 @@ usage(void)
     fprintf(stderr, "The following options are only useful when verifying files\n");
     fprintf(stderr, "  -s, --seek=[+][-]OFFSET  start at <OFFSET> bytes abs. (or +: rel.) infile offset.\n");
     fprintf(stderr, "  -l, --len=SIZE           stop after <SIZE> octets.\n");
+    fprintf(stderr, "  -j, --jobs=NUM           read devices and ranges, or hash tree digests of\n");
+    fprintf(stderr, "                           mapped files, with <NUM> parallel workers.\n");
+    fprintf(stderr, "      --ranges=LIST        print one checksum per \"OFFSET LENGTH\" line of\n");
+    fprintf(stderr, "                           <LIST>, or standard input when LIST is -.\n");
     fprintf(stderr, "\n");
 
     fprintf(stderr, "DIGEST determines the digest algorithm and default output format:\n");
     bfdev_list_for_each_entry(algo, &csum_algos, list) {
+        if (csum_find(algo->name) != algo)
+            continue;
+
         if (algo->desc)
             fprintf(stderr, "  %-16s - %s\n", algo->name, algo->desc);
         else
@@ -198,6 +985,25 @@ usage(void)
     exit(1);
 }
 
+/* a model that fails its own check value is worth more than the help */
+static struct csum_context *
+prepare_context(const char *algo, const char *para)
+{
+    struct csum_context *ctx;
+    const char *reason;
+
+    ctx = csum_prepare(algo, para, 0);
+    if (ctx)
+        return ctx;
+
+    if ((reason = csum_prepare_error())) {
+        errno = EINVAL;
+        err(errno, "%s", reason);
+    }
+
+    usage();
+}
+
 static __bfdev_noreturn void
 version(void)
 {
@@ -210,14 +1016,35 @@ version(void)
 int main(int argc, char * const argv[])
 {
     const char *para = NULL, *algo = DEF_ALGO;
+    const char *daemon = NULL, *connect = NULL;
     struct csum_context *ctx = NULL;
+    struct csum_extent *extents = NULL;
+    struct batch_context batch = {};
+    struct csum_client client;
+    const char **paths = NULL;
+    unsigned int npaths = 0;
+    unsigned int nextents = 0;
+    unsigned int samples = DEF_SAMPLES;
+    unsigned int delay = DEF_WATCH;
+    FILE *output = stdout;
     unsigned long flags = 0;
+    bool computed = false;
+    unsigned int jobs = DEF_JOBS;
     size_t length = 0;
     off_t offset = 0;
-    int optidx;
+    const char *drivers;
+    int optidx, retval;
     char arg;
 
-    while ((arg = getopt_long(argc, argv, "-a:p:zs:l:vh", options, &optidx)) >= 0) {
+    atexit(exit_writer);
+    if ((drivers = getenv(ENV_IMPL)))
+        select_impls(drivers);
+
+    while ((arg = getopt_long(argc, argv, "-a:p:I:Lzs:l:j:vh", options, &optidx)) >= 0) {
+        /* queued files were named before this option took effect */
+        if (arg != '\1')
+            batch_flush(&batch, output, algo, para, flags);
+
         switch (arg) {
             case 'a':
                 algo = optarg;
@@ -227,6 +1054,23 @@ int main(int argc, char * const argv[])
                 para = optarg;
                 break;
 
+            case 'I':
+                select_impls(optarg);
+                break;
+
+            case 'L':
+                list_impls();
+
+            case 'S':
+                flags |= CSUM_STATS;
+                if (optarg && !strcmp(optarg, "json"))
+                    flags |= CSUM_STATS_JSON;
+                else if (optarg && strcmp(optarg, "text"))
+                    usage();
+                if (!csum_stats_enabled)
+                    csum_stats_enable();
+                break;
+
             case 'z':
                 flags |= CSUM_ZERO;
                 break;
@@ -239,6 +1083,87 @@ int main(int argc, char * const argv[])
                 length = (size_t)strtoull(optarg, NULL, 0);
                 break;
 
+            case 'j':
+                jobs = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'D':
+                daemon = optarg;
+                break;
+
+            case 'C':
+                if (connect)
+                    csum_client_close(&client);
+                connect = optarg;
+                if ((retval = csum_client_connect(&client, connect)) < 0) {
+                    errno = -retval;
+                    err(errno, "failed to connect '%s'", connect);
+                }
+                break;
+
+            case 'B':
+                length = optarg ? (size_t)strtoull(optarg, NULL, 0) : DEF_BENCH;
+                if ((retval = csum_bench(stdout, algo, para, length)) < 0) {
+                    errno = -retval;
+                    err(errno, "failed to bench '%s'", algo);
+                }
+                exit(0);
+
+            case 'E':
+                samples = optarg ? (unsigned int)strtoul(optarg, NULL, 0) : DEF_SELFTEST;
+                if ((retval = csum_selftest(stdout, samples)) < 0) {
+                    errno = -retval;
+                    err(errno, "self test failed");
+                }
+                exit(0);
+
+            case 'T':
+                flags |= CSUM_TEE;
+                close_writer();
+                if (output != stdout && output != stderr)
+                    fclose(output);
+                if (!optarg)
+                    output = stderr;
+                else if (!(output = fopen(optarg, "w")))
+                    err(errno, "failed to open '%s'", optarg);
+                break;
+
+            case 'R':
+                free(extents);
+                extents = load_extents(optarg, &nextents);
+                break;
+
+            case 'U':
+                flags |= CSUM_DUPS;
+                break;
+
+            case 'Q':
+                flags |= CSUM_QUICK;
+                if (optarg)
+                    samples = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'W':
+                flags |= CSUM_WATCH;
+                if (optarg)
+                    delay = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+
+            case 'N':
+                flags |= CSUM_CONCAT;
+                break;
+
+            case 'O':
+                flags |= CSUM_APPEND_ONLY;
+                break;
+
+            case 'F':
+                if ((retval = csum_format_parse(optarg)) < 0)
+                    usage();
+                close_writer();
+                format = retval;
+                break;
+
             case 'v':
                 version();
 
@@ -248,23 +1173,144 @@ int main(int argc, char * const argv[])
             compute: case '\1': {
                 const char *result;
                 size_t active;
+                off_t start;
 
-                ctx = csum_prepare(algo, para, 0);
-                if (!ctx)
-                    usage();
+                computed = true;
+                if (flags & (CSUM_DUPS | CSUM_WATCH | CSUM_CONCAT)) {
+                    const char **block;
+
+                    /* directories are walked once every path is known */
+                    block = realloc(paths, sizeof(*paths) * (npaths + 1));
+                    if (!block)
+                        err(ENOMEM, "failed to queue '%s'", optarg);
+                    paths = block;
+                    paths[npaths++] = optarg;
+                    break;
+                }
+
+                if (flags & CSUM_QUICK) {
+                    ctx = prepare_context(algo, para);
+
+                    result = do_quick(ctx, &active, samples);
+                    print_result(output, algo, para, optarg, active, result, flags);
+                    csum_destroy(ctx);
+                    break;
+                }
+
+                if (extents) {
+                    ctx = prepare_context(algo, para);
+
+                    do_extents(ctx, extents, nextents, jobs);
+                    print_extents(output, algo, para, extents, nextents, flags);
+                    csum_extents_release(extents, nextents);
+                    csum_destroy(ctx);
+                    break;
+                }
+
+                /* the daemon only takes whole inputs */
+                if (connect) {
+                    if (offset || length || (flags & CSUM_TEE))
+                        usage();
+
+                    result = do_request(&client, &active, algo, para);
+                    print_result(output, algo, para, optarg, active, result, flags);
+                    break;
+                }
 
-                result = do_compute(ctx, &active, offset, length);
-                print_result(algo, para, active, result, flags);
+                if (!(flags & CSUM_TEE) && !offset && !length &&
+                    batch_queue(&batch, output, algo, para, flags)) {
+                    if (batch.count == BATCH_FILES)
+                        batch_flush(&batch, output, algo, para, flags);
+                    break;
+                }
+
+                batch_flush(&batch, output, algo, para, flags);
+                ctx = prepare_context(algo, para);
+
+                start = offset;
+                result = do_compute(ctx, &active, &start, length, jobs,
+                                    flags & CSUM_TEE ? STDOUT_FILENO : -1);
+
+                /*
+                 * a ranged digest must not pass for a whole file line,
+                 * and records have to say where the range started
+                 */
+                if ((offset || length) && (format != CSUM_FORMAT_TEXT ||
+                                           csum_find(algo)->coreutils)) {
+                    struct csum_extent extent = {
+                        .offset = start, .length = active, .result = result,
+                    };
+                    print_extents(output, algo, para, &extent, 1, flags);
+                } else
+                    print_result(output, algo, para, optarg, active, result, flags);
                 csum_destroy(ctx);
                 break;
             }
         }
     }
 
-    if (!ctx) {
-        optarg = "-";
+    batch_flush(&batch, output, algo, para, flags);
+
+    if (daemon) {
+        retval = csum_daemon_serve(daemon, jobs);
+        errno = -retval;
+        err(errno, "failed to serve '%s'", daemon);
+    }
+
+    if (!computed && (flags & CSUM_CONCAT))
+        usage();
+
+    if (!computed) {
+        optarg = flags & (CSUM_DUPS | CSUM_WATCH) ? "." : "-";
         goto compute;
     }
 
+    if (flags & CSUM_CONCAT) {
+        struct csum_state sta;
+        const char *result;
+        unsigned int failed;
+        char *name;
+
+        ctx = prepare_context(algo, para);
+
+        result = csum_concat_compute(ctx, &sta, paths, npaths, jobs, &failed);
+        if (!result)
+            err(errno, "failed to concatenate '%s'", paths[failed]);
+
+        name = concat_name(paths, npaths);
+        print_result(output, algo, para, name, sta.offset, result, flags);
+        csum_destroy(ctx);
+        free(paths);
+        free(name);
+    }
+
+    if (flags & CSUM_DUPS) {
+        retval = csum_dups(output, algo, para, paths, npaths, jobs);
+        if (retval < 0) {
+            errno = -retval;
+            err(errno, "failed to find duplicates");
+        }
+        free(paths);
+    }
+
+    if (flags & CSUM_WATCH) {
+        /* only returns once watching failed */
+        retval = csum_watch(output, algo, para, paths, npaths, delay,
+                            !!(flags & CSUM_APPEND_ONLY));
+        errno = -retval;
+        err(errno, "failed to watch");
+    }
+
+    if (connect)
+        csum_client_close(&client);
+
+    free(extents);
+    close_writer();
+    if (output != stdout && output != stderr)
+        fclose(output);
+
+    if (flags & CSUM_STATS)
+        csum_stats_report(stderr, !!(flags & CSUM_STATS_JSON));
+
     return 0;
 }
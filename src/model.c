@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <string.h>
+#include <model.h>
+#include <bfdev/bits.h>
+
+#define MODEL_VERIFY 1024
+
+static inline uint64_t
+model_mask(unsigned int width)
+{
+    if (width >= BFDEV_BITS_PER_U64)
+        return UINT64_MAX;
+    return BFDEV_BIT_ULL(width) - 1;
+}
+
+static uint64_t
+model_reverse(uint64_t value, unsigned int width)
+{
+    uint64_t result = 0;
+
+    while (width--) {
+        result = (result << 1) | (value & 1);
+        value >>= 1;
+    }
+
+    return result;
+}
+
+static inline uint64_t
+model_load_le(const uint8_t *data)
+{
+    uint64_t value;
+
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+
+    return value;
+}
+
+static inline uint64_t
+model_load_be(const uint8_t *data)
+{
+    uint64_t value;
+
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+
+    return value;
+}
+
+static uint64_t
+model_reflect_update(const struct crc_model *model, uint64_t crc,
+                     const uint8_t *data, size_t length)
+{
+    const uint64_t (*table)[256] = model->table;
+
+    while (length && ((uintptr_t)data & 7)) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+        length--;
+    }
+
+    while (length >= 8) {
+        crc ^= model_load_le(data);
+        crc = table[7][crc & 0xff] ^ table[6][(crc >> 8) & 0xff] ^
+              table[5][(crc >> 16) & 0xff] ^ table[4][(crc >> 24) & 0xff] ^
+              table[3][(crc >> 32) & 0xff] ^ table[2][(crc >> 40) & 0xff] ^
+              table[1][(crc >> 48) & 0xff] ^ table[0][crc >> 56];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--)
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+
+    return crc;
+}
+
+static uint64_t
+model_normal_update(const struct crc_model *model, uint64_t crc,
+                    const uint8_t *data, size_t length)
+{
+    const uint64_t (*table)[256] = model->table;
+
+    while (length && ((uintptr_t)data & 7)) {
+        crc = (crc << 8) ^ table[0][(crc >> 56) ^ *data++];
+        length--;
+    }
+
+    while (length >= 8) {
+        crc ^= model_load_be(data);
+        crc = table[7][crc >> 56] ^ table[6][(crc >> 48) & 0xff] ^
+              table[5][(crc >> 40) & 0xff] ^ table[4][(crc >> 32) & 0xff] ^
+              table[3][(crc >> 24) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^
+              table[1][(crc >> 8) & 0xff] ^ table[0][crc & 0xff];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--)
+        crc = (crc << 8) ^ table[0][(crc >> 56) ^ *data++];
+
+    return crc;
+}
+
+uint64_t
+crc_model_table(const struct crc_model *model, uint64_t crc,
+                const void *data, size_t length)
+{
+    unsigned int shift;
+
+    crc &= model_mask(model->width);
+    if (model->reflect)
+        return model_reflect_update(model, crc, data, length);
+
+    /* the normal register is kept msb aligned in 64 bits */
+    shift = BFDEV_BITS_PER_U64 - model->width;
+    crc = model_normal_update(model, crc << shift, data, length);
+
+    return crc >> shift;
+}
+
+static void
+model_table_init(struct crc_model *model)
+{
+    unsigned int shift, count, bit;
+    uint64_t poly, value;
+
+    if (model->reflect) {
+        poly = model_reverse(model->poly, model->width);
+        for (count = 0; count < 256; ++count) {
+            value = count;
+            for (bit = 0; bit < BFDEV_BITS_PER_U8; ++bit)
+                value = (value & 1) ? (value >> 1) ^ poly : value >> 1;
+            model->table[0][count] = value;
+        }
+    } else {
+        shift = BFDEV_BITS_PER_U64 - model->width;
+        poly = model->poly << shift;
+        for (count = 0; count < 256; ++count) {
+            value = (uint64_t)count << 56;
+            for (bit = 0; bit < BFDEV_BITS_PER_U8; ++bit)
+                value = (value >> 63) ? (value << 1) ^ poly : value << 1;
+            model->table[0][count] = value;
+        }
+    }
+
+    for (count = 0; count < 256; ++count) {
+        for (bit = 1; bit < 8; ++bit) {
+            value = model->table[bit - 1][count];
+            if (model->reflect)
+                value = (value >> 8) ^ model->table[0][value & 0xff];
+            else
+                value = (value << 8) ^ model->table[0][value >> 56];
+            model->table[bit][count] = value;
+        }
+    }
+}
+
+/*
+ * Folding constants are residues of x^n modulo the msb aligned
+ * generator G = (x^width + poly) * x^(64 - width), which keeps every
+ * constant within one 64 bit lane for all widths.
+ */
+static uint64_t
+model_xpow(const struct crc_model *model, unsigned int power)
+{
+    uint64_t poly, value = 1;
+
+    poly = model->poly << (BFDEV_BITS_PER_U64 - model->width);
+    while (power--)
+        value = (value >> 63) ? (value << 1) ^ poly : value << 1;
+
+    return value;
+}
+
+static void
+model_fold_init(struct crc_model *model)
+{
+    static const unsigned int distance[CRC_FOLD_NR] = {
+        [CRC_FOLD_128] = 128,
+        [CRC_FOLD_512] = 512,
+        [CRC_FOLD_2048] = 2048,
+    };
+    unsigned int count, bits;
+
+    for (count = 0; count < CRC_FOLD_NR; ++count) {
+        bits = distance[count];
+        if (model->reflect) {
+            /* reflected products come out multiplied by an extra x */
+            model->fold[count][0] = model_reverse(model_xpow(model, bits + 63), 64);
+            model->fold[count][1] = model_reverse(model_xpow(model, bits - 1), 64);
+        } else {
+            model->fold[count][0] = model_xpow(model, bits);
+            model->fold[count][1] = model_xpow(model, bits + 64);
+        }
+    }
+}
+
+void
+crc_model_init(struct crc_model *model, unsigned int width,
+               uint64_t poly, bool reflect)
+{
+    model->width = width;
+    model->poly = poly & model_mask(width);
+    model->reflect = reflect;
+    model->update = crc_model_table;
+
+    model_table_init(model);
+    model_fold_init(model);
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("vpclmulqdq"))
+        model->update = crc_model_vpclmul;
+    else if (__builtin_cpu_supports("pclmul") &&
+             __builtin_cpu_supports("sse4.1"))
+        model->update = crc_model_pclmul;
+#endif
+}
+
+uint64_t
+crc_narrow_update(const struct crc_narrow *narrow, uint64_t crc,
+                  const void *data, size_t length)
+{
+    const uint8_t (*table)[256] = narrow->table;
+    const uint8_t *walk = data;
+    uint8_t value = crc & narrow->mask;
+
+    while (length >= 8) {
+        value = narrow->state[value] ^
+                table[0][walk[0]] ^ table[1][walk[1]] ^
+                table[2][walk[2]] ^ table[3][walk[3]] ^
+                table[4][walk[4]] ^ table[5][walk[5]] ^
+                table[6][walk[6]] ^ table[7][walk[7]];
+        walk += 8;
+        length -= 8;
+    }
+
+    while (length--)
+        value = narrow->shift[value] ^ narrow->byte[*walk++];
+
+    return value;
+}
+
+/*
+ * Narrow registers do not need the polynomial: the update is affine in
+ * both the register and the message, so the tables are sampled from the
+ * reference implementation itself and stay bit exact with it whatever
+ * bit order it uses.
+ */
+void
+crc_narrow_init(struct crc_narrow *narrow, unsigned int width,
+                uint64_t (*reference)(uint64_t crc, const void *data, size_t length))
+{
+    uint8_t slice[8] = { };
+    unsigned int count, index;
+    uint64_t single, eight;
+
+    narrow->mask = model_mask(width);
+    single = reference(0, slice, 1);
+    eight = reference(0, slice, 8);
+
+    for (count = 0; count <= narrow->mask; ++count) {
+        narrow->state[count] = reference(count, slice, 8);
+        narrow->shift[count] = reference(count, slice, 1);
+    }
+
+    for (count = 0; count < 256; ++count) {
+        slice[0] = count;
+        narrow->byte[count] = reference(0, slice, 1) ^ single;
+        slice[0] = 0;
+
+        for (index = 0; index < 8; ++index) {
+            slice[index] = count;
+            narrow->table[index][count] = reference(0, slice, 8) ^ eight;
+            slice[index] = 0;
+        }
+    }
+}
+
+bool
+crc_model_verify(uint64_t (*update)(uint64_t crc, const void *data, size_t length),
+                 uint64_t (*reference)(uint64_t crc, const void *data, size_t length),
+                 unsigned int width)
+{
+    static const size_t lengths[] = {
+        0, 1, 7, 15, 16, 17, 63, 64, 65, 255,
+        256, 257, 511, 512, 1000, MODEL_VERIFY - 1,
+    };
+    uint8_t buffer[MODEL_VERIFY + 1];
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    unsigned int count;
+    uint64_t crc;
+
+    for (count = 0; count < sizeof(buffer); ++count) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        buffer[count] = seed >> 56;
+    }
+
+    for (count = 0; count < sizeof(lengths) / sizeof(*lengths); ++count) {
+        crc = (seed >> count) & model_mask(width);
+        if (update(crc, buffer + (count & 1), lengths[count]) !=
+            reference(crc, buffer + (count & 1), lengths[count]))
+            return false;
+    }
+
+    return true;
+}
+
+void
+crc_impl_unregister(struct crc_impl *impls, unsigned int count)
+{
+    while (count--) {
+        if (!impls[count].registered)
+            continue;
+
+        csum_unregister(&impls[count].algo);
+        impls[count].registered = false;
+    }
+}
+
+/*
+ * The first entry is the reference implementation. Every other entry
+ * that can run on this cpu must agree with it before it is offered,
+ * entries needing missing cpu features are listed but never picked,
+ * and entries whose probe fails are left out entirely.
+ */
+int
+crc_impl_register(struct crc_impl *impls, unsigned int count,
+                  const struct csum_algo *template, unsigned int width)
+{
+    struct crc_impl *impl;
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < count; ++index) {
+        impl = &impls[index];
+        impl->algo.name = template->name;
+        impl->algo.desc = template->desc;
+        impl->algo.prepare = template->prepare;
+        impl->algo.destroy = template->destroy;
+        impl->algo.reset = template->reset;
+        impl->algo.compute = template->compute;
+        impl->algo.linear = template->linear;
+        impl->algo.combine = template->combine;
+        impl->algo.zeros = template->zeros;
+
+        if (impl->probe && impl->probe(impl))
+            continue;
+
+        if (index && !(impl->algo.features & ~csum_cpu_features()) &&
+            !crc_model_verify(impl->update, impls->update, width))
+            continue;
+
+        retval = csum_register(&impl->algo);
+        if (retval) {
+            crc_impl_unregister(impls, index);
+            return retval;
+        }
+
+        impl->registered = true;
+    }
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <model.h>
+#include <bfdev/compiler.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <bfdev/bits.h>
+
+#define PCLMUL_TARGET __attribute__((target("pclmul,sse4.1,ssse3")))
+#define VPCLMUL_TARGET __attribute__((target("pclmul,sse4.1,ssse3,avx2,avx512f,avx512bw,vpclmulqdq")))
+
+/*
+ * Both bit orders share one folding step: the 128 bit accumulator is
+ * split into two 64 bit halves which are multiplied by their own fold
+ * constant. Normal crcs byte swap every block so the first message byte
+ * lands in the most significant position, reflected crcs use the
+ * natural little endian layout. The final 16 bytes are handed back to
+ * the table engine, which also takes care of any unaligned tail.
+ */
+
+static PCLMUL_TARGET __always_inline __m128i
+pclmul_fold(__m128i value, __m128i konst)
+{
+    return _mm_xor_si128(
+        _mm_clmulepi64_si128(value, konst, 0x00),
+        _mm_clmulepi64_si128(value, konst, 0x11)
+    );
+}
+
+static PCLMUL_TARGET __always_inline __m128i
+pclmul_load(const uint8_t *data, __m128i shuffle, bool reflect)
+{
+    __m128i value;
+
+    value = _mm_loadu_si128((const __m128i *)data);
+    if (!reflect)
+        value = _mm_shuffle_epi8(value, shuffle);
+
+    return value;
+}
+
+static PCLMUL_TARGET __always_inline __m128i
+pclmul_seed(const struct crc_model *model, uint64_t crc, bool reflect)
+{
+    if (reflect) {
+        crc &= UINT64_MAX >> (BFDEV_BITS_PER_U64 - model->width);
+        return _mm_cvtsi64_si128(crc);
+    }
+
+    crc <<= BFDEV_BITS_PER_U64 - model->width;
+    return _mm_insert_epi64(_mm_setzero_si128(), crc, 1);
+}
+
+static PCLMUL_TARGET __always_inline uint64_t
+pclmul_finish(const struct crc_model *model, __m128i value, __m128i shuffle,
+              const uint8_t *data, size_t length, bool reflect)
+{
+    uint8_t block[16];
+    uint64_t crc;
+
+    if (!reflect)
+        value = _mm_shuffle_epi8(value, shuffle);
+    _mm_storeu_si128((__m128i *)block, value);
+
+    crc = crc_model_table(model, 0, block, sizeof(block));
+    return crc_model_table(model, crc, data, length);
+}
+
+static PCLMUL_TARGET __always_inline uint64_t
+pclmul_update(const struct crc_model *model, uint64_t crc,
+              const uint8_t *data, size_t length, bool reflect)
+{
+    __m128i x0, x1, x2, x3, k128, k512, shuffle;
+
+    if (length < 16)
+        return crc_model_table(model, crc, data, length);
+
+    shuffle = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    k128 = _mm_loadu_si128((const __m128i *)model->fold[CRC_FOLD_128]);
+    k512 = _mm_loadu_si128((const __m128i *)model->fold[CRC_FOLD_512]);
+
+    x0 = pclmul_load(data, shuffle, reflect);
+    x0 = _mm_xor_si128(x0, pclmul_seed(model, crc, reflect));
+    data += 16;
+    length -= 16;
+
+    if (length >= 48) {
+        x1 = pclmul_load(data, shuffle, reflect);
+        x2 = pclmul_load(data + 16, shuffle, reflect);
+        x3 = pclmul_load(data + 32, shuffle, reflect);
+        data += 48;
+        length -= 48;
+
+        while (length >= 64) {
+            x0 = _mm_xor_si128(pclmul_fold(x0, k512), pclmul_load(data, shuffle, reflect));
+            x1 = _mm_xor_si128(pclmul_fold(x1, k512), pclmul_load(data + 16, shuffle, reflect));
+            x2 = _mm_xor_si128(pclmul_fold(x2, k512), pclmul_load(data + 32, shuffle, reflect));
+            x3 = _mm_xor_si128(pclmul_fold(x3, k512), pclmul_load(data + 48, shuffle, reflect));
+            data += 64;
+            length -= 64;
+        }
+
+        x1 = _mm_xor_si128(x1, pclmul_fold(x0, k128));
+        x2 = _mm_xor_si128(x2, pclmul_fold(x1, k128));
+        x0 = _mm_xor_si128(x3, pclmul_fold(x2, k128));
+    }
+
+    while (length >= 16) {
+        x0 = _mm_xor_si128(pclmul_fold(x0, k128), pclmul_load(data, shuffle, reflect));
+        data += 16;
+        length -= 16;
+    }
+
+    return pclmul_finish(model, x0, shuffle, data, length, reflect);
+}
+
+static PCLMUL_TARGET uint64_t
+pclmul_reflect(const struct crc_model *model, uint64_t crc,
+               const uint8_t *data, size_t length)
+{
+    return pclmul_update(model, crc, data, length, true);
+}
+
+static PCLMUL_TARGET uint64_t
+pclmul_normal(const struct crc_model *model, uint64_t crc,
+              const uint8_t *data, size_t length)
+{
+    return pclmul_update(model, crc, data, length, false);
+}
+
+uint64_t
+crc_model_pclmul(const struct crc_model *model, uint64_t crc,
+                 const void *data, size_t length)
+{
+    if (model->reflect)
+        return pclmul_reflect(model, crc, data, length);
+    return pclmul_normal(model, crc, data, length);
+}
+
+static VPCLMUL_TARGET __always_inline __m512i
+vpclmul_fold(__m512i value, __m512i konst)
+{
+    return _mm512_xor_si512(
+        _mm512_clmulepi64_epi128(value, konst, 0x00),
+        _mm512_clmulepi64_epi128(value, konst, 0x11)
+    );
+}
+
+static VPCLMUL_TARGET __always_inline __m512i
+vpclmul_load(const uint8_t *data, __m512i shuffle, bool reflect)
+{
+    __m512i value;
+
+    value = _mm512_loadu_si512((const void *)data);
+    if (!reflect)
+        value = _mm512_shuffle_epi8(value, shuffle);
+
+    return value;
+}
+
+static VPCLMUL_TARGET __always_inline uint64_t
+vpclmul_update(const struct crc_model *model, uint64_t crc,
+               const uint8_t *data, size_t length, bool reflect)
+{
+    __m512i z0, z1, z2, z3, k512, k2048, shuffle;
+    __m128i x0, k128, lanes[4];
+    unsigned int count;
+
+    if (length < 256)
+        return pclmul_update(model, crc, data, length, reflect);
+
+    shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    k128 = _mm_loadu_si128((const __m128i *)model->fold[CRC_FOLD_128]);
+    k512 = _mm512_broadcast_i32x4(_mm_loadu_si128(
+        (const __m128i *)model->fold[CRC_FOLD_512]));
+    k2048 = _mm512_broadcast_i32x4(_mm_loadu_si128(
+        (const __m128i *)model->fold[CRC_FOLD_2048]));
+
+    z0 = vpclmul_load(data, shuffle, reflect);
+    z0 = _mm512_xor_si512(z0, _mm512_zextsi128_si512(pclmul_seed(model, crc, reflect)));
+    z1 = vpclmul_load(data + 64, shuffle, reflect);
+    z2 = vpclmul_load(data + 128, shuffle, reflect);
+    z3 = vpclmul_load(data + 192, shuffle, reflect);
+    data += 256;
+    length -= 256;
+
+    while (length >= 256) {
+        z0 = _mm512_xor_si512(vpclmul_fold(z0, k2048), vpclmul_load(data, shuffle, reflect));
+        z1 = _mm512_xor_si512(vpclmul_fold(z1, k2048), vpclmul_load(data + 64, shuffle, reflect));
+        z2 = _mm512_xor_si512(vpclmul_fold(z2, k2048), vpclmul_load(data + 128, shuffle, reflect));
+        z3 = _mm512_xor_si512(vpclmul_fold(z3, k2048), vpclmul_load(data + 192, shuffle, reflect));
+        data += 256;
+        length -= 256;
+    }
+
+    z1 = _mm512_xor_si512(z1, vpclmul_fold(z0, k512));
+    z2 = _mm512_xor_si512(z2, vpclmul_fold(z1, k512));
+    z0 = _mm512_xor_si512(z3, vpclmul_fold(z2, k512));
+
+    while (length >= 64) {
+        z0 = _mm512_xor_si512(vpclmul_fold(z0, k512), vpclmul_load(data, shuffle, reflect));
+        data += 64;
+        length -= 64;
+    }
+
+    lanes[0] = _mm512_extracti32x4_epi32(z0, 0);
+    lanes[1] = _mm512_extracti32x4_epi32(z0, 1);
+    lanes[2] = _mm512_extracti32x4_epi32(z0, 2);
+    lanes[3] = _mm512_extracti32x4_epi32(z0, 3);
+
+    x0 = lanes[0];
+    for (count = 1; count < 4; ++count)
+        x0 = _mm_xor_si128(lanes[count], pclmul_fold(x0, k128));
+
+    while (length >= 16) {
+        x0 = _mm_xor_si128(pclmul_fold(x0, k128), pclmul_load(data,
+                           _mm512_castsi512_si128(shuffle), reflect));
+        data += 16;
+        length -= 16;
+    }
+
+    return pclmul_finish(model, x0, _mm512_castsi512_si128(shuffle),
+                         data, length, reflect);
+}
+
+static VPCLMUL_TARGET uint64_t
+vpclmul_reflect(const struct crc_model *model, uint64_t crc,
+                const uint8_t *data, size_t length)
+{
+    return vpclmul_update(model, crc, data, length, true);
+}
+
+static VPCLMUL_TARGET uint64_t
+vpclmul_normal(const struct crc_model *model, uint64_t crc,
+               const uint8_t *data, size_t length)
+{
+    return vpclmul_update(model, crc, data, length, false);
+}
+
+uint64_t
+crc_model_vpclmul(const struct crc_model *model, uint64_t crc,
+                  const void *data, size_t length)
+{
+    if (model->reflect)
+        return vpclmul_reflect(model, crc, data, length);
+    return vpclmul_normal(model, crc, data, length);
+}
+
+#else /* !__x86_64__ */
+
+uint64_t
+crc_model_pclmul(const struct crc_model *model, uint64_t crc,
+                 const void *data, size_t length)
+{
+    return crc_model_table(model, crc, data, length);
+}
+
+uint64_t
+crc_model_vpclmul(const struct crc_model *model, uint64_t crc,
+                  const void *data, size_t length)
+{
+    return crc_model_table(model, crc, data, length);
+}
+
+#endif /* __x86_64__ */
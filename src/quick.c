@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <unistd.h>
+#include <csum.h>
+#include <bfdev/minmax.h>
+
+#define QUICK_BLOCK 0x1000
+
+/*
+ * A fingerprint is the checksum of the little endian size followed by
+ * the head block, the sample blocks and the tail block, in file order.
+ * Samples sit at evenly spaced block aligned offsets, so the same file
+ * always yields the same reads. Small files are taken whole.
+ */
+static int
+quick_feed(struct csum_context *ctx, struct csum_stream *stream, int fd,
+           const uint8_t *data, uint64_t offset, size_t length)
+{
+    uint8_t buffer[QUICK_BLOCK];
+    ssize_t retval;
+
+    if (data) {
+        csum_stream_update(ctx, stream, data + offset, length);
+        return 0;
+    }
+
+    while (length) {
+        retval = pread(fd, buffer, bfdev_min(length, sizeof(buffer)), offset);
+        if (retval <= 0)
+            return retval ? -errno : -EIO;
+
+        csum_stream_update(ctx, stream, buffer, retval);
+        offset += retval;
+        length -= retval;
+    }
+
+    return 0;
+}
+
+const char *
+csum_quick_compute(struct csum_context *ctx, int fd, const void *data,
+                   uint64_t size, unsigned int samples)
+{
+    uint64_t offset, next, stride, prefix = size;
+    uint8_t header[sizeof(size)];
+    struct csum_stream stream;
+    unsigned int count;
+    int retval;
+
+    for (count = 0; count < sizeof(header); ++count) {
+        header[count] = prefix;
+        prefix >>= 8;
+    }
+
+    csum_stream_init(ctx, &stream);
+    csum_stream_update(ctx, &stream, header, sizeof(header));
+
+    if (size <= (uint64_t)(samples + 2) * QUICK_BLOCK) {
+        retval = quick_feed(ctx, &stream, fd, data, 0, size);
+        goto finish;
+    }
+
+    retval = quick_feed(ctx, &stream, fd, data, 0, QUICK_BLOCK);
+    stride = (size - QUICK_BLOCK) / (samples + 1);
+
+    for (count = 1, offset = QUICK_BLOCK; !retval && count <= samples; ++count) {
+        next = stride * count;
+        next -= next % QUICK_BLOCK;
+        if (next < offset)
+            continue;
+
+        retval = quick_feed(ctx, &stream, fd, data, next, QUICK_BLOCK);
+        offset = next + QUICK_BLOCK;
+    }
+
+    if (!retval) {
+        next = bfdev_max(size - QUICK_BLOCK, offset);
+        retval = quick_feed(ctx, &stream, fd, data, next, size - next);
+    }
+
+finish:
+    if (retval) {
+        errno = -retval;
+        return NULL;
+    }
+
+    return csum_stream_final(ctx, &stream);
+}
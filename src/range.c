@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define RANGE_BUFFER 0x100000
+#define RANGE_MINIMUM 0x400000
+#define RANGE_JOBS 64
+
+struct range_context {
+    struct csum_context *ctx;
+    struct csum_state sta;
+    pthread_t thread;
+    const char *result;
+    void *buffer;
+    size_t size;
+    size_t align;
+    uint64_t offset;
+    uint64_t length;
+    int error;
+    int fd;
+};
+
+static size_t
+range_next_block(struct csum_context *ctx, struct csum_state *sta,
+                 uintptr_t consumed, const void **dest)
+{
+    struct range_context *range = sta->pdata;
+    uint64_t offset;
+    ssize_t retval;
+    size_t size;
+
+    if (bfdev_unlikely(consumed >= range->length))
+        return 0;
+
+    /* keep every read after the first one on a logical block boundary */
+    offset = range->offset + consumed;
+    size = range->size - offset % range->align;
+    bfdev_min_adj(size, range->length - consumed);
+
+    retval = pread(range->fd, range->buffer, size, offset);
+    if (bfdev_unlikely(retval <= 0)) {
+        range->error = retval ? errno : EIO;
+        return 0;
+    }
+
+    *dest = range->buffer;
+    return retval;
+}
+
+static size_t
+range_empty_block(struct csum_context *ctx, struct csum_state *sta,
+                  uintptr_t consumed, const void **dest)
+{
+    return 0;
+}
+
+static void *
+range_worker(void *pdata)
+{
+    struct range_context *range = pdata;
+
+    range->sta.pdata = range;
+    range->ctx->next_block = range_next_block;
+    range->result = csum_compute(range->ctx, &range->sta);
+
+    return NULL;
+}
+
+static int
+range_prepare(struct range_context *range, struct csum_context *ctx)
+{
+    int retval;
+
+    if (!ctx)
+        return -ENOMEM;
+
+    range->ctx = ctx;
+    range->size = RANGE_BUFFER - RANGE_BUFFER % range->align;
+    if (!range->size)
+        range->size = range->align;
+
+    retval = posix_memalign(&range->buffer, range->align, range->size);
+    if (retval)
+        return -retval;
+
+    return 0;
+}
+
+const char *
+csum_range_compute(struct csum_context *ctx, struct csum_state *sta, int fd,
+                   uint64_t offset, uint64_t length, size_t align, unsigned int jobs)
+{
+    struct range_context *ranges;
+    const char *result = NULL;
+    uint64_t start, end, part;
+    unsigned int count;
+    int retval = 0;
+
+    if (!align)
+        align = 1;
+
+    if (!ctx->algo->combine)
+        jobs = 1;
+
+    bfdev_min_adj(jobs, RANGE_JOBS);
+    bfdev_min_adj(jobs, length / RANGE_MINIMUM + 1);
+    if (!jobs)
+        jobs = 1;
+
+    ranges = bfdev_zalloc(NULL, sizeof(*ranges) * jobs);
+    if (bfdev_unlikely(!ranges)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* split on absolute logical block boundaries of the device */
+    part = length / jobs;
+    start = offset;
+
+    for (count = 0; count < jobs; ++count) {
+        struct range_context *range = &ranges[count];
+
+        if (count == jobs - 1)
+            end = offset + length;
+        else {
+            end = offset + part * (count + 1);
+            end -= end % align;
+            bfdev_max_adj(end, start);
+        }
+
+        range->fd = fd;
+        range->align = align;
+        range->offset = start;
+        range->length = end - start;
+        start = end;
+
+        retval = range_prepare(range, count ? csum_clone(ctx) : ctx);
+        if (retval)
+            goto failed;
+    }
+
+    for (count = 1; count < jobs; ++count) {
+        retval = -pthread_create(&ranges[count].thread, NULL,
+                                 range_worker, &ranges[count]);
+        if (retval)
+            break;
+    }
+
+    range_worker(&ranges[0]);
+    while (--count)
+        pthread_join(ranges[count].thread, NULL);
+
+    if (retval)
+        goto failed;
+
+    for (count = 0; count < jobs; ++count) {
+        if (ranges[count].error || !ranges[count].result) {
+            retval = ranges[count].error ? -ranges[count].error : -EFAULT;
+            goto failed;
+        }
+    }
+
+    *sta = ranges[0].sta;
+    for (count = 1; count < jobs; ++count)
+        csum_combine(ctx, sta, ranges[count].ctx, &ranges[count].sta);
+
+    ctx->next_block = range_empty_block;
+    result = csum_next(ctx, sta);
+
+failed:
+    for (count = 0; count < jobs; ++count) {
+        if (count && ranges[count].ctx)
+            csum_destroy(ranges[count].ctx);
+        free(ranges[count].buffer);
+    }
+
+    bfdev_free(NULL, ranges);
+    errno = -retval;
+
+    return result;
+}
@@ -0,0 +1,648 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <csum.h>
+#include <async.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define SELFTEST_SIZE 0x10000
+#define SELFTEST_ALIGN 64
+#define SELFTEST_CUTS 4
+#define SELFTEST_MANY 4096
+#define SELFTEST_RESULT 256
+#define SELFTEST_CHECK "123456789"
+#define SELFTEST_PACKET 1500
+#define SELFTEST_FIELD 16
+#define SELFTEST_ADJUST 64
+
+/*
+ * Every driver is held against the check value of its algorithm and
+ * against the plain C driver of the same algorithm, the lowest one from
+ * the generic priority up; kernel fallbacks rank below it but are
+ * drivers under test like any other. Inputs come at random lengths and alignments, and
+ * are fed whole, in random pieces, resumed in stages, in two combined
+ * halves, padded with zeros, in many rounds and through pipes. inet
+ * drivers also have to agree with csum_inet_adjust() on rewritten
+ * fields.
+ */
+struct selftest_vector {
+    const char *name;
+    const char *check;
+};
+
+/* @data holds the stream from offset @base on */
+struct selftest_feed {
+    const uint8_t *data;
+    size_t base;
+    size_t limit;
+    uint64_t seed;
+};
+
+struct selftest_pipe {
+    struct csum_async_entry entry;
+    const uint8_t *data;
+    const char *result;
+    size_t length;
+    size_t written;
+    int input;
+};
+
+struct selftest {
+    struct csum_algo *ref;
+    struct csum_algo *impl;
+    const char *failed;
+    size_t length;
+    uint64_t seed;
+};
+
+static const struct selftest_vector
+selftest_vectors[] = {
+    {"adler32", "0x091e01de"},
+    {"blake3", "b7d65b48420d1033cb2595293263b6f72eabee20d55e699d0df1973b3c9deed1"},
+    {"crc", "0xcbf43926"},
+    {"crc-ccitt", "0x2189"},
+    {"crc-itut", "0x31c3"},
+    {"crc-rocksoft", "0xae8b14860a799888"},
+    {"crc-t10dif", "0xd0db"},
+    {"crc16", "0xbb3d"},
+    {"crc32", "0x2dfd2d88"},
+    {"crc4", "0x2"},
+    {"crc64", "0x6c40df5f0b497347"},
+    {"crc7", "0xea"},
+    {"crc8", "0xf4"},
+    {"fletcher16", "0x1ede"},
+    {"fletcher32", "0xdf09d509"},
+    {"fletcher64", "0x0d0803376c6a689f"},
+    {"inet", "0xf62a"},
+    {"sha1", "f7c3bc1d808e04732adf679965ccc34ca7ae3441"},
+    {"sha256", "15e2b0d3c33891ebb0f1ef609ec419420c20e320ce94c65fbc8c3312448eb225"},
+    {"xxh128", "0x33119477ede5dcd5e9716427681d5860"},
+    {"xxh3", "0x72dcb18b67a17dff"},
+};
+
+static inline uint64_t
+selftest_random(uint64_t *seed)
+{
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed >> 33;
+}
+
+static size_t
+selftest_next_block(struct csum_context *ctx, struct csum_state *sta,
+                    uintptr_t consumed, const void **dest)
+{
+    struct selftest_feed *feed = sta->pdata;
+
+    if (consumed >= feed->limit)
+        return 0;
+
+    *dest = feed->data + (consumed - feed->base);
+    return 1 + selftest_random(&feed->seed) % (feed->limit - consumed);
+}
+
+static size_t
+selftest_empty_block(struct csum_context *ctx, struct csum_state *sta,
+                     uintptr_t consumed, const void **dest)
+{
+    return 0;
+}
+
+static void
+selftest_fail(struct selftest *test, const char *what)
+{
+    if (!test->failed) {
+        test->failed = what;
+        test->length = 0;
+    }
+}
+
+static bool
+selftest_check(struct selftest *test, const char *what,
+               const char *expect, const char *result)
+{
+    if (result && !strcmp(expect, result))
+        return true;
+
+    selftest_fail(test, what);
+    return false;
+}
+
+static const char *
+selftest_linear(struct csum_algo *algo, const void *data, size_t length,
+                char *result)
+{
+    struct csum_linear linear;
+    struct csum_context *ctx;
+    const char *value;
+
+    ctx = csum_prepare(algo->driver, NULL, 0);
+    if (!ctx)
+        return NULL;
+
+    value = csum_linear_compute(ctx, &linear, data, length);
+    if (value)
+        snprintf(result, SELFTEST_RESULT, "%s", value);
+    csum_destroy(ctx);
+
+    return value ? result : NULL;
+}
+
+static void
+selftest_split(struct selftest *test, const uint8_t *data, size_t length,
+               const char *expect)
+{
+    struct selftest_feed feed;
+    struct csum_context *ctx;
+    struct csum_state sta;
+
+    ctx = csum_prepare(test->impl->driver, NULL, 0);
+    if (!ctx)
+        return;
+
+    feed.data = data;
+    feed.base = 0;
+    feed.limit = length;
+    feed.seed = test->seed;
+    sta.pdata = &feed;
+    ctx->next_block = selftest_next_block;
+
+    selftest_check(test, "split", expect, csum_compute(ctx, &sta));
+    csum_destroy(ctx);
+}
+
+/* every intermediate result has to match its prefix, and leave no trace */
+static void
+selftest_resume(struct selftest *test, const uint8_t *data, size_t length,
+                const char *expect)
+{
+    char prefix[SELFTEST_RESULT];
+    struct selftest_feed feed;
+    struct csum_context *ctx;
+    struct csum_state sta;
+    unsigned int count;
+    const char *value;
+
+    ctx = csum_prepare(test->impl->driver, NULL, 0);
+    if (!ctx)
+        return;
+
+    feed.data = data;
+    feed.base = 0;
+    feed.limit = 0;
+    feed.seed = test->seed;
+    sta.offset = 0;
+    sta.pdata = &feed;
+    ctx->next_block = selftest_next_block;
+
+    for (count = 0; count < SELFTEST_CUTS; ++count) {
+        feed.limit += selftest_random(&test->seed) % (length - feed.limit + 1);
+        value = csum_next(ctx, &sta);
+
+        if (!selftest_linear(test->ref, data, feed.limit, prefix) ||
+            !selftest_check(test, "resume", prefix, value))
+            goto finish;
+
+        if (sta.offset != feed.limit) {
+            selftest_fail(test, "resume");
+            goto finish;
+        }
+    }
+
+    feed.limit = length;
+    selftest_check(test, "resume", expect, csum_next(ctx, &sta));
+
+finish:
+    csum_destroy(ctx);
+}
+
+static void
+selftest_combine(struct selftest *test, const uint8_t *data, size_t length,
+                 const char *expect)
+{
+    struct csum_context *ctx, *next;
+    struct csum_linear head, tail;
+    size_t cut;
+
+    ctx = csum_prepare(test->impl->driver, NULL, 0);
+    next = csum_prepare(test->impl->driver, NULL, 0);
+    if (!ctx || !next)
+        goto finish;
+
+    cut = selftest_random(&test->seed) % (length + 1);
+    csum_linear_compute(ctx, &head, data, cut);
+    csum_linear_compute(next, &tail, data + cut, length - cut);
+    csum_combine(ctx, &head.sta, next, &tail.sta);
+
+    ctx->next_block = selftest_empty_block;
+    selftest_check(test, "combine", expect, csum_next(ctx, &head.sta));
+
+finish:
+    if (ctx)
+        csum_destroy(ctx);
+    if (next)
+        csum_destroy(next);
+}
+
+/* zeros land in the middle, the bytes behind them must not notice */
+static void
+selftest_zeros(struct selftest *test, const uint8_t *data, size_t length)
+{
+    char expect[SELFTEST_RESULT];
+    struct selftest_feed feed;
+    struct csum_linear linear;
+    struct csum_context *ctx;
+    size_t zeros, cut;
+    uint8_t *padded;
+
+    zeros = selftest_random(&test->seed) % SELFTEST_SIZE;
+    cut = selftest_random(&test->seed) % (length + 1);
+
+    padded = bfdev_zalloc(NULL, length + zeros + 1);
+    if (bfdev_unlikely(!padded))
+        return;
+
+    memcpy(padded, data, cut);
+    memcpy(padded + cut + zeros, data + cut, length - cut);
+
+    ctx = csum_prepare(test->impl->driver, NULL, 0);
+    if (!ctx || !selftest_linear(test->ref, padded, length + zeros, expect))
+        goto finish;
+
+    csum_linear_compute(ctx, &linear, data, cut);
+    csum_zeros(ctx, &linear.sta, zeros);
+
+    feed.data = data + cut;
+    feed.base = cut + zeros;
+    feed.limit = length + zeros;
+    feed.seed = test->seed;
+    linear.sta.pdata = &feed;
+    ctx->next_block = selftest_next_block;
+
+    selftest_check(test, "zeros", expect, csum_next(ctx, &linear.sta));
+
+finish:
+    if (ctx)
+        csum_destroy(ctx);
+    bfdev_free(NULL, padded);
+}
+
+static void
+selftest_many(struct selftest *test, const uint8_t *buffer, size_t size)
+{
+    struct csum_context *ctxs[CSUM_MANY_MAX];
+    struct csum_linear linears[CSUM_MANY_MAX];
+    const char *results[CSUM_MANY_MAX];
+    char expect[SELFTEST_RESULT];
+    unsigned int index, count;
+    size_t length;
+
+    count = 2 + selftest_random(&test->seed) % (CSUM_MANY_MAX - 1);
+    for (index = 0; index < count; ++index) {
+        length = selftest_random(&test->seed) % bfdev_min(size, SELFTEST_MANY);
+        linears[index].data = buffer + selftest_random(&test->seed) % (size - length + 1);
+        linears[index].length = length;
+
+        ctxs[index] = csum_prepare(test->impl->driver, NULL, 0);
+        if (!ctxs[index]) {
+            count = index;
+            goto finish;
+        }
+    }
+
+    csum_linear_many(ctxs, linears, results, count);
+    for (index = 0; index < count; ++index) {
+        if (!selftest_linear(test->ref, linears[index].data,
+                             linears[index].length, expect) ||
+            !selftest_check(test, "many", expect, results[index]))
+            break;
+    }
+
+finish:
+    for (index = 0; index < count; ++index)
+        csum_destroy(ctxs[index]);
+}
+
+static void
+selftest_done(struct csum_async_entry *entry, const char *result, int error)
+{
+    struct selftest_pipe *pipe = entry->pdata;
+    pipe->result = result;
+}
+
+/* the writers take turns with the event loop, all on this one thread */
+static void
+selftest_async(struct selftest *test, const uint8_t *buffer)
+{
+    struct selftest_pipe pipes[SELFTEST_CUTS] = {}, *pipe;
+    char expect[SELFTEST_RESULT];
+    struct csum_async async;
+    unsigned int index, count;
+    size_t length;
+    ssize_t retval;
+    int fds[2];
+
+    if (csum_async_init(&async))
+        return;
+
+    for (count = 0; count < SELFTEST_CUTS; ++count) {
+        pipe = &pipes[count];
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0)
+            goto finish;
+
+        pipe->entry.fd = fds[0];
+        pipe->input = fds[1];
+        pipe->data = buffer + selftest_random(&test->seed) % SELFTEST_ALIGN;
+        pipe->length = selftest_random(&test->seed) % SELFTEST_SIZE;
+
+        pipe->entry.ctx = csum_prepare(test->impl->driver, NULL, 0);
+        if (!pipe->entry.ctx)
+            goto finish;
+
+        pipe->entry.done = selftest_done;
+        pipe->entry.pdata = pipe;
+        if (csum_async_add(&async, &pipe->entry))
+            goto finish;
+    }
+
+    while (!csum_async_empty(&async)) {
+        for (index = 0; index < count; ++index) {
+            pipe = &pipes[index];
+            if (pipe->input < 0)
+                continue;
+
+            length = pipe->length - pipe->written;
+            if (length) {
+                length = 1 + selftest_random(&test->seed) % length;
+                retval = write(pipe->input, pipe->data + pipe->written, length);
+                if (retval < 0 && errno != EAGAIN) {
+                    selftest_fail(test, "async");
+                    goto finish;
+                }
+                if (retval > 0)
+                    pipe->written += retval;
+            }
+
+            if (pipe->written == pipe->length) {
+                close(pipe->input);
+                pipe->input = -1;
+            }
+        }
+
+        if (csum_async_dispatch(&async, 0) < 0) {
+            selftest_fail(test, "async");
+            goto finish;
+        }
+    }
+
+    for (index = 0; index < count; ++index) {
+        pipe = &pipes[index];
+        if (!selftest_linear(test->ref, pipe->data, pipe->length, expect) ||
+            !selftest_check(test, "async", expect, pipe->result))
+            break;
+    }
+
+finish:
+    csum_async_exit(&async);
+    for (index = 0; index <= count && index < SELFTEST_CUTS; ++index) {
+        pipe = &pipes[index];
+        if (pipe->entry.ctx)
+            csum_destroy(pipe->entry.ctx);
+        if (pipe->entry.fd > 0)
+            close(pipe->entry.fd);
+        if (pipe->input > 0)
+            close(pipe->input);
+    }
+}
+
+static bool
+selftest_inet(struct selftest *test, const uint8_t *data, size_t length,
+              uint16_t *check)
+{
+    char result[SELFTEST_RESULT];
+
+    if (!selftest_linear(test->impl, data, length, result)) {
+        selftest_fail(test, "adjust");
+        return false;
+    }
+
+    *check = strtoul(result, NULL, 16);
+    return true;
+}
+
+/* ones complement has two zeros, RFC 1624 may land on either */
+static bool
+selftest_zero(uint16_t check)
+{
+    return !check || check == 0xffff;
+}
+
+static void
+selftest_adjust(struct selftest *test, const uint8_t *buffer, unsigned int rounds)
+{
+    uint8_t packet[SELFTEST_PACKET], field[SELFTEST_FIELD];
+    size_t length, offset, size, index;
+    uint16_t before, after, adjust;
+
+    while (rounds-- && !test->failed) {
+        length = selftest_random(&test->seed) % sizeof(packet) + 1;
+        memcpy(packet, buffer + selftest_random(&test->seed) % SELFTEST_ALIGN, length);
+        if (!selftest_inet(test, packet, length, &before))
+            return;
+
+        offset = selftest_random(&test->seed) % length & ~(size_t)1;
+        size = selftest_random(&test->seed) % sizeof(field) + 1;
+        bfdev_min_adj(size, length - offset);
+
+        memcpy(field, packet + offset, size);
+        for (index = 0; index < size; ++index)
+            packet[offset + index] = selftest_random(&test->seed) >> 23;
+
+        adjust = csum_inet_adjust(before, field, packet + offset, size);
+        if (!selftest_inet(test, packet, length, &after))
+            return;
+
+        if (adjust != after && !(selftest_zero(adjust) && selftest_zero(after))) {
+            selftest_fail(test, "adjust");
+            test->length = length;
+            return;
+        }
+    }
+}
+
+static void
+selftest_input(struct selftest *test, const uint8_t *data, size_t length)
+{
+    char expect[SELFTEST_RESULT], result[SELFTEST_RESULT];
+    const char *failed = test->failed;
+
+    if (!selftest_linear(test->ref, data, length, expect))
+        return;
+
+    selftest_check(test, "linear", expect,
+                   selftest_linear(test->impl, data, length, result));
+    selftest_split(test, data, length, expect);
+    selftest_resume(test, data, length, expect);
+
+    if (test->impl->combine)
+        selftest_combine(test, data, length, expect);
+
+    if (test->impl->zeros)
+        selftest_zeros(test, data, length);
+
+    if (!failed && test->failed)
+        test->length = length;
+}
+
+static struct csum_algo *
+selftest_reference(struct csum_algo *impl)
+{
+    struct csum_algo *walk, *best = impl;
+
+    bfdev_list_for_each_entry(walk, &csum_algos, list) {
+        if (strcmp(walk->name, impl->name) ||
+            (walk->features & ~csum_cpu_features()) ||
+            walk->priority < CSUM_PRIO_GENERIC)
+            continue;
+
+        if (best->priority < CSUM_PRIO_GENERIC || walk->priority < best->priority)
+            best = walk;
+    }
+
+    return best;
+}
+
+static const char *
+selftest_vector(struct csum_algo *algo)
+{
+    unsigned int index;
+
+    for (index = 0; index < sizeof(selftest_vectors) / sizeof(*selftest_vectors); ++index) {
+        if (!strcmp(selftest_vectors[index].name, algo->name))
+            return selftest_vectors[index].check;
+    }
+
+    return NULL;
+}
+
+static void
+selftest_driver(struct selftest *test, const uint8_t *buffer, unsigned int rounds)
+{
+    char result[SELFTEST_RESULT];
+    const char *check;
+    size_t length;
+
+    check = selftest_vector(test->impl);
+    if (check && !selftest_check(test, "check", check, selftest_linear(
+        test->impl, SELFTEST_CHECK, sizeof(SELFTEST_CHECK) - 1, result)))
+        test->length = sizeof(SELFTEST_CHECK) - 1;
+
+    if (!test->failed)
+        selftest_async(test, buffer);
+
+    if (!strcmp(test->impl->name, "inet"))
+        selftest_adjust(test, buffer, rounds * SELFTEST_ADJUST);
+
+    while (rounds-- && !test->failed) {
+        /* mostly short inputs, those take the head and tail paths */
+        switch (selftest_random(&test->seed) % 4) {
+            case 0:
+                length = selftest_random(&test->seed) % 64;
+                break;
+
+            case 1:
+                length = selftest_random(&test->seed) % 1024;
+                break;
+
+            case 2:
+                length = selftest_random(&test->seed) % 16384;
+                break;
+
+            default:
+                length = selftest_random(&test->seed) % SELFTEST_SIZE;
+                break;
+        }
+
+        selftest_input(test, buffer + selftest_random(&test->seed) %
+                       SELFTEST_ALIGN, length);
+
+        if (test->impl->many && !test->failed)
+            selftest_many(test, buffer, SELFTEST_SIZE);
+    }
+}
+
+int
+csum_selftest_input(const void *data, size_t length)
+{
+    struct selftest test = {};
+    struct csum_algo *algo;
+
+    bfdev_list_for_each_entry(algo, &csum_algos, list) {
+        if (algo->features & ~csum_cpu_features())
+            continue;
+
+        test.impl = algo;
+        test.ref = selftest_reference(algo);
+        test.seed = length;
+
+        selftest_input(&test, data, length);
+        if (test.failed)
+            return -EFAULT;
+    }
+
+    return 0;
+}
+
+int
+csum_selftest(FILE *stream, unsigned int rounds)
+{
+    unsigned int drivers = 0, failed = 0;
+    struct csum_algo *algo;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    struct selftest test;
+    uint8_t *buffer;
+    size_t index;
+
+    buffer = bfdev_malloc(NULL, SELFTEST_SIZE + SELFTEST_ALIGN);
+    if (bfdev_unlikely(!buffer))
+        return -ENOMEM;
+
+    for (index = 0; index < SELFTEST_SIZE + SELFTEST_ALIGN; ++index)
+        buffer[index] = selftest_random(&seed) >> 23;
+
+    bfdev_list_for_each_entry(algo, &csum_algos, list) {
+        if (algo->features & ~csum_cpu_features()) {
+            fprintf(stream, "%-24s skipped\n", algo->driver);
+            continue;
+        }
+
+        memset(&test, 0, sizeof(test));
+        test.impl = algo;
+        test.ref = selftest_reference(algo);
+        test.seed = seed;
+
+        selftest_driver(&test, buffer, rounds);
+        drivers++;
+
+        if (!test.failed) {
+            fprintf(stream, "%-24s ok\n", algo->driver);
+            continue;
+        }
+
+        fprintf(stream, "%-24s FAILED %s against %s, length %zu\n",
+                algo->driver, test.failed, test.ref->driver, test.length);
+        failed++;
+    }
+
+    fprintf(stream, "%u drivers, %u failed\n", drivers, failed);
+    bfdev_free(NULL, buffer);
+
+    return failed ? -EFAULT : 0;
+}
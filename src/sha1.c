@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <digest.h>
+#include <string.h>
+#include <bfdev/minmax.h>
+
+static const uint32_t sha1_init[5] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+    0xc3d2e1f0,
+};
+
+static const uint32_t sha1_k[4] = {
+    0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6,
+};
+
+static inline uint32_t
+sha1_rol(uint32_t value, unsigned int shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static inline uint32_t
+sha1_load(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+           ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void
+sha1_generic(uint32_t *hash, const uint8_t *data, size_t blocks)
+{
+    uint32_t a, b, c, d, e, f, tmp;
+    uint32_t w[80];
+    unsigned int count;
+
+    while (blocks--) {
+        for (count = 0; count < 16; ++count)
+            w[count] = sha1_load(data + count * 4);
+
+        for (; count < 80; ++count)
+            w[count] = sha1_rol(w[count - 3] ^ w[count - 8] ^
+                                w[count - 14] ^ w[count - 16], 1);
+
+        a = hash[0]; b = hash[1]; c = hash[2];
+        d = hash[3]; e = hash[4];
+
+        for (count = 0; count < 80; ++count) {
+            if (count < 20)
+                f = d ^ (b & (c ^ d));
+            else if (count >= 40 && count < 60)
+                f = (b & c) | (d & (b | c));
+            else
+                f = b ^ c ^ d;
+
+            tmp = sha1_rol(a, 5) + f + e + sha1_k[count / 20] + w[count];
+            e = d; d = c; c = sha1_rol(b, 30);
+            b = a; a = tmp;
+        }
+
+        hash[0] += a; hash[1] += b; hash[2] += c;
+        hash[3] += d; hash[4] += e;
+        data += DIGEST_BLOCK;
+    }
+}
+
+#if defined(__x86_64__)
+
+static inline __attribute__((target("sse2,ssse3,sse4.1,sha"))) __m128i
+sha1_shani_rounds(__m128i abcd, __m128i e, unsigned int func)
+{
+    /* the round function is an immediate operand */
+    switch (func) {
+        case 0:
+            return _mm_sha1rnds4_epu32(abcd, e, 0);
+
+        case 1:
+            return _mm_sha1rnds4_epu32(abcd, e, 1);
+
+        case 2:
+            return _mm_sha1rnds4_epu32(abcd, e, 2);
+
+        default:
+            return _mm_sha1rnds4_epu32(abcd, e, 3);
+    }
+}
+
+/*
+ * Twenty groups of four rounds. The E input alternates between two
+ * registers and the schedule of the following groups is extended with
+ * msg1, xor and msg2 while the current one is compressed.
+ */
+static __attribute__((target("sse2,ssse3,sse4.1,sha"))) void
+sha1_shani(uint32_t *hash, const uint8_t *data, size_t blocks)
+{
+    const __m128i swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd, e0, e1, save0, save1;
+    __m128i w[4];
+    unsigned int count;
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)hash), 0x1b);
+    e0 = _mm_set_epi32(hash[4], 0, 0, 0);
+
+    while (blocks--) {
+        save0 = abcd;
+        save1 = e0;
+
+#pragma GCC unroll 20
+        for (count = 0; count < 20; ++count) {
+            if (count < 4)
+                w[count] = _mm_shuffle_epi8(_mm_loadu_si128(
+                    (const __m128i *)(data + count * 16)), swap);
+
+            if (!count) {
+                e0 = _mm_add_epi32(e0, w[0]);
+                e1 = abcd;
+                abcd = sha1_shani_rounds(abcd, e0, 0);
+            } else if (count & 1) {
+                e1 = _mm_sha1nexte_epu32(e1, w[count % 4]);
+                e0 = abcd;
+                abcd = sha1_shani_rounds(abcd, e1, count / 5);
+            } else {
+                e0 = _mm_sha1nexte_epu32(e0, w[count % 4]);
+                e1 = abcd;
+                abcd = sha1_shani_rounds(abcd, e0, count / 5);
+            }
+
+            if (count >= 3 && count < 19)
+                w[(count + 1) % 4] = _mm_sha1msg2_epu32(w[(count + 1) % 4], w[count % 4]);
+
+            if (count >= 2 && count < 18)
+                w[(count + 2) % 4] = _mm_xor_si128(w[(count + 2) % 4], w[count % 4]);
+
+            if (count && count < 17)
+                w[(count + 3) % 4] = _mm_sha1msg1_epu32(w[(count + 3) % 4], w[count % 4]);
+        }
+
+        e0 = _mm_sha1nexte_epu32(e0, save1);
+        abcd = _mm_add_epi32(abcd, save0);
+        data += DIGEST_BLOCK;
+    }
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i *)hash, abcd);
+    hash[4] = _mm_extract_epi32(e0, 3);
+}
+
+#define SHA1_AVX2_ROL(x, n) \
+    _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+/*
+ * Eight messages, one per 32 bit lane. Lanes that ran out of blocks
+ * keep hashing a dummy block, their result is masked out.
+ */
+static __attribute__((target("avx2"))) void
+sha1_avx2(uint32_t *const *hashes, const uint8_t *const *data,
+          const size_t *blocks)
+{
+    static const uint8_t idle[DIGEST_BLOCK];
+    __m256i a, b, c, d, e, f, tmp, mask;
+    __m256i state[5], w[80];
+    const uint8_t *input[DIGEST_LANES];
+    uint32_t active[DIGEST_LANES];
+    size_t block, most = 0;
+    unsigned int lane, count;
+
+    for (lane = 0; lane < DIGEST_LANES; ++lane)
+        most = bfdev_max(most, blocks[lane]);
+
+    if (!most)
+        return;
+
+    for (count = 0; count < 5; ++count)
+        state[count] = _mm256_setr_epi32(
+            hashes[0][count], hashes[1][count], hashes[2][count], hashes[3][count],
+            hashes[4][count], hashes[5][count], hashes[6][count], hashes[7][count]);
+
+    for (block = 0; block < most; ++block) {
+        for (lane = 0; lane < DIGEST_LANES; ++lane) {
+            active[lane] = block < blocks[lane] ? UINT32_MAX : 0;
+            input[lane] = active[lane] ? data[lane] + block * DIGEST_BLOCK : idle;
+        }
+
+        mask = _mm256_loadu_si256((const __m256i *)active);
+        digest_avx2_message(w, input, 0);
+
+        for (count = 16; count < 80; ++count) {
+            tmp = _mm256_xor_si256(_mm256_xor_si256(w[count - 3], w[count - 8]),
+                                   _mm256_xor_si256(w[count - 14], w[count - 16]));
+            w[count] = SHA1_AVX2_ROL(tmp, 1);
+        }
+
+        a = state[0]; b = state[1]; c = state[2];
+        d = state[3]; e = state[4];
+
+        for (count = 0; count < 80; ++count) {
+            if (count < 20)
+                f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+            else if (count >= 40 && count < 60)
+                f = _mm256_or_si256(_mm256_and_si256(b, c),
+                                    _mm256_and_si256(d, _mm256_or_si256(b, c)));
+            else
+                f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+
+            tmp = _mm256_add_epi32(_mm256_add_epi32(SHA1_AVX2_ROL(a, 5), f),
+                  _mm256_add_epi32(_mm256_add_epi32(e, w[count]),
+                  _mm256_set1_epi32(sha1_k[count / 20])));
+            e = d; d = c; c = SHA1_AVX2_ROL(b, 30);
+            b = a; a = tmp;
+        }
+
+        state[0] = _mm256_add_epi32(state[0], _mm256_and_si256(a, mask));
+        state[1] = _mm256_add_epi32(state[1], _mm256_and_si256(b, mask));
+        state[2] = _mm256_add_epi32(state[2], _mm256_and_si256(c, mask));
+        state[3] = _mm256_add_epi32(state[3], _mm256_and_si256(d, mask));
+        state[4] = _mm256_add_epi32(state[4], _mm256_and_si256(e, mask));
+    }
+
+    for (count = 0; count < 5; ++count) {
+        _mm256_storeu_si256((__m256i *)active, state[count]);
+        for (lane = 0; lane < DIGEST_LANES; ++lane) {
+            if (blocks[lane])
+                hashes[lane][count] = active[lane];
+        }
+    }
+}
+
+#endif /* __x86_64__ */
+
+static const struct digest_model sha1_model = {
+    .words = 5,
+    .init = sha1_init,
+    .reference = sha1_generic,
+};
+
+static struct csum_context *
+sha1_prepare(const char *args, unsigned long flags)
+{
+    return digest_prepare(&sha1_model);
+}
+
+static struct csum_algo sha1 = {
+    .name = "sha1",
+    .coreutils = true,
+    .prepare = sha1_prepare,
+    .destroy = digest_destroy,
+    .reset = digest_reset,
+    .compute = digest_compute,
+    .many = digest_many,
+};
+
+static struct digest_impl sha1_impls[] = {
+    {
+        .algo = {
+            .driver = "sha1-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .model = &sha1_model,
+        .compress = sha1_generic,
+    },
+#if defined(__x86_64__)
+    {
+        .algo = {
+            .driver = "sha1-avx2",
+            .priority = CSUM_PRIO_SIMD,
+            .features = DIGEST_IMPL_AVX2,
+        },
+        .model = &sha1_model,
+        .compress = sha1_generic,
+        .lanes = sha1_avx2,
+    }, {
+        .algo = {
+            .driver = "sha1-shani",
+            .priority = CSUM_PRIO_WIDE,
+            .features = DIGEST_IMPL_SHANI,
+        },
+        .model = &sha1_model,
+        .compress = sha1_shani,
+    },
+#endif
+};
+
+static int __bfdev_ctor
+sha1_register(void)
+{
+    return digest_impl_register(sha1_impls, DIGEST_IMPL_COUNT(sha1_impls), &sha1);
+}
+
+static void __bfdev_dtor
+sha1_unregister(void)
+{
+    digest_impl_unregister(sha1_impls, DIGEST_IMPL_COUNT(sha1_impls));
+}
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <digest.h>
+#include <string.h>
+#include <bfdev/minmax.h>
+
+static const uint32_t sha256_init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t
+sha256_ror(uint32_t value, unsigned int shift)
+{
+    return (value >> shift) | (value << (32 - shift));
+}
+
+static inline uint32_t
+sha256_load(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+           ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void
+sha256_generic(uint32_t *hash, const uint8_t *data, size_t blocks)
+{
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    uint32_t w[64];
+    unsigned int count;
+
+    while (blocks--) {
+        for (count = 0; count < 16; ++count)
+            w[count] = sha256_load(data + count * 4);
+
+        for (; count < 64; ++count) {
+            t1 = sha256_ror(w[count - 2], 17) ^ sha256_ror(w[count - 2], 19) ^
+                 (w[count - 2] >> 10);
+            t2 = sha256_ror(w[count - 15], 7) ^ sha256_ror(w[count - 15], 18) ^
+                 (w[count - 15] >> 3);
+            w[count] = t1 + w[count - 7] + t2 + w[count - 16];
+        }
+
+        a = hash[0]; b = hash[1]; c = hash[2]; d = hash[3];
+        e = hash[4]; f = hash[5]; g = hash[6]; h = hash[7];
+
+        for (count = 0; count < 64; ++count) {
+            t1 = h + (sha256_ror(e, 6) ^ sha256_ror(e, 11) ^ sha256_ror(e, 25)) +
+                 ((e & f) ^ (~e & g)) + sha256_k[count] + w[count];
+            t2 = (sha256_ror(a, 2) ^ sha256_ror(a, 13) ^ sha256_ror(a, 22)) +
+                 ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        hash[0] += a; hash[1] += b; hash[2] += c; hash[3] += d;
+        hash[4] += e; hash[5] += f; hash[6] += g; hash[7] += h;
+        data += DIGEST_BLOCK;
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * The sha extensions keep the state as ABEF and CDGH halves and take
+ * four message words per quad of rounds, the schedule of the next
+ * quads is extended while the current one is compressed.
+ */
+static __attribute__((target("sse2,ssse3,sse4.1,sha"))) void
+sha256_shani(uint32_t *hash, const uint8_t *data, size_t blocks)
+{
+    const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, save0, save1, msg, tmp;
+    __m128i w[4];
+    unsigned int count;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&hash[0]), 0xb1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&hash[4]), 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    while (blocks--) {
+        save0 = state0;
+        save1 = state1;
+
+#pragma GCC unroll 16
+        for (count = 0; count < 16; ++count) {
+            if (count < 4)
+                w[count] = _mm_shuffle_epi8(_mm_loadu_si128(
+                    (const __m128i *)(data + count * 16)), swap);
+
+            msg = _mm_add_epi32(w[count % 4], _mm_loadu_si128(
+                (const __m128i *)&sha256_k[count * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            if (count >= 3 && count < 15) {
+                tmp = _mm_alignr_epi8(w[count % 4], w[(count + 3) % 4], 4);
+                w[(count + 1) % 4] = _mm_add_epi32(w[(count + 1) % 4], tmp);
+                w[(count + 1) % 4] = _mm_sha256msg2_epu32(w[(count + 1) % 4], w[count % 4]);
+            }
+
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+
+            if (count && count < 13)
+                w[(count + 3) % 4] = _mm_sha256msg1_epu32(w[(count + 3) % 4], w[count % 4]);
+        }
+
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
+        data += DIGEST_BLOCK;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i *)&hash[0], state0);
+    _mm_storeu_si128((__m128i *)&hash[4], state1);
+}
+
+#define SHA256_AVX2_ROR(x, n) \
+    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+/*
+ * Eight messages, one per 32 bit lane. Lanes that ran out of blocks
+ * keep hashing a dummy block, their result is masked out.
+ */
+static __attribute__((target("avx2"))) void
+sha256_avx2(uint32_t *const *hashes, const uint8_t *const *data,
+            const size_t *blocks)
+{
+    static const uint8_t idle[DIGEST_BLOCK];
+    __m256i a, b, c, d, e, f, g, h, t1, t2, mask;
+    __m256i state[8], w[64];
+    const uint8_t *input[DIGEST_LANES];
+    uint32_t active[DIGEST_LANES];
+    size_t block, most = 0;
+    unsigned int lane, count;
+
+    for (lane = 0; lane < DIGEST_LANES; ++lane)
+        most = bfdev_max(most, blocks[lane]);
+
+    if (!most)
+        return;
+
+    for (count = 0; count < 8; ++count)
+        state[count] = _mm256_setr_epi32(
+            hashes[0][count], hashes[1][count], hashes[2][count], hashes[3][count],
+            hashes[4][count], hashes[5][count], hashes[6][count], hashes[7][count]);
+
+    for (block = 0; block < most; ++block) {
+        for (lane = 0; lane < DIGEST_LANES; ++lane) {
+            active[lane] = block < blocks[lane] ? UINT32_MAX : 0;
+            input[lane] = active[lane] ? data[lane] + block * DIGEST_BLOCK : idle;
+        }
+
+        mask = _mm256_loadu_si256((const __m256i *)active);
+        digest_avx2_message(w, input, 0);
+
+        for (count = 16; count < 64; ++count) {
+            t1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROR(w[count - 2], 17),
+                 SHA256_AVX2_ROR(w[count - 2], 19)), _mm256_srli_epi32(w[count - 2], 10));
+            t2 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROR(w[count - 15], 7),
+                 SHA256_AVX2_ROR(w[count - 15], 18)), _mm256_srli_epi32(w[count - 15], 3));
+            w[count] = _mm256_add_epi32(_mm256_add_epi32(t1, w[count - 7]),
+                                        _mm256_add_epi32(t2, w[count - 16]));
+        }
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+        for (count = 0; count < 64; ++count) {
+            t1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROR(e, 6),
+                 SHA256_AVX2_ROR(e, 11)), SHA256_AVX2_ROR(e, 25));
+            t1 = _mm256_add_epi32(_mm256_add_epi32(h, t1),
+                 _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)));
+            t1 = _mm256_add_epi32(t1, _mm256_add_epi32(
+                 _mm256_set1_epi32(sha256_k[count]), w[count]));
+            t2 = _mm256_xor_si256(_mm256_xor_si256(SHA256_AVX2_ROR(a, 2),
+                 SHA256_AVX2_ROR(a, 13)), SHA256_AVX2_ROR(a, 22));
+            t2 = _mm256_add_epi32(t2, _mm256_xor_si256(_mm256_and_si256(a, b),
+                 _mm256_and_si256(c, _mm256_xor_si256(a, b))));
+            h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+        }
+
+        state[0] = _mm256_add_epi32(state[0], _mm256_and_si256(a, mask));
+        state[1] = _mm256_add_epi32(state[1], _mm256_and_si256(b, mask));
+        state[2] = _mm256_add_epi32(state[2], _mm256_and_si256(c, mask));
+        state[3] = _mm256_add_epi32(state[3], _mm256_and_si256(d, mask));
+        state[4] = _mm256_add_epi32(state[4], _mm256_and_si256(e, mask));
+        state[5] = _mm256_add_epi32(state[5], _mm256_and_si256(f, mask));
+        state[6] = _mm256_add_epi32(state[6], _mm256_and_si256(g, mask));
+        state[7] = _mm256_add_epi32(state[7], _mm256_and_si256(h, mask));
+    }
+
+    for (count = 0; count < 8; ++count) {
+        _mm256_storeu_si256((__m256i *)active, state[count]);
+        for (lane = 0; lane < DIGEST_LANES; ++lane) {
+            if (blocks[lane])
+                hashes[lane][count] = active[lane];
+        }
+    }
+}
+
+#endif /* __x86_64__ */
+
+static const struct digest_model sha256_model = {
+    .words = 8,
+    .init = sha256_init,
+    .reference = sha256_generic,
+};
+
+static struct csum_context *
+sha256_prepare(const char *args, unsigned long flags)
+{
+    return digest_prepare(&sha256_model);
+}
+
+static struct csum_algo sha256 = {
+    .name = "sha256",
+    .coreutils = true,
+    .prepare = sha256_prepare,
+    .destroy = digest_destroy,
+    .reset = digest_reset,
+    .compute = digest_compute,
+    .many = digest_many,
+};
+
+static struct digest_impl sha256_impls[] = {
+    {
+        .algo = {
+            .driver = "sha256-generic",
+            .priority = CSUM_PRIO_GENERIC,
+        },
+        .model = &sha256_model,
+        .compress = sha256_generic,
+    },
+#if defined(__x86_64__)
+    {
+        .algo = {
+            .driver = "sha256-avx2",
+            .priority = CSUM_PRIO_SIMD,
+            .features = DIGEST_IMPL_AVX2,
+        },
+        .model = &sha256_model,
+        .compress = sha256_generic,
+        .lanes = sha256_avx2,
+    }, {
+        .algo = {
+            .driver = "sha256-shani",
+            .priority = CSUM_PRIO_WIDE,
+            .features = DIGEST_IMPL_SHANI,
+        },
+        .model = &sha256_model,
+        .compress = sha256_shani,
+    },
+#endif
+};
+
+static int __bfdev_ctor
+sha256_register(void)
+{
+    return digest_impl_register(sha256_impls, DIGEST_IMPL_COUNT(sha256_impls), &sha256);
+}
+
+static void __bfdev_dtor
+sha256_unregister(void)
+{
+    digest_impl_unregister(sha256_impls, DIGEST_IMPL_COUNT(sha256_impls));
+}
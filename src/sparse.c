@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <csum.h>
+#include <bfdev/minmax.h>
+
+struct sparse_context {
+    const uint8_t *data;
+    uint64_t limit;
+};
+
+static size_t
+sparse_next_block(struct csum_context *ctx, struct csum_state *sta,
+                  uintptr_t consumed, const void **dest)
+{
+    struct sparse_context *sparse = sta->pdata;
+
+    if (consumed >= sparse->limit)
+        return 0;
+
+    *dest = sparse->data + consumed;
+    return sparse->limit - consumed;
+}
+
+const char *
+csum_sparse_compute(struct csum_context *ctx, struct csum_state *sta, int fd,
+                    const void *data, uint64_t offset, uint64_t length)
+{
+    struct sparse_context sparse;
+    uint64_t end = offset + length;
+    off_t walk, hole;
+
+    sparse.data = data;
+    sparse.limit = 0;
+    sta->offset = 0;
+    sta->pdata = &sparse;
+    ctx->next_block = sparse_next_block;
+
+    while (sta->offset < length) {
+        walk = lseek(fd, offset + sta->offset, SEEK_DATA);
+        if (walk < 0) {
+            /* nothing but a trailing hole is left */
+            if (errno != ENXIO)
+                return NULL;
+            walk = end;
+            errno = 0;
+        }
+
+        bfdev_min_adj(walk, (off_t)end);
+        if (walk > offset + sta->offset)
+            csum_zeros(ctx, sta, walk - offset - sta->offset);
+
+        if (walk == end)
+            break;
+
+        hole = lseek(fd, walk, SEEK_HOLE);
+        if (hole < 0)
+            return NULL;
+
+        bfdev_min_adj(hole, (off_t)end);
+        sparse.limit = hole - offset;
+
+        if (!csum_next(ctx, sta))
+            return NULL;
+    }
+
+    sparse.limit = sta->offset;
+    return csum_next(ctx, sta);
+}
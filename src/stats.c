@@ -0,0 +1,313 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <csum.h>
+#include <bfdev/minmax.h>
+
+enum stats_counter {
+    STATS_CYCLES = 0,
+    STATS_INSTRUCTIONS,
+    STATS_LLC_MISSES,
+    STATS_COUNTER_NR,
+};
+
+struct stats_stage {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t wall;
+    uint64_t cpu;
+};
+
+/*
+ * Compute time is measured around the algorithm's compute callback and
+ * the time spent inside its next_block source is charged to the source
+ * stage instead. The original source is parked per thread so parallel
+ * range readers are accounted independently.
+ */
+struct stats_thread {
+    size_t (*next_block)(struct csum_context *ctx, struct csum_state *sta,
+                         uintptr_t consumed, const void **dest);
+    uint64_t wall;
+    uint64_t cpu;
+};
+
+static const char *
+stage_names[CSUM_STAGE_NR] = {
+    [CSUM_STAGE_OPEN] = "open",
+    [CSUM_STAGE_MAP] = "map",
+    [CSUM_STAGE_SOURCE] = "source",
+    [CSUM_STAGE_COMPUTE] = "compute",
+    [CSUM_STAGE_COMBINE] = "combine",
+};
+
+static const char *
+counter_names[STATS_COUNTER_NR] = {
+    [STATS_CYCLES] = "cycles",
+    [STATS_INSTRUCTIONS] = "instructions",
+    [STATS_LLC_MISSES] = "llc_misses",
+};
+
+static const uint64_t
+counter_configs[STATS_COUNTER_NR] = {
+    [STATS_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [STATS_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [STATS_LLC_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+bool csum_stats_enabled;
+static struct stats_stage stats_stages[CSUM_STAGE_NR];
+static int stats_counters[STATS_COUNTER_NR];
+static struct csum_clock stats_total;
+static struct rusage stats_usage;
+static __thread struct stats_thread stats_thread;
+
+static inline uint64_t
+stats_clock(clockid_t clock)
+{
+    struct timespec time;
+
+    clock_gettime(clock, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+static inline void
+stats_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void
+stats_account(enum csum_stage stage, uint64_t bytes,
+              uint64_t wall, uint64_t cpu)
+{
+    struct stats_stage *walk = &stats_stages[stage];
+
+    stats_add(&walk->calls, 1);
+    stats_add(&walk->bytes, bytes);
+    stats_add(&walk->wall, wall);
+    stats_add(&walk->cpu, cpu);
+}
+
+static inline void
+stats_sample(struct csum_clock *clock)
+{
+    clock->wall = stats_clock(CLOCK_MONOTONIC);
+    clock->cpu = stats_clock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void
+csum_stats_start(struct csum_clock *clock)
+{
+    if (csum_stats_enabled)
+        stats_sample(clock);
+}
+
+void
+csum_stats_stop(enum csum_stage stage, struct csum_clock *clock, uint64_t bytes)
+{
+    if (!csum_stats_enabled)
+        return;
+
+    stats_account(stage, bytes,
+                  stats_clock(CLOCK_MONOTONIC) - clock->wall,
+                  stats_clock(CLOCK_THREAD_CPUTIME_ID) - clock->cpu);
+}
+
+static size_t
+stats_next_block(struct csum_context *ctx, struct csum_state *sta,
+                 uintptr_t consumed, const void **dest)
+{
+    struct stats_thread *thread = &stats_thread;
+    struct csum_clock clock;
+    uint64_t wall, cpu;
+    size_t length;
+
+    stats_sample(&clock);
+    length = thread->next_block(ctx, sta, consumed, dest);
+    wall = stats_clock(CLOCK_MONOTONIC) - clock.wall;
+    cpu = stats_clock(CLOCK_THREAD_CPUTIME_ID) - clock.cpu;
+
+    if (length)
+        stats_account(CSUM_STAGE_SOURCE, length, wall, cpu);
+    thread->wall += wall;
+    thread->cpu += cpu;
+
+    return length;
+}
+
+const char *
+csum_stats_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct stats_thread *thread = &stats_thread;
+    struct csum_algo *algo = ctx->algo;
+    uintptr_t offset = sta->offset;
+    struct csum_clock clock;
+    const char *result;
+    uint64_t wall, cpu;
+
+    thread->next_block = ctx->next_block;
+    thread->wall = thread->cpu = 0;
+    ctx->next_block = stats_next_block;
+
+    stats_sample(&clock);
+    result = algo->compute(ctx, sta);
+    wall = stats_clock(CLOCK_MONOTONIC) - clock.wall;
+    cpu = stats_clock(CLOCK_THREAD_CPUTIME_ID) - clock.cpu;
+    ctx->next_block = thread->next_block;
+
+    stats_account(CSUM_STAGE_COMPUTE, sta->offset - offset,
+                  wall - bfdev_min(wall, thread->wall),
+                  cpu - bfdev_min(cpu, thread->cpu));
+
+    return result;
+}
+
+static int
+stats_counter_open(uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void
+csum_stats_enable(void)
+{
+    unsigned int count;
+    int fd, error;
+
+    /* hardware counters are optional, most containers deny them */
+    error = errno;
+    for (count = 0; count < STATS_COUNTER_NR; ++count) {
+        fd = stats_counter_open(counter_configs[count]);
+        stats_counters[count] = fd;
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    getrusage(RUSAGE_SELF, &stats_usage);
+    stats_sample(&stats_total);
+    csum_stats_enabled = true;
+    errno = error;
+}
+
+static inline uint64_t
+stats_timeval(const struct timeval *time)
+{
+    return (uint64_t)time->tv_sec * 1000000000ULL + time->tv_usec * 1000ULL;
+}
+
+static bool
+stats_counter_read(enum stats_counter counter, uint64_t *value)
+{
+    int fd = stats_counters[counter];
+
+    if (fd < 0)
+        return false;
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, value, sizeof(*value)) != sizeof(*value))
+        return false;
+
+    return true;
+}
+
+static inline double
+stats_rate(uint64_t bytes, uint64_t nsec)
+{
+    if (!nsec)
+        return 0;
+    return (double)bytes * 1000.0 / nsec;
+}
+
+void
+csum_stats_report(FILE *stream, bool json)
+{
+    uint64_t counters[STATS_COUNTER_NR], wall, cpu;
+    bool valid[STATS_COUNTER_NR];
+    struct stats_stage *stage;
+    struct rusage usage;
+    unsigned int count;
+
+    if (!csum_stats_enabled)
+        return;
+
+    wall = stats_clock(CLOCK_MONOTONIC) - stats_total.wall;
+    getrusage(RUSAGE_SELF, &usage);
+    cpu = stats_timeval(&usage.ru_utime) + stats_timeval(&usage.ru_stime) -
+          stats_timeval(&stats_usage.ru_utime) - stats_timeval(&stats_usage.ru_stime);
+
+    for (count = 0; count < STATS_COUNTER_NR; ++count)
+        valid[count] = stats_counter_read(count, &counters[count]);
+
+    if (json) {
+        fprintf(stream, "{\"wall_ns\":%llu,\"cpu_ns\":%llu,\"stages\":{",
+                (unsigned long long)wall, (unsigned long long)cpu);
+        for (count = 0; count < CSUM_STAGE_NR; ++count) {
+            stage = &stats_stages[count];
+            fprintf(stream, "%s\"%s\":{\"calls\":%llu,\"bytes\":%llu,"
+                    "\"wall_ns\":%llu,\"cpu_ns\":%llu}",
+                    count ? "," : "", stage_names[count],
+                    (unsigned long long)stage->calls,
+                    (unsigned long long)stage->bytes,
+                    (unsigned long long)stage->wall,
+                    (unsigned long long)stage->cpu);
+        }
+        fprintf(stream, "},\"faults\":{\"minor\":%ld,\"major\":%ld},\"counters\":{",
+                usage.ru_minflt - stats_usage.ru_minflt,
+                usage.ru_majflt - stats_usage.ru_majflt);
+        for (count = 0; count < STATS_COUNTER_NR; ++count) {
+            fprintf(stream, "%s\"%s\":", count ? "," : "", counter_names[count]);
+            if (valid[count])
+                fprintf(stream, "%llu", (unsigned long long)counters[count]);
+            else
+                fprintf(stream, "null");
+        }
+        fprintf(stream, "}}\n");
+        return;
+    }
+
+    fprintf(stream, "%-8s %10s %14s %12s %12s %10s\n",
+            "stage", "calls", "bytes", "wall(ms)", "cpu(ms)", "MB/s");
+    for (count = 0; count < CSUM_STAGE_NR; ++count) {
+        stage = &stats_stages[count];
+        fprintf(stream, "%-8s %10llu %14llu %12.3f %12.3f %10.1f\n",
+                stage_names[count], (unsigned long long)stage->calls,
+                (unsigned long long)stage->bytes, stage->wall / 1e6,
+                stage->cpu / 1e6, stats_rate(stage->bytes, stage->wall));
+    }
+
+    fprintf(stream, "total: wall %.3fms, cpu %.3fms\n", wall / 1e6, cpu / 1e6);
+    fprintf(stream, "faults: minor %ld, major %ld\n",
+            usage.ru_minflt - stats_usage.ru_minflt,
+            usage.ru_majflt - stats_usage.ru_majflt);
+
+    for (count = 0; count < STATS_COUNTER_NR; ++count) {
+        if (valid[count])
+            fprintf(stream, "%s: %llu\n", counter_names[count],
+                    (unsigned long long)counters[count]);
+        else
+            fprintf(stream, "%s: unavailable\n", counter_names[count]);
+    }
+}
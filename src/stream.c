@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+
+/*
+ * Every algorithm keeps its running state in the context between
+ * compute rounds, so pushing is one round over a source that yields
+ * the new block once and then reports the end of this round only.
+ */
+static size_t
+stream_next_block(struct csum_context *ctx, struct csum_state *sta,
+                  uintptr_t consumed, const void **dest)
+{
+    struct csum_stream *stream = sta->pdata;
+    size_t length = stream->length;
+
+    if (!length)
+        return 0;
+
+    *dest = stream->data;
+    stream->length = 0;
+
+    return length;
+}
+
+void
+csum_stream_init(struct csum_context *ctx, struct csum_stream *stream)
+{
+    stream->sta.offset = 0;
+    stream->sta.pdata = stream;
+    stream->data = NULL;
+    stream->length = 0;
+}
+
+void
+csum_stream_update(struct csum_context *ctx, struct csum_stream *stream,
+                   const void *data, size_t length)
+{
+    if (!length)
+        return;
+
+    stream->data = data;
+    stream->length = length;
+    ctx->next_block = stream_next_block;
+    csum_next(ctx, &stream->sta);
+}
+
+const char *
+csum_stream_final(struct csum_context *ctx, struct csum_stream *stream)
+{
+    stream->length = 0;
+    ctx->next_block = stream_next_block;
+    return csum_next(ctx, &stream->sta);
+}
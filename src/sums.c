@@ -0,0 +1,336 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <sums.h>
+#include <bfdev/compiler.h>
+
+/*
+ * Every kernel returns the plain sum and the position weighted sum of
+ * one run. The vector loops keep the weighted sum of each block apart
+ * from the running first sum, which is added back once per run scaled
+ * by the block size, so no reduction happens inside the loop.
+ */
+
+static __always_inline void
+sums_merge(struct sums_block *block, const struct sums_block *tail, size_t words)
+{
+    block->sum2 += block->sum1 * words + tail->sum2;
+    block->sum1 += tail->sum1;
+}
+
+void
+sums_generic8(struct sums_block *block, const void *data, size_t words)
+{
+    const uint8_t *buff = data;
+    uint64_t sum1 = 0, sum2 = 0;
+
+    while (words--) {
+        sum1 += *buff++;
+        sum2 += sum1;
+    }
+
+    block->sum1 = sum1;
+    block->sum2 = sum2;
+}
+
+void
+sums_generic16(struct sums_block *block, const void *data, size_t words)
+{
+    const uint8_t *buff = data;
+    uint64_t sum1 = 0, sum2 = 0;
+
+    for (; words--; buff += 2) {
+        sum1 += buff[0] | (uint32_t)buff[1] << 8;
+        sum2 += sum1;
+    }
+
+    block->sum1 = sum1;
+    block->sum2 = sum2;
+}
+
+void
+sums_generic32(struct sums_block *block, const void *data, size_t words)
+{
+    const uint8_t *buff = data;
+    uint64_t sum1 = 0, sum2 = 0;
+
+    for (; words--; buff += 4) {
+        sum1 += buff[0] | (uint32_t)buff[1] << 8 |
+                (uint32_t)buff[2] << 16 | (uint32_t)buff[3] << 24;
+        sum2 += sum1;
+    }
+
+    block->sum1 = sum1;
+    block->sum2 = sum2;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+#define SSSE3_TARGET __attribute__((target("sse2,ssse3")))
+#define AVX2_TARGET __attribute__((target("sse2,ssse3,avx2")))
+
+static SSSE3_TARGET __always_inline uint64_t
+ssse3_hsum32(__m128i value)
+{
+    uint32_t lanes[4];
+
+    _mm_storeu_si128((__m128i *)lanes, value);
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static SSSE3_TARGET __always_inline uint64_t
+ssse3_hsum64(__m128i value)
+{
+    uint64_t lanes[2];
+
+    _mm_storeu_si128((__m128i *)lanes, value);
+    return lanes[0] + lanes[1];
+}
+
+static AVX2_TARGET __always_inline uint64_t
+avx2_hsum32(__m256i value)
+{
+    return ssse3_hsum32(_mm256_castsi256_si128(value)) +
+           ssse3_hsum32(_mm256_extracti128_si256(value, 1));
+}
+
+static AVX2_TARGET __always_inline uint64_t
+avx2_hsum64(__m256i value)
+{
+    return ssse3_hsum64(_mm256_castsi256_si128(value)) +
+           ssse3_hsum64(_mm256_extracti128_si256(value, 1));
+}
+
+SSSE3_TARGET void
+sums_ssse3_8(struct sums_block *block, const void *data, size_t words)
+{
+    const __m128i weights = _mm_setr_epi8(
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+    );
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vs1 = zero, vs2 = zero, vs1p = zero, value;
+    const uint8_t *buff = data;
+    struct sums_block tail;
+    size_t blocks;
+
+    for (blocks = words / 16; blocks; --blocks, buff += 16) {
+        value = _mm_loadu_si128((const __m128i *)buff);
+        vs1p = _mm_add_epi32(vs1p, vs1);
+        vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(value, zero));
+        vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(
+              _mm_maddubs_epi16(value, weights), ones));
+    }
+
+    block->sum1 = ssse3_hsum32(vs1);
+    block->sum2 = ssse3_hsum32(vs2) + (ssse3_hsum32(vs1p) << 4);
+
+    sums_generic8(&tail, buff, words % 16);
+    sums_merge(block, &tail, words % 16);
+}
+
+SSSE3_TARGET void
+sums_ssse3_16(struct sums_block *block, const void *data, size_t words)
+{
+    const __m128i wlow = _mm_setr_epi8(
+        8, 0, 7, 0, 6, 0, 5, 0, 4, 0, 3, 0, 2, 0, 1, 0
+    );
+    const __m128i whigh = _mm_slli_epi16(wlow, 8);
+    const __m128i mhigh = _mm_set1_epi16((short)0xff00);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vs1l = zero, vs1h = zero, vs1pl = zero, vs1ph = zero;
+    __m128i vs2l = zero, vs2h = zero, value, high;
+    const uint8_t *buff = data;
+    struct sums_block tail;
+    size_t blocks;
+
+    /* low and high bytes are weighted apart and joined at the end */
+    for (blocks = words / 8; blocks; --blocks, buff += 16) {
+        value = _mm_loadu_si128((const __m128i *)buff);
+        high = _mm_and_si128(value, mhigh);
+        vs1pl = _mm_add_epi32(vs1pl, vs1l);
+        vs1ph = _mm_add_epi32(vs1ph, vs1h);
+        vs1l = _mm_add_epi32(vs1l, _mm_sad_epu8(_mm_andnot_si128(mhigh, value), zero));
+        vs1h = _mm_add_epi32(vs1h, _mm_sad_epu8(high, zero));
+        vs2l = _mm_add_epi32(vs2l, _mm_madd_epi16(
+               _mm_maddubs_epi16(value, wlow), ones));
+        vs2h = _mm_add_epi32(vs2h, _mm_madd_epi16(
+               _mm_maddubs_epi16(value, whigh), ones));
+    }
+
+    block->sum1 = ssse3_hsum32(vs1l) + (ssse3_hsum32(vs1h) << 8);
+    block->sum2 = ssse3_hsum32(vs2l) + (ssse3_hsum32(vs1pl) << 3) +
+                  ((ssse3_hsum32(vs2h) + (ssse3_hsum32(vs1ph) << 3)) << 8);
+
+    sums_generic16(&tail, buff, words % 8);
+    sums_merge(block, &tail, words % 8);
+}
+
+SSSE3_TARGET void
+sums_ssse3_32(struct sums_block *block, const void *data, size_t words)
+{
+    const __m128i weven = _mm_set_epi64x(2, 4);
+    const __m128i wodd = _mm_set_epi64x(1, 3);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vs1 = zero, vs2 = zero, vs1p = zero, value, odd;
+    const uint8_t *buff = data;
+    struct sums_block tail;
+    size_t blocks;
+
+    for (blocks = words / 4; blocks; --blocks, buff += 16) {
+        value = _mm_loadu_si128((const __m128i *)buff);
+        odd = _mm_srli_epi64(value, 32);
+        vs1p = _mm_add_epi64(vs1p, vs1);
+        vs1 = _mm_add_epi64(vs1, _mm_add_epi64(odd,
+              _mm_and_si128(value, _mm_set1_epi64x(UINT32_MAX))));
+        vs2 = _mm_add_epi64(vs2, _mm_add_epi64(
+              _mm_mul_epu32(value, weven), _mm_mul_epu32(odd, wodd)));
+    }
+
+    block->sum1 = ssse3_hsum64(vs1);
+    block->sum2 = ssse3_hsum64(vs2) + (ssse3_hsum64(vs1p) << 2);
+
+    sums_generic32(&tail, buff, words % 4);
+    sums_merge(block, &tail, words % 4);
+}
+
+AVX2_TARGET void
+sums_avx2_8(struct sums_block *block, const void *data, size_t words)
+{
+    const __m256i weights = _mm256_setr_epi8(
+        32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+    );
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vs1 = zero, vs2 = zero, vs1p = zero, value;
+    const uint8_t *buff = data;
+    struct sums_block tail;
+    size_t blocks;
+
+    for (blocks = words / 32; blocks; --blocks, buff += 32) {
+        value = _mm256_loadu_si256((const __m256i *)buff);
+        vs1p = _mm256_add_epi32(vs1p, vs1);
+        vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(value, zero));
+        vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(
+              _mm256_maddubs_epi16(value, weights), ones));
+    }
+
+    block->sum1 = avx2_hsum32(vs1);
+    block->sum2 = avx2_hsum32(vs2) + (avx2_hsum32(vs1p) << 5);
+
+    sums_ssse3_8(&tail, buff, words % 32);
+    sums_merge(block, &tail, words % 32);
+}
+
+AVX2_TARGET void
+sums_avx2_16(struct sums_block *block, const void *data, size_t words)
+{
+    const __m256i wlow = _mm256_setr_epi8(
+        16, 0, 15, 0, 14, 0, 13, 0, 12, 0, 11, 0, 10, 0, 9, 0,
+        8, 0, 7, 0, 6, 0, 5, 0, 4, 0, 3, 0, 2, 0, 1, 0
+    );
+    const __m256i whigh = _mm256_slli_epi16(wlow, 8);
+    const __m256i mhigh = _mm256_set1_epi16((short)0xff00);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vs1l = zero, vs1h = zero, vs1pl = zero, vs1ph = zero;
+    __m256i vs2l = zero, vs2h = zero, value, high;
+    const uint8_t *buff = data;
+    struct sums_block tail;
+    size_t blocks;
+
+    for (blocks = words / 16; blocks; --blocks, buff += 32) {
+        value = _mm256_loadu_si256((const __m256i *)buff);
+        high = _mm256_and_si256(value, mhigh);
+        vs1pl = _mm256_add_epi32(vs1pl, vs1l);
+        vs1ph = _mm256_add_epi32(vs1ph, vs1h);
+        vs1l = _mm256_add_epi32(vs1l, _mm256_sad_epu8(
+               _mm256_andnot_si256(mhigh, value), zero));
+        vs1h = _mm256_add_epi32(vs1h, _mm256_sad_epu8(high, zero));
+        vs2l = _mm256_add_epi32(vs2l, _mm256_madd_epi16(
+               _mm256_maddubs_epi16(value, wlow), ones));
+        vs2h = _mm256_add_epi32(vs2h, _mm256_madd_epi16(
+               _mm256_maddubs_epi16(value, whigh), ones));
+    }
+
+    block->sum1 = avx2_hsum32(vs1l) + (avx2_hsum32(vs1h) << 8);
+    block->sum2 = avx2_hsum32(vs2l) + (avx2_hsum32(vs1pl) << 4) +
+                  ((avx2_hsum32(vs2h) + (avx2_hsum32(vs1ph) << 4)) << 8);
+
+    sums_ssse3_16(&tail, buff, words % 16);
+    sums_merge(block, &tail, words % 16);
+}
+
+AVX2_TARGET void
+sums_avx2_32(struct sums_block *block, const void *data, size_t words)
+{
+    const __m256i weven = _mm256_setr_epi64x(8, 6, 4, 2);
+    const __m256i wodd = _mm256_setr_epi64x(7, 5, 3, 1);
+    const __m256i mlow = _mm256_set1_epi64x(UINT32_MAX);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vs1 = zero, vs2 = zero, vs1p = zero, value, odd;
+    const uint8_t *buff = data;
+    struct sums_block tail;
+    size_t blocks;
+
+    for (blocks = words / 8; blocks; --blocks, buff += 32) {
+        value = _mm256_loadu_si256((const __m256i *)buff);
+        odd = _mm256_srli_epi64(value, 32);
+        vs1p = _mm256_add_epi64(vs1p, vs1);
+        vs1 = _mm256_add_epi64(vs1, _mm256_add_epi64(odd,
+              _mm256_and_si256(value, mlow)));
+        vs2 = _mm256_add_epi64(vs2, _mm256_add_epi64(
+              _mm256_mul_epu32(value, weven), _mm256_mul_epu32(odd, wodd)));
+    }
+
+    block->sum1 = avx2_hsum64(vs1);
+    block->sum2 = avx2_hsum64(vs2) + (avx2_hsum64(vs1p) << 3);
+
+    sums_ssse3_32(&tail, buff, words % 8);
+    sums_merge(block, &tail, words % 8);
+}
+
+#else /* !__x86_64__ */
+
+void
+sums_ssse3_8(struct sums_block *block, const void *data, size_t words)
+{
+    sums_generic8(block, data, words);
+}
+
+void
+sums_ssse3_16(struct sums_block *block, const void *data, size_t words)
+{
+    sums_generic16(block, data, words);
+}
+
+void
+sums_ssse3_32(struct sums_block *block, const void *data, size_t words)
+{
+    sums_generic32(block, data, words);
+}
+
+void
+sums_avx2_8(struct sums_block *block, const void *data, size_t words)
+{
+    sums_generic8(block, data, words);
+}
+
+void
+sums_avx2_16(struct sums_block *block, const void *data, size_t words)
+{
+    sums_generic16(block, data, words);
+}
+
+void
+sums_avx2_32(struct sums_block *block, const void *data, size_t words)
+{
+    sums_generic32(block, data, words);
+}
+
+#endif /* __x86_64__ */
@@ -0,0 +1,664 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/fs.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#define WATCH_BUFFER 0x10000
+#define WATCH_TAIL 64
+#define WATCH_LATENCY 10
+
+#define WATCH_DIR_EVENTS \
+    (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+     IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * Every watched file keeps its context and stream, so a change that
+ * only appended data resumes from the saved offset. A change counts as
+ * an append when the file is still the same inode, grew, got a new
+ * mtime and still ends the old data with the bytes hashed last. inotify
+ * does not say which bytes a write touched, so an overwrite of earlier
+ * bytes that also appends is not seen; @strict limits the resume to
+ * inodes the kernel keeps append-only (chattr +a), where that cannot
+ * happen. Anything else rehashes from the start.
+ */
+struct watch_entry {
+    char *path;
+    char *digest;
+    struct csum_context *ctx;
+    struct csum_stream stream;
+    struct timespec mtime;
+    uint8_t tail[WATCH_TAIL];
+    unsigned int ntail;
+    dev_t dev;
+    ino_t ino;
+    bool rewritten;
+    bool dirty;
+    bool gone;
+};
+
+/**
+ * struct watch_node - one inotify watch.
+ * @path: watched directory, or the file itself when @file is set.
+ * @name: last component of a watched file, reported by its directory.
+ */
+struct watch_node {
+    char *path;
+    const char *name;
+    int wd;
+    bool file;
+};
+
+struct watch_work {
+    FILE *stream;
+    struct csum_context *ctx;
+    struct watch_entry **entries;
+    unsigned int count;
+    unsigned int limit;
+    struct watch_node *nodes;
+    unsigned int nnodes;
+    unsigned int nlimit;
+    unsigned int dirty;
+    uint8_t buffer[WATCH_BUFFER];
+    bool strict;
+    int fd;
+};
+
+static int
+watch_compare(const void *key, const void *entry)
+{
+    return strcmp(key, (*(struct watch_entry *const *)entry)->path);
+}
+
+static struct watch_entry *
+watch_find(struct watch_work *work, const char *path)
+{
+    struct watch_entry **slot;
+
+    slot = bsearch(path, work->entries, work->count,
+                   sizeof(*work->entries), watch_compare);
+
+    return slot ? *slot : NULL;
+}
+
+/*
+ * The index stays sorted by path. Entries themselves never move, the
+ * stream state points back into its own entry.
+ */
+static struct watch_entry *
+watch_insert(struct watch_work *work, const char *path)
+{
+    struct watch_entry *entry, **block;
+    unsigned int index;
+
+    if (work->count == work->limit) {
+        work->limit = work->limit ? work->limit * 2 : 256;
+        block = bfdev_realloc(NULL, work->entries, sizeof(*block) * work->limit);
+        if (bfdev_unlikely(!block))
+            return NULL;
+        work->entries = block;
+    }
+
+    entry = bfdev_zalloc(NULL, sizeof(*entry));
+    if (bfdev_unlikely(!entry))
+        return NULL;
+
+    entry->path = strdup(path);
+    if (bfdev_unlikely(!entry->path)) {
+        bfdev_free(NULL, entry);
+        return NULL;
+    }
+
+    for (index = 0; index < work->count; ++index) {
+        if (strcmp(work->entries[index]->path, path) > 0)
+            break;
+    }
+
+    block = &work->entries[index];
+    memmove(block + 1, block, sizeof(*block) * (work->count - index));
+    *block = entry;
+    work->count++;
+
+    return entry;
+}
+
+static void
+watch_remove(struct watch_work *work, unsigned int index)
+{
+    struct watch_entry *entry = work->entries[index];
+
+    if (entry->ctx)
+        csum_destroy(entry->ctx);
+    free(entry->digest);
+    free(entry->path);
+    bfdev_free(NULL, entry);
+
+    work->count--;
+    memmove(&work->entries[index], &work->entries[index + 1],
+            sizeof(*work->entries) * (work->count - index));
+}
+
+static void
+watch_mark(struct watch_work *work, struct watch_entry *entry, bool gone)
+{
+    if (!entry->dirty)
+        work->dirty++;
+
+    entry->dirty = true;
+    entry->gone = gone;
+}
+
+/*
+ * A named file is watched through its directory, so an editor that
+ * saves by renaming a new file over the old one is still followed.
+ */
+static int
+watch_node(struct watch_work *work, const char *path, bool file)
+{
+    struct watch_node *node;
+    const char *name;
+    char *parent;
+    int wd;
+
+    if (!file)
+        wd = inotify_add_watch(work->fd, path, WATCH_DIR_EVENTS);
+    else {
+        name = strrchr(path, '/');
+        if (!name)
+            parent = strdup(".");
+        else if (name == path)
+            parent = strdup("/");
+        else
+            parent = strndup(path, name - path);
+        if (bfdev_unlikely(!parent))
+            return -ENOMEM;
+
+        wd = inotify_add_watch(work->fd, parent, WATCH_DIR_EVENTS);
+        free(parent);
+    }
+
+    if (wd < 0)
+        return -errno;
+
+    if (work->nnodes == work->nlimit) {
+        work->nlimit = work->nlimit ? work->nlimit * 2 : 16;
+        node = bfdev_realloc(NULL, work->nodes, sizeof(*node) * work->nlimit);
+        if (bfdev_unlikely(!node))
+            return -ENOMEM;
+        work->nodes = node;
+    }
+
+    node = &work->nodes[work->nnodes];
+    node->path = strdup(path);
+    if (bfdev_unlikely(!node->path))
+        return -ENOMEM;
+
+    name = strrchr(node->path, '/');
+    node->name = name ? name + 1 : node->path;
+    node->wd = wd;
+    node->file = file;
+    work->nnodes++;
+
+    return 0;
+}
+
+static int
+watch_track(struct watch_work *work, const char *path)
+{
+    struct watch_entry *entry;
+
+    entry = watch_find(work, path);
+    if (!entry) {
+        entry = watch_insert(work, path);
+        if (bfdev_unlikely(!entry))
+            return -ENOMEM;
+    }
+
+    watch_mark(work, entry, false);
+    return 0;
+}
+
+/* directories are watched one level deep, the files right inside */
+static int
+watch_collect(struct watch_work *work, const char *path)
+{
+    struct dirent *dirent;
+    struct stat stat;
+    char *child;
+    DIR *dir;
+    int retval;
+
+    if (lstat(path, &stat) < 0)
+        return -errno;
+
+    if (S_ISREG(stat.st_mode)) {
+        if ((retval = watch_node(work, path, true)))
+            return retval;
+        return watch_track(work, path);
+    }
+
+    if (!S_ISDIR(stat.st_mode))
+        return 0;
+
+    if ((retval = watch_node(work, path, false)))
+        return retval;
+
+    dir = opendir(path);
+    if (!dir)
+        return -errno;
+
+    while ((dirent = readdir(dir))) {
+        if (asprintf(&child, "%s/%s", path, dirent->d_name) < 0) {
+            closedir(dir);
+            return -ENOMEM;
+        }
+
+        retval = 0;
+        if (!lstat(child, &stat) && S_ISREG(stat.st_mode))
+            retval = watch_track(work, child);
+        free(child);
+
+        if (retval) {
+            closedir(dir);
+            return retval;
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+static struct csum_context *
+watch_context(struct watch_work *work, struct watch_entry *entry)
+{
+    /* contexts keep their running value, start the file afresh */
+    if (entry->ctx && !csum_reset(entry->ctx))
+        return entry->ctx;
+
+    if (entry->ctx)
+        csum_destroy(entry->ctx);
+
+    entry->ctx = csum_clone(work->ctx);
+    return entry->ctx;
+}
+
+static bool
+watch_append_only(int fd)
+{
+    int flags;
+
+    if (ioctl(fd, FS_IOC_GETFLAGS, &flags) < 0)
+        return false;
+
+    return flags & FS_APPEND_FL;
+}
+
+static bool
+watch_appended(struct watch_work *work, struct watch_entry *entry,
+               int fd, const struct stat *stat)
+{
+    uint64_t offset = entry->stream.sta.offset;
+
+    if (!entry->digest || entry->rewritten ||
+        entry->dev != stat->st_dev || entry->ino != stat->st_ino ||
+        (uint64_t)stat->st_size < offset)
+        return false;
+
+    /* same size and a new mtime is a rewrite in place */
+    if ((uint64_t)stat->st_size == offset)
+        return entry->mtime.tv_sec == stat->st_mtim.tv_sec &&
+               entry->mtime.tv_nsec == stat->st_mtim.tv_nsec;
+
+    /* data written without touching mtime was put there on purpose */
+    if (entry->mtime.tv_sec == stat->st_mtim.tv_sec &&
+        entry->mtime.tv_nsec == stat->st_mtim.tv_nsec)
+        return false;
+
+    if (work->strict && !watch_append_only(fd))
+        return false;
+
+    if (entry->ntail && pread(fd, work->buffer, entry->ntail,
+        offset - entry->ntail) != (ssize_t)entry->ntail)
+        return false;
+
+    return !memcmp(work->buffer, entry->tail, entry->ntail);
+}
+
+static void
+watch_keep_tail(struct watch_entry *entry, const uint8_t *data, size_t length)
+{
+    unsigned int keep;
+
+    if (length >= WATCH_TAIL) {
+        memcpy(entry->tail, data + length - WATCH_TAIL, WATCH_TAIL);
+        entry->ntail = WATCH_TAIL;
+        return;
+    }
+
+    keep = bfdev_min(entry->ntail, WATCH_TAIL - (unsigned int)length);
+    memmove(entry->tail, entry->tail + entry->ntail - keep, keep);
+    memcpy(entry->tail + keep, data, length);
+    entry->ntail = keep + length;
+}
+
+/*
+ * Brings one entry up to date. Returns the event to report, NULL when
+ * nothing changed, or sets @error when the file could not be hashed.
+ */
+static const char *
+watch_refresh(struct watch_work *work, struct watch_entry *entry, int *error)
+{
+    struct csum_context *ctx;
+    const char *event, *result;
+    struct stat stat;
+    uint64_t offset;
+    ssize_t length;
+    char *digest;
+    int fd;
+
+    fd = open(entry->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        *error = -errno;
+        return NULL;
+    }
+
+    if (fstat(fd, &stat) < 0 || !S_ISREG(stat.st_mode)) {
+        *error = -EINVAL;
+        goto failed;
+    }
+
+    if (watch_appended(work, entry, fd, &stat)) {
+        ctx = entry->ctx;
+        event = "append";
+        if ((uint64_t)stat.st_size == entry->stream.sta.offset) {
+            close(fd);
+            return NULL;
+        }
+    } else {
+        event = entry->digest ? "change" : "create";
+        ctx = watch_context(work, entry);
+        if (!ctx) {
+            *error = -ENOMEM;
+            goto failed;
+        }
+        csum_stream_init(ctx, &entry->stream);
+        entry->ntail = 0;
+    }
+
+    for (offset = entry->stream.sta.offset;; offset += length) {
+        length = pread(fd, work->buffer, WATCH_BUFFER, offset);
+        if (length <= 0)
+            break;
+
+        csum_stream_update(ctx, &entry->stream, work->buffer, length);
+        watch_keep_tail(entry, work->buffer, length);
+    }
+
+    if (length < 0) {
+        *error = -errno;
+        goto failed;
+    }
+
+    /* a file that changed size while being read is rehashed next time */
+    entry->rewritten = offset != (uint64_t)stat.st_size;
+    entry->dev = stat.st_dev;
+    entry->ino = stat.st_ino;
+
+    result = csum_stream_final(ctx, &entry->stream);
+    if (!result || !(digest = strdup(result))) {
+        *error = -ENOMEM;
+        goto failed;
+    }
+
+    entry->mtime = stat.st_mtim;
+    if (entry->digest && !strcmp(entry->digest, digest)) {
+        free(digest);
+        event = NULL;
+    } else {
+        free(entry->digest);
+        entry->digest = digest;
+    }
+
+    close(fd);
+    return event;
+
+failed:
+    close(fd);
+    return NULL;
+}
+
+static void
+watch_flush(struct watch_work *work, bool scan)
+{
+    struct watch_entry *entry;
+    const char *event;
+    unsigned int index;
+    int error;
+
+    for (index = 0; index < work->count;) {
+        entry = work->entries[index];
+        if (!entry->dirty) {
+            index++;
+            continue;
+        }
+
+        entry->dirty = false;
+        error = 0;
+
+        event = entry->gone ? NULL : watch_refresh(work, entry, &error);
+        if (entry->gone || error) {
+            if (!scan && entry->digest)
+                fprintf(work->stream, "delete - 0 %s\n", entry->path);
+            watch_remove(work, index);
+            continue;
+        }
+
+        if (event)
+            fprintf(work->stream, "%s %s %llu %s\n", scan ? "scan" : event,
+                    entry->digest, (unsigned long long)entry->stream.sta.offset,
+                    entry->path);
+        index++;
+    }
+
+    work->dirty = 0;
+    fflush(work->stream);
+}
+
+static int
+watch_change(struct watch_work *work, const char *path, uint32_t mask)
+{
+    struct watch_entry *entry;
+
+    entry = watch_find(work, path);
+    if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if (entry)
+            watch_mark(work, entry, true);
+        return 0;
+    }
+
+    if (!entry)
+        return watch_track(work, path);
+
+    watch_mark(work, entry, false);
+    return 0;
+}
+
+static int
+watch_event(struct watch_work *work, const struct inotify_event *event)
+{
+    struct watch_node *node;
+    unsigned int index;
+    char *path, *last = NULL;
+    int retval = 0;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+        /* events were lost, check every file again */
+        for (index = 0; index < work->count; ++index) {
+            work->entries[index]->rewritten = true;
+            watch_mark(work, work->entries[index], false);
+        }
+        return 0;
+    }
+
+    /* a directory itself went away, its files report on their own */
+    if ((event->mask & (IN_ISDIR | IN_IGNORED)) || !event->len)
+        return 0;
+
+    /* named files share the watch of their directory */
+    for (index = 0; index < work->nnodes && !retval; ++index) {
+        node = &work->nodes[index];
+        if (node->wd != event->wd ||
+            (node->file && strcmp(node->name, event->name)))
+            continue;
+
+        if (node->file)
+            path = strdup(node->path);
+        else if (asprintf(&path, "%s/%s", node->path, event->name) < 0)
+            path = NULL;
+
+        if (bfdev_unlikely(!path)) {
+            retval = -ENOMEM;
+            break;
+        }
+
+        if (!last || strcmp(last, path))
+            retval = watch_change(work, path, event->mask);
+
+        free(last);
+        last = path;
+    }
+
+    free(last);
+    return retval;
+}
+
+static uint64_t
+watch_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+ * Bursts of writes are coalesced: changes are only hashed once the
+ * queue stayed quiet for @delay milliseconds, or after a few delays
+ * in a row for files that never stop changing.
+ */
+static int
+watch_loop(struct watch_work *work, unsigned int delay)
+{
+    uint8_t events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct pollfd pollfd;
+    uint64_t first = 0;
+    ssize_t length;
+    size_t offset;
+    int retval;
+
+    pollfd.fd = work->fd;
+    pollfd.events = POLLIN;
+
+    for (;;) {
+        retval = poll(&pollfd, 1, work->dirty ? (int)delay : -1);
+        if (retval < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+
+        if (!retval || (work->dirty && watch_clock() - first >= (uint64_t)delay * WATCH_LATENCY)) {
+            watch_flush(work, false);
+            if (!retval)
+                continue;
+        }
+
+        length = read(work->fd, events, sizeof(events));
+        if (length < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -errno;
+        }
+
+        if (!work->dirty)
+            first = watch_clock();
+
+        for (offset = 0; offset < (size_t)length;
+             offset += sizeof(*event) + event->len) {
+            event = (const void *)(events + offset);
+            if ((retval = watch_event(work, event)))
+                return retval;
+        }
+    }
+}
+
+int
+csum_watch(FILE *stream, const char *name, const char *args,
+           const char *const *paths, unsigned int count, unsigned int delay,
+           bool strict)
+{
+    struct watch_work *work;
+    unsigned int index;
+    int retval = 0;
+
+    work = bfdev_zalloc(NULL, sizeof(*work));
+    if (bfdev_unlikely(!work))
+        return -ENOMEM;
+
+    work->stream = stream;
+    work->strict = strict;
+    work->fd = -1;
+    work->ctx = csum_prepare(name, args, 0);
+    if (!work->ctx) {
+        retval = -ENOENT;
+        goto finish;
+    }
+
+    work->fd = inotify_init1(IN_CLOEXEC);
+    if (work->fd < 0) {
+        retval = -errno;
+        goto finish;
+    }
+
+    /* watches go in before the scan, nothing slips in between */
+    for (index = 0; index < count; ++index) {
+        if ((retval = watch_collect(work, paths[index])) < 0)
+            goto finish;
+    }
+
+    watch_flush(work, true);
+    retval = watch_loop(work, delay);
+
+finish:
+    while (work->count)
+        watch_remove(work, work->count - 1);
+    for (index = 0; index < work->nnodes; ++index)
+        free(work->nodes[index].path);
+
+    if (work->fd >= 0)
+        close(work->fd);
+    if (work->ctx)
+        csum_destroy(work->ctx);
+
+    bfdev_free(NULL, work->nodes);
+    bfdev_free(NULL, work->entries);
+    bfdev_free(NULL, work);
+
+    return retval;
+}
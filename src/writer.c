@@ -0,0 +1,465 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <csum.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+/*
+ * Records are formatted straight into one large buffer and leave it
+ * with a single write once it runs full, never split across writes.
+ * Each thread owns its writer, so there is no lock on the way.
+ */
+
+#define WRITER_MAGIC "CSUMREC1"
+
+enum {
+    WRITER_ALGO = 1,
+    WRITER_RESULT = 2,
+};
+
+enum {
+    WRITER_TEXT = BFDEV_BIT(0),
+};
+
+static int
+writer_write(int fd, const void *data, size_t length)
+{
+    ssize_t retval;
+
+    while (length) {
+        retval = write(fd, data, length);
+        if (retval < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+
+        data = (const uint8_t *)data + retval;
+        length -= retval;
+    }
+
+    return 0;
+}
+
+int
+csum_writer_flush(struct csum_writer *writer)
+{
+    int retval;
+
+    retval = writer_write(writer->fd, writer->buffer, writer->used);
+    writer->used = 0;
+
+    return retval;
+}
+
+/* room for @length more bytes, a record never straddles two writes */
+static int
+writer_reserve(struct csum_writer *writer, size_t length)
+{
+    if (writer->used + length <= CSUM_WRITER_BUFFER)
+        return 0;
+
+    if (length > CSUM_WRITER_BUFFER)
+        return -EMSGSIZE;
+
+    return csum_writer_flush(writer);
+}
+
+static __always_inline void
+writer_put(struct csum_writer *writer, const void *data, size_t length)
+{
+    memcpy(writer->buffer + writer->used, data, length);
+    writer->used += length;
+}
+
+static __always_inline void
+writer_le(struct csum_writer *writer, uint64_t value, unsigned int bytes)
+{
+    while (bytes--) {
+        writer->buffer[writer->used++] = value;
+        value >>= 8;
+    }
+}
+
+/* length of the well formed utf-8 sequence at @string, 0 if there is none */
+static unsigned int
+writer_utf8(const unsigned char *string)
+{
+    unsigned int length, index;
+    uint32_t code;
+
+    if (string[0] < 0xc2 || string[0] > 0xf4)
+        return 0;
+
+    length = string[0] < 0xe0 ? 2 : string[0] < 0xf0 ? 3 : 4;
+    code = string[0] & (0x7f >> length);
+
+    for (index = 1; index < length; ++index) {
+        if ((string[index] & 0xc0) != 0x80)
+            return 0;
+        code = code << 6 | (string[index] & 0x3f);
+    }
+
+    /* overlong forms, surrogates and anything past the last plane */
+    if ((length == 3 && code < 0x800) || (length == 4 && code < 0x10000) ||
+        (code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff)
+        return 0;
+
+    return length;
+}
+
+/*
+ * Paths are bytes, not text. Bytes that do not form valid utf-8 are
+ * escaped one by one as the latin-1 code point of the same value, so
+ * the document always parses. That is lossy, writer_json() adds the
+ * exact bytes next to such a string.
+ */
+static void
+writer_string(struct csum_writer *writer, const char *string)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *walk = (const unsigned char *)string;
+    unsigned int length;
+    unsigned char ch;
+
+    writer->buffer[writer->used++] = '"';
+    while ((ch = *walk)) {
+        if (ch == '"' || ch == '\\') {
+            writer->buffer[writer->used++] = '\\';
+            writer->buffer[writer->used++] = ch;
+        } else if (ch >= 0x20 && ch < 0x7f)
+            writer->buffer[writer->used++] = ch;
+        else if (ch >= 0x80 && (length = writer_utf8(walk))) {
+            writer_put(writer, walk, length);
+            walk += length;
+            continue;
+        } else {
+            writer_put(writer, "\\u00", 4);
+            writer->buffer[writer->used++] = hex[ch >> 4];
+            writer->buffer[writer->used++] = hex[ch & 0xf];
+        }
+        walk++;
+    }
+    writer->buffer[writer->used++] = '"';
+}
+
+static bool
+writer_valid(const char *string)
+{
+    const unsigned char *walk = (const unsigned char *)string;
+    unsigned int length;
+
+    while (*walk) {
+        if (*walk < 0x80)
+            walk++;
+        else if ((length = writer_utf8(walk)))
+            walk += length;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+static void
+writer_base64(struct csum_writer *writer, const char *string)
+{
+    static const char table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *walk = (const unsigned char *)string;
+    size_t length = strlen(string);
+    uint32_t value;
+
+    writer->buffer[writer->used++] = '"';
+    for (; length >= 3; walk += 3, length -= 3) {
+        value = walk[0] << 16 | walk[1] << 8 | walk[2];
+        writer->buffer[writer->used++] = table[value >> 18];
+        writer->buffer[writer->used++] = table[value >> 12 & 0x3f];
+        writer->buffer[writer->used++] = table[value >> 6 & 0x3f];
+        writer->buffer[writer->used++] = table[value & 0x3f];
+    }
+
+    if (length) {
+        value = walk[0] << 16 | (length > 1 ? walk[1] << 8 : 0);
+        writer->buffer[writer->used++] = table[value >> 18];
+        writer->buffer[writer->used++] = table[value >> 12 & 0x3f];
+        writer->buffer[writer->used++] = length > 1 ? table[value >> 6 & 0x3f] : '=';
+        writer->buffer[writer->used++] = '=';
+    }
+    writer->buffer[writer->used++] = '"';
+}
+
+static int
+writer_nibble(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Numbers are printed in a field of "0x" and the digest width in
+ * digits, but printf drops the prefix of a zero and pads two more
+ * zeros instead. Either way the digits behind the first two bytes are
+ * the digest at its full width.
+ */
+static const char *
+writer_hex(const struct csum_record *record, size_t *digits)
+{
+    const char *walk = record->result;
+    size_t length, index;
+
+    if (record->prefixed) {
+        if (walk[0] != '0' || (walk[1] != 'x' && walk[1] != 'X' && walk[1] != '0'))
+            return NULL;
+        walk += 2;
+    }
+
+    length = strlen(walk);
+    for (index = 0; index < length; ++index) {
+        if (writer_nibble(walk[index]) < 0)
+            return NULL;
+    }
+
+    *digits = length;
+    return length ? walk : NULL;
+}
+
+static int
+writer_json(struct csum_writer *writer, const struct csum_record *record)
+{
+    const char *digest;
+    char number[48];
+    size_t digits;
+    int retval;
+
+    /* escapes grow a byte to six at most, base64 to two */
+    retval = writer_reserve(writer, 128 + (strlen(record->algo) +
+        (record->para ? strlen(record->para) : 0) + strlen(record->path) +
+        strlen(record->result)) * 6 + strlen(record->path) * 2);
+    if (retval)
+        return retval;
+
+    if (writer->format == CSUM_FORMAT_JSON)
+        writer_put(writer, writer->records ? ",\n  " : "\n  ", writer->records ? 4 : 3);
+
+    writer_put(writer, "{\"algo\":", 8);
+    writer_string(writer, record->algo);
+    if (record->para) {
+        writer_put(writer, ",\"param\":", 9);
+        writer_string(writer, record->para);
+    }
+
+    writer_put(writer, ",\"path\":", 8);
+    writer_string(writer, record->path);
+
+    /* the escaped path is only readable, these are the actual bytes */
+    if (!writer_valid(record->path)) {
+        writer_put(writer, ",\"path_b64\":", 12);
+        writer_base64(writer, record->path);
+    }
+
+    if (record->ranged) {
+        writer_put(writer, number, sprintf(number, ",\"offset\":%llu",
+                   (unsigned long long)record->offset));
+    }
+
+    writer_put(writer, number, sprintf(number, ",\"size\":%llu,\"digest\":",
+               (unsigned long long)record->size));
+    digest = writer_hex(record, &digits);
+    if (digest && record->prefixed) {
+        writer_put(writer, "\"0x", 3);
+        writer_put(writer, digest, digits);
+        writer_put(writer, "\"", 1);
+    } else
+        writer_string(writer, record->result);
+    writer_put(writer, "}", 1);
+
+    if (writer->format == CSUM_FORMAT_NDJSON)
+        writer_put(writer, "\n", 1);
+
+    return 0;
+}
+
+/*
+ * Hex results are stored as raw bytes, an odd digit count gets a
+ * leading zero nibble. Anything else is kept as text and flagged.
+ */
+static size_t
+writer_digest(const struct csum_record *record, uint8_t *digest, size_t size,
+              unsigned int *flags)
+{
+    const char *result = record->result, *walk;
+    size_t length, index;
+
+    walk = writer_hex(record, &length);
+    if (!walk || (length + 1) / 2 > size) {
+        length = bfdev_min(strlen(result), size);
+        memcpy(digest, result, length);
+        *flags |= WRITER_TEXT;
+        return length;
+    }
+
+    for (index = 0; index < (length + 1) / 2; ++index) {
+        if (length & 1)
+            digest[index] = (index ? writer_nibble(walk[index * 2 - 1]) << 4 : 0) |
+                            writer_nibble(walk[index * 2]);
+        else
+            digest[index] = writer_nibble(walk[index * 2]) << 4 |
+                            writer_nibble(walk[index * 2 + 1]);
+    }
+
+    return index;
+}
+
+static int
+writer_algo(struct csum_writer *writer, const char *algo)
+{
+    size_t length = strlen(algo);
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < writer->nalgos; ++index) {
+        if (!strcmp(writer->algos[index], algo))
+            return index;
+    }
+
+    if (writer->nalgos == CSUM_WRITER_ALGOS || length > UINT16_MAX)
+        return -ENOSPC;
+
+    /* a failed flush must not leave a name behind without its record */
+    if ((retval = writer_reserve(writer, 8 + length)))
+        return retval;
+
+    writer->algos[index] = strdup(algo);
+    if (bfdev_unlikely(!writer->algos[index]))
+        return -ENOMEM;
+
+    /* type, flags, algo id and payload length, then the name */
+    writer_le(writer, WRITER_ALGO, 1);
+    writer_le(writer, 0, 1);
+    writer_le(writer, index, 2);
+    writer_le(writer, length, 4);
+    writer_put(writer, algo, length);
+
+    writer->nalgos++;
+    return index;
+}
+
+static int
+writer_binary(struct csum_writer *writer, const struct csum_record *record)
+{
+    uint8_t digest[CSUM_WRITER_DIGEST];
+    unsigned int flags = 0;
+    size_t length, plen;
+    int algo, retval;
+
+    if ((algo = writer_algo(writer, record->algo)) < 0)
+        return algo;
+
+    length = writer_digest(record, digest, sizeof(digest), &flags);
+    plen = strlen(record->path);
+    if (plen > UINT16_MAX)
+        return -ENAMETOOLONG;
+
+    if ((retval = writer_reserve(writer, 32 + length + plen)))
+        return retval;
+
+    writer_le(writer, WRITER_RESULT, 1);
+    writer_le(writer, flags, 1);
+    writer_le(writer, algo, 2);
+    writer_le(writer, 24 + length + plen, 4);
+    writer_le(writer, record->offset, 8);
+    writer_le(writer, record->size, 8);
+    writer_le(writer, length, 2);
+    writer_le(writer, plen, 2);
+    writer_le(writer, 0, 4);
+    writer_put(writer, digest, length);
+    writer_put(writer, record->path, plen);
+
+    return 0;
+}
+
+int
+csum_writer_record(struct csum_writer *writer, const struct csum_record *record)
+{
+    int retval;
+
+    if (writer->format == CSUM_FORMAT_BINARY)
+        retval = writer_binary(writer, record);
+    else
+        retval = writer_json(writer, record);
+
+    if (!retval)
+        writer->records++;
+
+    return retval;
+}
+
+int
+csum_format_parse(const char *name)
+{
+    if (!strcmp(name, "json"))
+        return CSUM_FORMAT_JSON;
+    if (!strcmp(name, "ndjson"))
+        return CSUM_FORMAT_NDJSON;
+    if (!strcmp(name, "binary"))
+        return CSUM_FORMAT_BINARY;
+    if (!strcmp(name, "text"))
+        return CSUM_FORMAT_TEXT;
+
+    return -EINVAL;
+}
+
+struct csum_writer *
+csum_writer_create(int fd, enum csum_format format)
+{
+    struct csum_writer *writer;
+
+    writer = bfdev_malloc(NULL, sizeof(*writer));
+    if (bfdev_unlikely(!writer))
+        return NULL;
+
+    writer->fd = fd;
+    writer->format = format;
+    writer->records = 0;
+    writer->nalgos = 0;
+    writer->used = 0;
+
+    if (format == CSUM_FORMAT_BINARY)
+        writer_put(writer, WRITER_MAGIC, 8);
+    else if (format == CSUM_FORMAT_JSON)
+        writer_put(writer, "[", 1);
+
+    return writer;
+}
+
+int
+csum_writer_destroy(struct csum_writer *writer)
+{
+    unsigned int index;
+    int retval;
+
+    retval = writer_reserve(writer, 3);
+    if (!retval && writer->format == CSUM_FORMAT_JSON)
+        writer_put(writer, writer->records ? "\n]\n" : "]\n",
+                   writer->records ? 3 : 2);
+
+    if (!retval)
+        retval = csum_writer_flush(writer);
+    for (index = 0; index < writer->nalgos; ++index)
+        free(writer->algos[index]);
+    bfdev_free(NULL, writer);
+
+    return retval;
+}
@@ -0,0 +1,991 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2023 John Sanpe <sanpeqf@gmail.com>
+ */
+
+#include <csum.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bfdev/allocator.h>
+#include <bfdev/minmax.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define XXH3_STRIPE 64
+#define XXH3_ACC 8
+#define XXH3_SECRET 192
+#define XXH3_SECRET_MIN 136
+#define XXH3_SECRET_RATE 8
+#define XXH3_SECRET_LIMIT (XXH3_SECRET - XXH3_STRIPE)
+#define XXH3_SECRET_MERGE 11
+#define XXH3_SECRET_LAST 7
+#define XXH3_BLOCK_STRIPES (XXH3_SECRET_LIMIT / XXH3_SECRET_RATE)
+#define XXH3_BUFFER 256
+#define XXH3_BUFFER_STRIPES (XXH3_BUFFER / XXH3_STRIPE)
+#define XXH3_MIDSIZE 240
+#define XXH3_MID_START 3
+#define XXH3_MID_LAST 17
+
+#define XXH3_PRIME32_1 0x9e3779b1U
+#define XXH3_PRIME32_2 0x85ebca77U
+#define XXH3_PRIME32_3 0xc2b2ae3dU
+#define XXH3_PRIME64_1 0x9e3779b185ebca87ULL
+#define XXH3_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define XXH3_PRIME64_3 0x165667b19e3779f9ULL
+#define XXH3_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define XXH3_PRIME64_5 0x27d4eb2f165667c5ULL
+#define XXH3_PRIME_MX1 0x165667919e3779f9ULL
+#define XXH3_PRIME_MX2 0x9fb21c651e98df25ULL
+
+static const uint8_t xxh3_secret[XXH3_SECRET] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+/**
+ * struct xxh3_kernel - stripe kernels of one instruction set.
+ * @accumulate: fold @stripes consecutive stripes into the accumulators,
+ *              the secret advancing by eight bytes per stripe.
+ * @scramble: scramble the accumulators at the end of a block.
+ */
+struct xxh3_kernel {
+    void (*accumulate)(uint64_t *acc, const uint8_t *data,
+                       const uint8_t *secret, size_t stripes);
+    void (*scramble)(uint64_t *acc, const uint8_t *secret);
+};
+
+struct xxh3_impl {
+    struct csum_algo algo;
+    const struct xxh3_kernel *kernel;
+    bool registered;
+};
+
+#define algo_to_xxh3_impl(ptr) \
+    bfdev_container_of(ptr, struct xxh3_impl, algo)
+
+/**
+ * struct xxh3_state - streaming state.
+ * @acc: accumulators of the long input path.
+ * @secret: secret derived from the seed.
+ * @buffer: pending bytes, the whole input while it is still short.
+ *          Its last stripe keeps the most recent consumed stripe, the
+ *          final stripe of the input may reach back into it.
+ * @seed: seed the secret was derived from.
+ * @total: bytes pushed so far.
+ * @buffered: pending bytes in @buffer.
+ * @stripes: stripes consumed in the current block.
+ */
+struct xxh3_state {
+    uint64_t acc[XXH3_ACC];
+    uint8_t secret[XXH3_SECRET];
+    uint8_t buffer[XXH3_BUFFER];
+    uint64_t seed;
+    uint64_t total;
+    size_t buffered;
+    size_t stripes;
+};
+
+struct xxh3_context {
+    struct csum_context csum;
+    char result[40];
+    struct xxh3_state state;
+};
+
+#define csum_to_xxh3(ptr) \
+    bfdev_container_of(ptr, struct xxh3_context, csum)
+
+static __always_inline uint32_t
+xxh3_read32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 |
+           (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static __always_inline uint64_t
+xxh3_read64(const uint8_t *data)
+{
+    return (uint64_t)xxh3_read32(data) | (uint64_t)xxh3_read32(data + 4) << 32;
+}
+
+static __always_inline void
+xxh3_write64(uint8_t *data, uint64_t value)
+{
+    unsigned int count;
+
+    for (count = 0; count < 8; ++count)
+        data[count] = value >> (count * 8);
+}
+
+static __always_inline uint64_t
+xxh3_mul128(uint64_t a, uint64_t b, uint64_t *high)
+{
+    unsigned __int128 product = (unsigned __int128)a * b;
+
+    *high = product >> 64;
+    return product;
+}
+
+static __always_inline uint64_t
+xxh3_fold64(uint64_t a, uint64_t b)
+{
+    uint64_t low, high;
+
+    low = xxh3_mul128(a, b, &high);
+    return low ^ high;
+}
+
+static __always_inline uint64_t
+xxh3_rotl64(uint64_t value, unsigned int shift)
+{
+    return value << shift | value >> (64 - shift);
+}
+
+static __always_inline uint64_t
+xxh3_xorshift(uint64_t value, unsigned int shift)
+{
+    return value ^ (value >> shift);
+}
+
+static __always_inline uint64_t
+xxh64_avalanche(uint64_t hash)
+{
+    hash = xxh3_xorshift(hash, 33) * XXH3_PRIME64_2;
+    hash = xxh3_xorshift(hash, 29) * XXH3_PRIME64_3;
+    return xxh3_xorshift(hash, 32);
+}
+
+static __always_inline uint64_t
+xxh3_avalanche(uint64_t hash)
+{
+    hash = xxh3_xorshift(hash, 37) * XXH3_PRIME_MX1;
+    return xxh3_xorshift(hash, 32);
+}
+
+static __always_inline uint64_t
+xxh3_rrmxmx(uint64_t hash, uint64_t length)
+{
+    hash ^= xxh3_rotl64(hash, 49) ^ xxh3_rotl64(hash, 24);
+    hash *= XXH3_PRIME_MX2;
+    hash ^= (hash >> 35) + length;
+    hash *= XXH3_PRIME_MX2;
+    return xxh3_xorshift(hash, 28);
+}
+
+static __always_inline uint64_t
+xxh3_mix16(const uint8_t *data, const uint8_t *secret, uint64_t seed)
+{
+    return xxh3_fold64(
+        xxh3_read64(data) ^ (xxh3_read64(secret) + seed),
+        xxh3_read64(data + 8) ^ (xxh3_read64(secret + 8) - seed)
+    );
+}
+
+static __always_inline void
+xxh3_mix32(uint64_t *low, uint64_t *high, const uint8_t *data1,
+           const uint8_t *data2, const uint8_t *secret, uint64_t seed)
+{
+    *low += xxh3_mix16(data1, secret, seed);
+    *low ^= xxh3_read64(data2) + xxh3_read64(data2 + 8);
+    *high += xxh3_mix16(data2, secret + 16, seed);
+    *high ^= xxh3_read64(data1) + xxh3_read64(data1 + 8);
+}
+
+/*
+ * Inputs up to XXH3_MIDSIZE bytes never reach the stripe kernels, they
+ * are hashed directly against the default secret and the seed.
+ */
+static uint64_t
+xxh3_short64(const uint8_t *data, size_t length, uint64_t seed)
+{
+    const uint8_t *secret = xxh3_secret;
+    uint64_t acc, acc_end, low, high;
+    unsigned int count;
+    uint32_t combined;
+
+    if (length > 128) {
+        acc = length * XXH3_PRIME64_1;
+        for (count = 0; count < 8; ++count)
+            acc += xxh3_mix16(data + 16 * count, secret + 16 * count, seed);
+
+        acc_end = xxh3_mix16(data + length - 16,
+                             secret + XXH3_SECRET_MIN - XXH3_MID_LAST, seed);
+        acc = xxh3_avalanche(acc);
+
+        for (count = 8; count < length / 16; ++count)
+            acc_end += xxh3_mix16(data + 16 * count, secret + 16 * (count - 8) +
+                                  XXH3_MID_START, seed);
+
+        return xxh3_avalanche(acc + acc_end);
+    }
+
+    if (length > 16) {
+        acc = length * XXH3_PRIME64_1;
+        if (length > 32) {
+            if (length > 64) {
+                if (length > 96) {
+                    acc += xxh3_mix16(data + 48, secret + 96, seed);
+                    acc += xxh3_mix16(data + length - 64, secret + 112, seed);
+                }
+                acc += xxh3_mix16(data + 32, secret + 64, seed);
+                acc += xxh3_mix16(data + length - 48, secret + 80, seed);
+            }
+            acc += xxh3_mix16(data + 16, secret + 32, seed);
+            acc += xxh3_mix16(data + length - 32, secret + 48, seed);
+        }
+        acc += xxh3_mix16(data, secret, seed);
+        acc += xxh3_mix16(data + length - 16, secret + 16, seed);
+        return xxh3_avalanche(acc);
+    }
+
+    if (length > 8) {
+        low = xxh3_read64(data) ^
+              ((xxh3_read64(secret + 24) ^ xxh3_read64(secret + 32)) + seed);
+        high = xxh3_read64(data + length - 8) ^
+               ((xxh3_read64(secret + 40) ^ xxh3_read64(secret + 48)) - seed);
+        acc = length + __builtin_bswap64(low) + high + xxh3_fold64(low, high);
+        return xxh3_avalanche(acc);
+    }
+
+    if (length >= 4) {
+        seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+        acc = xxh3_read32(data + length - 4) +
+              ((uint64_t)xxh3_read32(data) << 32);
+        acc ^= (xxh3_read64(secret + 8) ^ xxh3_read64(secret + 16)) - seed;
+        return xxh3_rrmxmx(acc, length);
+    }
+
+    if (length) {
+        combined = (uint32_t)data[0] << 16 | (uint32_t)data[length >> 1] << 24 |
+                   data[length - 1] | (uint32_t)length << 8;
+        acc = combined ^ ((uint64_t)(xxh3_read32(secret) ^
+              xxh3_read32(secret + 4)) + seed);
+        return xxh64_avalanche(acc);
+    }
+
+    return xxh64_avalanche(seed ^ xxh3_read64(secret + 56) ^
+                           xxh3_read64(secret + 64));
+}
+
+static uint64_t
+xxh3_short128(const uint8_t *data, size_t length, uint64_t seed, uint64_t *hash)
+{
+    const uint8_t *secret = xxh3_secret;
+    uint64_t low, high, value, mhigh;
+    uint32_t combined, combinedh;
+    unsigned int count;
+
+    if (length > 16) {
+        low = length * XXH3_PRIME64_1;
+        high = 0;
+
+        if (length > 128) {
+            for (count = 32; count < 160; count += 32)
+                xxh3_mix32(&low, &high, data + count - 32, data + count - 16,
+                           secret + count - 32, seed);
+
+            low = xxh3_avalanche(low);
+            high = xxh3_avalanche(high);
+
+            for (count = 160; count <= length; count += 32)
+                xxh3_mix32(&low, &high, data + count - 32, data + count - 16,
+                           secret + XXH3_MID_START + count - 160, seed);
+
+            xxh3_mix32(&low, &high, data + length - 16, data + length - 32,
+                       secret + XXH3_SECRET_MIN - XXH3_MID_LAST - 16, 0 - seed);
+        } else {
+            if (length > 32) {
+                if (length > 64) {
+                    if (length > 96)
+                        xxh3_mix32(&low, &high, data + 48, data + length - 64,
+                                   secret + 96, seed);
+                    xxh3_mix32(&low, &high, data + 32, data + length - 48,
+                               secret + 64, seed);
+                }
+                xxh3_mix32(&low, &high, data + 16, data + length - 32,
+                           secret + 32, seed);
+            }
+            xxh3_mix32(&low, &high, data, data + length - 16, secret, seed);
+        }
+
+        value = low + high;
+        *hash = 0 - xxh3_avalanche(low * XXH3_PRIME64_1 + high * XXH3_PRIME64_4 +
+                                   (length - seed) * XXH3_PRIME64_2);
+        return xxh3_avalanche(value);
+    }
+
+    if (length > 8) {
+        low = xxh3_read64(data);
+        high = xxh3_read64(data + length - 8);
+
+        value = xxh3_mul128(low ^ high ^ ((xxh3_read64(secret + 32) ^
+                            xxh3_read64(secret + 40)) - seed),
+                            XXH3_PRIME64_1, &mhigh);
+        value += (uint64_t)(length - 1) << 54;
+        high ^= (xxh3_read64(secret + 48) ^ xxh3_read64(secret + 56)) + seed;
+        mhigh += high + (uint64_t)(uint32_t)high * (XXH3_PRIME32_2 - 1);
+        value ^= __builtin_bswap64(mhigh);
+
+        low = xxh3_mul128(value, XXH3_PRIME64_2, &high);
+        high += mhigh * XXH3_PRIME64_2;
+        *hash = xxh3_avalanche(high);
+        return xxh3_avalanche(low);
+    }
+
+    if (length >= 4) {
+        seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+        value = xxh3_read32(data) + ((uint64_t)xxh3_read32(data + length - 4) << 32);
+        value ^= (xxh3_read64(secret + 16) ^ xxh3_read64(secret + 24)) + seed;
+
+        low = xxh3_mul128(value, XXH3_PRIME64_1 + (length << 2), &high);
+        high += low << 1;
+        low ^= high >> 3;
+        low = xxh3_xorshift(low, 35) * XXH3_PRIME_MX2;
+        *hash = xxh3_avalanche(high);
+        return xxh3_xorshift(low, 28);
+    }
+
+    if (length) {
+        combined = (uint32_t)data[0] << 16 | (uint32_t)data[length >> 1] << 24 |
+                   data[length - 1] | (uint32_t)length << 8;
+        combinedh = __builtin_bswap32(combined);
+        combinedh = combinedh << 13 | combinedh >> 19;
+        low = combined ^ ((uint64_t)(xxh3_read32(secret) ^
+              xxh3_read32(secret + 4)) + seed);
+        high = combinedh ^ ((uint64_t)(xxh3_read32(secret + 8) ^
+               xxh3_read32(secret + 12)) - seed);
+        *hash = xxh64_avalanche(high);
+        return xxh64_avalanche(low);
+    }
+
+    *hash = xxh64_avalanche(seed ^ xxh3_read64(secret + 80) ^
+                            xxh3_read64(secret + 88));
+    return xxh64_avalanche(seed ^ xxh3_read64(secret + 64) ^
+                           xxh3_read64(secret + 72));
+}
+
+static __always_inline void
+xxh3_generic_stripe(uint64_t *acc, const uint8_t *data, const uint8_t *secret)
+{
+    uint64_t value, key;
+    unsigned int count;
+
+    for (count = 0; count < XXH3_ACC; ++count) {
+        value = xxh3_read64(data + count * 8);
+        key = value ^ xxh3_read64(secret + count * 8);
+        acc[count ^ 1] += value;
+        acc[count] += (uint32_t)key * (key >> 32);
+    }
+}
+
+static void
+xxh3_generic_accumulate(uint64_t *acc, const uint8_t *data,
+                        const uint8_t *secret, size_t stripes)
+{
+    size_t count;
+
+    for (count = 0; count < stripes; ++count)
+        xxh3_generic_stripe(acc, data + count * XXH3_STRIPE,
+                            secret + count * XXH3_SECRET_RATE);
+}
+
+static void
+xxh3_generic_scramble(uint64_t *acc, const uint8_t *secret)
+{
+    unsigned int count;
+    uint64_t value;
+
+    for (count = 0; count < XXH3_ACC; ++count) {
+        value = xxh3_xorshift(acc[count], 47) ^ xxh3_read64(secret + count * 8);
+        acc[count] = value * XXH3_PRIME32_1;
+    }
+}
+
+static const struct xxh3_kernel
+xxh3_generic = {
+    .accumulate = xxh3_generic_accumulate,
+    .scramble = xxh3_generic_scramble,
+};
+
+#if defined(__x86_64__)
+
+#define XXH3_SSE2_TARGET __attribute__((target("sse2")))
+#define XXH3_AVX2_TARGET __attribute__((target("avx2")))
+#define XXH3_AVX512_TARGET __attribute__((target("avx2,avx512f")))
+
+/*
+ * Every kernel keeps the accumulators in registers across a run of
+ * stripes. Each 64 bit lane adds the 32x32 product of the keyed input
+ * halves plus the raw input of its neighbour lane, which the shuffle
+ * swaps into place. Scrambling multiplies by a 32 bit prime, built
+ * from two 32x32 products since there is no 64 bit vector multiply.
+ */
+
+static XXH3_SSE2_TARGET void
+xxh3_sse2_accumulate(uint64_t *acc, const uint8_t *data,
+                     const uint8_t *secret, size_t stripes)
+{
+    __m128i vacc[4], value, key;
+    unsigned int count;
+
+    for (count = 0; count < 4; ++count)
+        vacc[count] = _mm_loadu_si128((const __m128i *)acc + count);
+
+    while (stripes--) {
+        for (count = 0; count < 4; ++count) {
+            value = _mm_loadu_si128((const __m128i *)data + count);
+            key = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)secret + count));
+            vacc[count] = _mm_add_epi64(vacc[count], _mm_mul_epu32(key,
+                          _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1))));
+            vacc[count] = _mm_add_epi64(vacc[count],
+                          _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+
+        data += XXH3_STRIPE;
+        secret += XXH3_SECRET_RATE;
+    }
+
+    for (count = 0; count < 4; ++count)
+        _mm_storeu_si128((__m128i *)acc + count, vacc[count]);
+}
+
+static XXH3_SSE2_TARGET void
+xxh3_sse2_scramble(uint64_t *acc, const uint8_t *secret)
+{
+    __m128i value, prime = _mm_set1_epi32((int)XXH3_PRIME32_1);
+    unsigned int count;
+
+    for (count = 0; count < 4; ++count) {
+        value = _mm_loadu_si128((const __m128i *)acc + count);
+        value = _mm_xor_si128(value, _mm_srli_epi64(value, 47));
+        value = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)secret + count));
+        value = _mm_add_epi64(_mm_mul_epu32(value, prime), _mm_slli_epi64(
+                _mm_mul_epu32(_mm_srli_epi64(value, 32), prime), 32));
+        _mm_storeu_si128((__m128i *)acc + count, value);
+    }
+}
+
+static XXH3_AVX2_TARGET void
+xxh3_avx2_accumulate(uint64_t *acc, const uint8_t *data,
+                     const uint8_t *secret, size_t stripes)
+{
+    __m256i vacc[2], value, key;
+    unsigned int count;
+
+    for (count = 0; count < 2; ++count)
+        vacc[count] = _mm256_loadu_si256((const __m256i *)acc + count);
+
+    while (stripes--) {
+        for (count = 0; count < 2; ++count) {
+            value = _mm256_loadu_si256((const __m256i *)data + count);
+            key = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)secret + count));
+            vacc[count] = _mm256_add_epi64(vacc[count], _mm256_mul_epu32(key,
+                          _mm256_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1))));
+            vacc[count] = _mm256_add_epi64(vacc[count],
+                          _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+
+        data += XXH3_STRIPE;
+        secret += XXH3_SECRET_RATE;
+    }
+
+    for (count = 0; count < 2; ++count)
+        _mm256_storeu_si256((__m256i *)acc + count, vacc[count]);
+}
+
+static XXH3_AVX2_TARGET void
+xxh3_avx2_scramble(uint64_t *acc, const uint8_t *secret)
+{
+    __m256i value, prime = _mm256_set1_epi32((int)XXH3_PRIME32_1);
+    unsigned int count;
+
+    for (count = 0; count < 2; ++count) {
+        value = _mm256_loadu_si256((const __m256i *)acc + count);
+        value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+        value = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)secret + count));
+        value = _mm256_add_epi64(_mm256_mul_epu32(value, prime), _mm256_slli_epi64(
+                _mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime), 32));
+        _mm256_storeu_si256((__m256i *)acc + count, value);
+    }
+}
+
+static XXH3_AVX512_TARGET void
+xxh3_avx512_accumulate(uint64_t *acc, const uint8_t *data,
+                       const uint8_t *secret, size_t stripes)
+{
+    __m512i vacc, value, key;
+
+    vacc = _mm512_loadu_si512(acc);
+
+    while (stripes--) {
+        value = _mm512_loadu_si512(data);
+        key = _mm512_xor_si512(value, _mm512_loadu_si512(secret));
+        vacc = _mm512_add_epi64(vacc, _mm512_mul_epu32(key,
+               _mm512_shuffle_epi32(key, (_MM_PERM_ENUM)_MM_SHUFFLE(0, 3, 0, 1))));
+        vacc = _mm512_add_epi64(vacc,
+               _mm512_shuffle_epi32(value, (_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2)));
+
+        data += XXH3_STRIPE;
+        secret += XXH3_SECRET_RATE;
+    }
+
+    _mm512_storeu_si512(acc, vacc);
+}
+
+static XXH3_AVX512_TARGET void
+xxh3_avx512_scramble(uint64_t *acc, const uint8_t *secret)
+{
+    __m512i value, prime = _mm512_set1_epi32((int)XXH3_PRIME32_1);
+
+    value = _mm512_loadu_si512(acc);
+    value = _mm512_xor_si512(value, _mm512_srli_epi64(value, 47));
+    value = _mm512_xor_si512(value, _mm512_loadu_si512(secret));
+    value = _mm512_add_epi64(_mm512_mul_epu32(value, prime), _mm512_slli_epi64(
+            _mm512_mul_epu32(_mm512_srli_epi64(value, 32), prime), 32));
+    _mm512_storeu_si512(acc, value);
+}
+
+static const struct xxh3_kernel
+xxh3_sse2 = {
+    .accumulate = xxh3_sse2_accumulate,
+    .scramble = xxh3_sse2_scramble,
+};
+
+static const struct xxh3_kernel
+xxh3_avx2 = {
+    .accumulate = xxh3_avx2_accumulate,
+    .scramble = xxh3_avx2_scramble,
+};
+
+static const struct xxh3_kernel
+xxh3_avx512 = {
+    .accumulate = xxh3_avx512_accumulate,
+    .scramble = xxh3_avx512_scramble,
+};
+
+#else /* !__x86_64__ */
+
+# define xxh3_sse2 xxh3_generic
+# define xxh3_avx2 xxh3_generic
+# define xxh3_avx512 xxh3_generic
+
+#endif /* __x86_64__ */
+
+static void
+xxh3_state_init(struct xxh3_state *state, uint64_t seed)
+{
+    unsigned int count;
+
+    state->acc[0] = XXH3_PRIME32_3;
+    state->acc[1] = XXH3_PRIME64_1;
+    state->acc[2] = XXH3_PRIME64_2;
+    state->acc[3] = XXH3_PRIME64_3;
+    state->acc[4] = XXH3_PRIME64_4;
+    state->acc[5] = XXH3_PRIME32_2;
+    state->acc[6] = XXH3_PRIME64_5;
+    state->acc[7] = XXH3_PRIME32_1;
+
+    for (count = 0; count < XXH3_SECRET; count += 16) {
+        xxh3_write64(state->secret + count, xxh3_read64(xxh3_secret + count) + seed);
+        xxh3_write64(state->secret + count + 8, xxh3_read64(xxh3_secret + count + 8) - seed);
+    }
+
+    state->seed = seed;
+    state->total = 0;
+    state->buffered = 0;
+    state->stripes = 0;
+}
+
+static const uint8_t *
+xxh3_consume(const struct xxh3_kernel *kernel, uint64_t *acc, size_t *consumed,
+             const uint8_t *data, size_t stripes, const uint8_t *secret)
+{
+    const uint8_t *start = secret + *consumed * XXH3_SECRET_RATE;
+    size_t count;
+
+    if (stripes >= XXH3_BLOCK_STRIPES - *consumed) {
+        count = XXH3_BLOCK_STRIPES - *consumed;
+        do {
+            kernel->accumulate(acc, data, start, count);
+            kernel->scramble(acc, secret + XXH3_SECRET_LIMIT);
+            data += count * XXH3_STRIPE;
+            stripes -= count;
+            count = XXH3_BLOCK_STRIPES;
+            start = secret;
+        } while (stripes >= XXH3_BLOCK_STRIPES);
+        *consumed = 0;
+    }
+
+    if (stripes) {
+        kernel->accumulate(acc, data, start, stripes);
+        data += stripes * XXH3_STRIPE;
+        *consumed += stripes;
+    }
+
+    return data;
+}
+
+/*
+ * Stripes are only consumed while more input follows them: the final
+ * stripe is always taken at digest time, against its own secret slice.
+ */
+static void
+xxh3_state_update(const struct xxh3_kernel *kernel, struct xxh3_state *state,
+                  const uint8_t *data, size_t length)
+{
+    const uint8_t *end = data + length;
+    size_t load;
+
+    state->total += length;
+    if (length <= XXH3_BUFFER - state->buffered) {
+        memcpy(state->buffer + state->buffered, data, length);
+        state->buffered += length;
+        return;
+    }
+
+    if (state->buffered) {
+        load = XXH3_BUFFER - state->buffered;
+        memcpy(state->buffer + state->buffered, data, load);
+        data += load;
+        xxh3_consume(kernel, state->acc, &state->stripes, state->buffer,
+                     XXH3_BUFFER_STRIPES, state->secret);
+        state->buffered = 0;
+    }
+
+    if (end - data > XXH3_BUFFER) {
+        data = xxh3_consume(kernel, state->acc, &state->stripes, data,
+                            (end - data - 1) / XXH3_STRIPE, state->secret);
+        memcpy(state->buffer + XXH3_BUFFER - XXH3_STRIPE,
+               data - XXH3_STRIPE, XXH3_STRIPE);
+    }
+
+    memcpy(state->buffer, data, end - data);
+    state->buffered = end - data;
+}
+
+static void
+xxh3_state_long(const struct xxh3_kernel *kernel, const struct xxh3_state *state,
+                uint64_t *acc)
+{
+    uint8_t stripe[XXH3_STRIPE];
+    const uint8_t *last;
+    size_t consumed, catchup;
+
+    memcpy(acc, state->acc, sizeof(state->acc));
+    consumed = state->stripes;
+
+    if (state->buffered >= XXH3_STRIPE) {
+        xxh3_consume(kernel, acc, &consumed, state->buffer,
+                     (state->buffered - 1) / XXH3_STRIPE, state->secret);
+        last = state->buffer + state->buffered - XXH3_STRIPE;
+    } else {
+        catchup = XXH3_STRIPE - state->buffered;
+        memcpy(stripe, state->buffer + XXH3_BUFFER - catchup, catchup);
+        memcpy(stripe + catchup, state->buffer, state->buffered);
+        last = stripe;
+    }
+
+    kernel->accumulate(acc, last, state->secret + XXH3_SECRET_LIMIT -
+                       XXH3_SECRET_LAST, 1);
+}
+
+static uint64_t
+xxh3_merge(const uint64_t *acc, const uint8_t *secret, uint64_t start)
+{
+    unsigned int count;
+
+    for (count = 0; count < XXH3_ACC; count += 2) {
+        start += xxh3_fold64(acc[count] ^ xxh3_read64(secret + count * 8),
+                             acc[count + 1] ^ xxh3_read64(secret + count * 8 + 8));
+    }
+
+    return xxh3_avalanche(start);
+}
+
+static uint64_t
+xxh3_digest64(const struct xxh3_kernel *kernel, const struct xxh3_state *state)
+{
+    uint64_t acc[XXH3_ACC];
+
+    if (state->total <= XXH3_MIDSIZE)
+        return xxh3_short64(state->buffer, state->total, state->seed);
+
+    xxh3_state_long(kernel, state, acc);
+    return xxh3_merge(acc, state->secret + XXH3_SECRET_MERGE,
+                      state->total * XXH3_PRIME64_1);
+}
+
+static uint64_t
+xxh3_digest128(const struct xxh3_kernel *kernel, const struct xxh3_state *state,
+               uint64_t *high)
+{
+    uint64_t acc[XXH3_ACC];
+
+    if (state->total <= XXH3_MIDSIZE)
+        return xxh3_short128(state->buffer, state->total, state->seed, high);
+
+    xxh3_state_long(kernel, state, acc);
+    *high = xxh3_merge(acc, state->secret + XXH3_SECRET - XXH3_STRIPE -
+                       XXH3_SECRET_MERGE, ~(state->total * XXH3_PRIME64_2));
+    return xxh3_merge(acc, state->secret + XXH3_SECRET_MERGE,
+                      state->total * XXH3_PRIME64_1);
+}
+
+static void
+xxh3_feed(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct xxh3_context *xxh3 = csum_to_xxh3(ctx);
+    struct xxh3_impl *impl = algo_to_xxh3_impl(ctx->algo);
+    uintptr_t consumed = sta->offset;
+    size_t length;
+    const void *buff;
+
+    for (;;) {
+        length = ctx->next_block(ctx, sta, consumed, &buff);
+        if (!length)
+            break;
+
+        xxh3_state_update(impl->kernel, &xxh3->state, buff, length);
+        consumed += length;
+    }
+
+    sta->offset = consumed;
+}
+
+static const char *
+xxh3_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct xxh3_context *xxh3 = csum_to_xxh3(ctx);
+    struct xxh3_impl *impl = algo_to_xxh3_impl(ctx->algo);
+    uint64_t hash;
+
+    xxh3_feed(ctx, sta);
+    hash = xxh3_digest64(impl->kernel, &xxh3->state);
+    sprintf(xxh3->result, "%#018llx", (unsigned long long)hash);
+
+    return xxh3->result;
+}
+
+static const char *
+xxh128_compute(struct csum_context *ctx, struct csum_state *sta)
+{
+    struct xxh3_context *xxh3 = csum_to_xxh3(ctx);
+    struct xxh3_impl *impl = algo_to_xxh3_impl(ctx->algo);
+    uint64_t low, high;
+
+    xxh3_feed(ctx, sta);
+    low = xxh3_digest128(impl->kernel, &xxh3->state, &high);
+    sprintf(xxh3->result, "%#018llx%016llx",
+            (unsigned long long)high, (unsigned long long)low);
+
+    return xxh3->result;
+}
+
+static struct csum_context *
+xxh3_prepare(const char *args, unsigned long flags)
+{
+    struct xxh3_context *xxh3;
+    uint64_t seed = 0;
+
+    xxh3 = bfdev_zalloc(NULL, sizeof(*xxh3));
+    if (bfdev_unlikely(!xxh3))
+        return NULL;
+
+    if (args)
+        seed = strtoull(args, NULL, 0);
+    xxh3_state_init(&xxh3->state, seed);
+
+    return &xxh3->csum;
+}
+
+static void
+xxh3_destroy(struct csum_context *ctx)
+{
+    struct xxh3_context *xxh3 = csum_to_xxh3(ctx);
+    bfdev_free(NULL, xxh3);
+}
+
+static void
+xxh3_reset(struct csum_context *ctx)
+{
+    struct xxh3_context *xxh3 = csum_to_xxh3(ctx);
+    xxh3_state_init(&xxh3->state, xxh3->state.seed);
+}
+
+static struct csum_algo xxh3 = {
+    .name = "xxh3",
+    .prepare = xxh3_prepare,
+    .destroy = xxh3_destroy,
+    .reset = xxh3_reset,
+    .compute = xxh3_compute,
+};
+
+static struct csum_algo xxh128 = {
+    .name = "xxh128",
+    .prepare = xxh3_prepare,
+    .destroy = xxh3_destroy,
+    .reset = xxh3_reset,
+    .compute = xxh128_compute,
+};
+
+#define XXH3_IMPLS(prefix) { \
+    { \
+        .algo = { \
+            .driver = prefix "-generic", \
+            .priority = CSUM_PRIO_GENERIC, \
+        }, \
+        .kernel = &xxh3_generic, \
+    }, { \
+        .algo = { \
+            .driver = prefix "-sse2", \
+            .priority = CSUM_PRIO_SIMD, \
+            .features = CSUM_CPU_SSE2, \
+        }, \
+        .kernel = &xxh3_sse2, \
+    }, { \
+        .algo = { \
+            .driver = prefix "-avx2", \
+            .priority = CSUM_PRIO_WIDE, \
+            .features = CSUM_CPU_SSE2 | CSUM_CPU_AVX2, \
+        }, \
+        .kernel = &xxh3_avx2, \
+    }, { \
+        .algo = { \
+            .driver = prefix "-avx512", \
+            .priority = CSUM_PRIO_WIDE + 1, \
+            .features = CSUM_CPU_SSE2 | CSUM_CPU_AVX2 | CSUM_CPU_AVX512F, \
+        }, \
+        .kernel = &xxh3_avx512, \
+    }, \
+}
+
+static struct xxh3_impl xxh3_impls[] = XXH3_IMPLS("xxh3");
+static struct xxh3_impl xxh128_impls[] = XXH3_IMPLS("xxh128");
+
+#define XXH3_IMPL_COUNT \
+    (sizeof(xxh3_impls) / sizeof(*xxh3_impls))
+
+/*
+ * A kernel is only offered once it matches the generic one over a few
+ * blocks, each length crossing a different buffer and block boundary.
+ */
+static bool
+xxh3_verify(const struct xxh3_kernel *kernel)
+{
+    static const size_t lengths[] = {
+        241, 1024, 1025, 2048 + 63, 4096 + 257,
+    };
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    struct xxh3_state state, expect;
+    uint8_t data[4096 + 257];
+    uint64_t high, ehigh;
+    unsigned int count;
+
+    for (count = 0; count < sizeof(data); ++count) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[count] = seed >> 56;
+    }
+
+    for (count = 0; count < sizeof(lengths) / sizeof(*lengths); ++count) {
+        xxh3_state_init(&state, seed >> count);
+        expect = state;
+
+        xxh3_state_update(kernel, &state, data, lengths[count]);
+        xxh3_state_update(&xxh3_generic, &expect, data, lengths[count]);
+
+        if (xxh3_digest128(kernel, &state, &high) !=
+            xxh3_digest128(&xxh3_generic, &expect, &ehigh) || high != ehigh)
+            return false;
+    }
+
+    return true;
+}
+
+static void
+xxh3_impl_unregister(struct xxh3_impl *impls)
+{
+    unsigned int index;
+
+    for (index = 0; index < XXH3_IMPL_COUNT; ++index) {
+        if (!impls[index].registered)
+            continue;
+
+        csum_unregister(&impls[index].algo);
+        impls[index].registered = false;
+    }
+}
+
+static int
+xxh3_impl_register(struct xxh3_impl *impls, const struct csum_algo *template,
+                   const bool *verified)
+{
+    struct xxh3_impl *impl;
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < XXH3_IMPL_COUNT; ++index) {
+        impl = &impls[index];
+        impl->algo.name = template->name;
+        impl->algo.desc = template->desc;
+        impl->algo.prepare = template->prepare;
+        impl->algo.destroy = template->destroy;
+        impl->algo.reset = template->reset;
+        impl->algo.compute = template->compute;
+
+        if (!verified[index])
+            continue;
+
+        retval = csum_register(&impl->algo);
+        if (retval) {
+            xxh3_impl_unregister(impls);
+            return retval;
+        }
+
+        impl->registered = true;
+    }
+
+    return 0;
+}
+
+static int __bfdev_ctor
+xxh3_init(void)
+{
+    bool verified[XXH3_IMPL_COUNT];
+    unsigned int index;
+    int retval;
+
+    for (index = 0; index < XXH3_IMPL_COUNT; ++index) {
+        verified[index] = !index ||
+            (xxh3_impls[index].algo.features & ~csum_cpu_features()) ||
+            xxh3_verify(xxh3_impls[index].kernel);
+    }
+
+    retval = xxh3_impl_register(xxh3_impls, &xxh3, verified);
+    if (retval)
+        return retval;
+
+    retval = xxh3_impl_register(xxh128_impls, &xxh128, verified);
+    if (retval)
+        xxh3_impl_unregister(xxh3_impls);
+
+    return retval;
+}
+
+static void __bfdev_dtor
+xxh3_exit(void)
+{
+    xxh3_impl_unregister(xxh128_impls);
+    xxh3_impl_unregister(xxh3_impls);
+}